@@ -1,58 +1,390 @@
-#include <stdio.h>      // snprintf, vsnprintf
+#ifdef __linux__
+#define _GNU_SOURCE     // sendmmsg, struct mmsghdr, setns
+#endif
+
+#include <stdio.h>      // snprintf, vsnprintf, fopen, fread
 #include <stdlib.h>     // malloc, free
 #include <stdarg.h>     // va_start, va_end, va_list
-#include <string.h>     // memset, memcpy, strlen, strcpy, strcmp, strncasecmp, strerror
-#include <ctype.h>      // isprint, isspace
+#include <string.h>     // memset, memcpy, memmem, strlen, strcpy, strcmp, strncasecmp, strerror
 #include <errno.h>      // errno
 #include <unistd.h>     // close
 #include <sys/time.h>   // gettimeofday
+#include <time.h>       // nanosleep, clock_gettime
 #include <sys/ioctl.h>  // ioctl, FIONBIO
-#include <net/if.h>     // struct ifconf, struct ifreq
-#include <fcntl.h>      // fcntl, F_GETFD, F_SETFD, FD_CLOEXEC
-#include <sys/socket.h> // struct sockaddr, AF_INET, SOL_SOCKET, socklen_t, setsockopt, socket, bind, sendto, recvfrom
-#include <netinet/in.h> // struct sockaddr_in, struct ip_mreq, INADDR_ANY, IPPROTO_IP, also include <sys/socket.h>
+#include <net/if.h>     // IFF_UP, if_nametoindex
+#include <ifaddrs.h>    // getifaddrs, freeifaddrs
+#include <fcntl.h>      // fcntl, open, F_GETFD, F_SETFD, FD_CLOEXEC
+#include <sys/mman.h>   // mmap, munmap, shm_open, shm_unlink
+#include <sys/stat.h>   // fstat
+#include <limits.h>     // PATH_MAX
+#include <sched.h>      // sched_yield, setns, CLONE_NEWNET
+#include <sys/socket.h> // struct sockaddr, AF_INET, SOL_SOCKET, socklen_t, setsockopt, socket, bind, sendto, sendmmsg, recvmsg
+#include <sys/uio.h>    // struct iovec
+#include <poll.h>       // poll, struct pollfd
+#include <netinet/in.h> // struct sockaddr_in, struct sockaddr_in6, struct ip_mreq, struct ipv6_mreq, INADDR_ANY, IPPROTO_IP, IPPROTO_IPV6, also include <sys/socket.h>
 #include <arpa/inet.h>  // inet_aton, inet_ntop, inet_addr, also include <netinet/in.h>
 #include "lssdp.h"
 
-#ifndef _SIZEOF_ADDR_IFREQ
-#define _SIZEOF_ADDR_IFREQ sizeof
+/** Definition **/
+#ifndef LSSDP_BUFFER_LEN
+#define LSSDP_BUFFER_LEN    LSSDP_PROFILE_SELECT(1024, 2048, 2048)
 #endif
+#define LSSDP_CONTROL_LEN   128     // ancillary data of recvmsg: SCM_TIMESTAMPNS, SO_RXQ_OVFL
 
-/** Definition **/
-#define LSSDP_BUFFER_LEN    2048
-#define lssdp_debug(fmt, agrs...) lssdp_log(LSSDP_LOG_DEBUG, __LINE__, __func__, fmt, ##agrs)
-#define lssdp_info(fmt, agrs...)  lssdp_log(LSSDP_LOG_INFO,  __LINE__, __func__, fmt, ##agrs)
-#define lssdp_warn(fmt, agrs...)  lssdp_log(LSSDP_LOG_WARN,  __LINE__, __func__, fmt, ##agrs)
-#define lssdp_error(fmt, agrs...) lssdp_log(LSSDP_LOG_ERROR, __LINE__, __func__, fmt, ##agrs)
+// SO_*BUFFORCE (Linux, CAP_NET_ADMIN) exceeds rmem_max / wmem_max, otherwise SO_*BUF
+#ifndef SO_RCVBUFFORCE
+#define SO_RCVBUFFORCE      SO_RCVBUF
+#define SO_SNDBUFFORCE      SO_SNDBUF
+#endif
+
+/* Log Format
+ *  1: message is formatted by vsnprintf
+ *  0: debug / info are compiled out, the format string of warn / error is the message (arguments are not evaluated)
+ */
+#ifndef LSSDP_LOG_FORMAT
+#define LSSDP_LOG_FORMAT    LSSDP_PROFILE_SELECT(0, 1, 1)
+#endif
+
+#if LSSDP_LOG_FORMAT
+#define lssdp_debug(fmt, agrs...) lssdp_log(lssdp, LSSDP_LOG_DEBUG, __LINE__, __func__, fmt, ##agrs)
+#define lssdp_info(fmt, agrs...)  lssdp_log(lssdp, LSSDP_LOG_INFO,  __LINE__, __func__, fmt, ##agrs)
+#define lssdp_warn(fmt, agrs...)  lssdp_log(lssdp, LSSDP_LOG_WARN,  __LINE__, __func__, fmt, ##agrs)
+#define lssdp_error(fmt, agrs...) lssdp_log(lssdp, LSSDP_LOG_ERROR, __LINE__, __func__, fmt, ##agrs)
+#else
+// the dead branch keeps the arguments referenced (no unused variable warning)
+#define lssdp_log_drop(level, fmt, agrs...) do { if (0) lssdp_log(lssdp, level, __LINE__, __func__, fmt, ##agrs); } while (0)
+#define lssdp_log_raw(level, fmt, agrs...)  do { lssdp_log(lssdp, level, __LINE__, __func__, fmt); lssdp_log_drop(level, fmt, ##agrs); } while (0)
+#define lssdp_debug(fmt, agrs...) lssdp_log_drop(LSSDP_LOG_DEBUG, fmt, ##agrs)
+#define lssdp_info(fmt, agrs...)  lssdp_log_drop(LSSDP_LOG_INFO,  fmt, ##agrs)
+#define lssdp_warn(fmt, agrs...)  lssdp_log_raw(LSSDP_LOG_WARN,   fmt, ##agrs)
+#define lssdp_error(fmt, agrs...) lssdp_log_raw(LSSDP_LOG_ERROR,  fmt, ##agrs)
+#endif
+
+/* USDT probes of provider "lssdp", e.g. bpftrace -e 'usdt:./daemon.exe:lssdp:packet_parse { printf("%s\n", str(arg1)); }'
+ * a nop instruction when <sys/sdt.h> (systemtap sdt) is found, otherwise compiled out (or -DLSSDP_NO_USDT) */
+#if !defined(LSSDP_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define LSSDP_USDT
+#endif
+#endif
+
+#ifdef LSSDP_USDT
+#define lssdp_probe(name, args...) STAP_PROBEV(lssdp, name, ##args)
+#else
+#define lssdp_probe(name, args...) do {} while (0)
+#endif
 
 
 /** Struct: lssdp_packet **/
 typedef struct lssdp_packet {
     char            method      [LSSDP_FIELD_LEN];      // M-SEARCH, NOTIFY, RESPONSE
-    char            st          [LSSDP_FIELD_LEN];      // Search Target
-    char            usn         [LSSDP_FIELD_LEN];      // Unique Service Name
-    char            location    [LSSDP_LOCATION_LEN];   // Location
+    const char *    st;                                 // Search Target
+    const char *    usn;                                // Unique Service Name
+    const char *    location;                           // Location
+    const char *    nts;                                // Notification Sub Type: ssdp:alive, ssdp:byebye, ssdp:update
 
     /* Additional SSDP Header Fields */
-    char            sm_id       [LSSDP_FIELD_LEN];
-    char            device_type [LSSDP_FIELD_LEN];
+    const char *    sm_id;
+    const char *    device_type;
     long long       update_time;
+
+    /* Header Fields (the fields above point to the values, "" if not found) */
+    char *          header;                             // "NAME\0VALUE\0...", buffer is not shorter than packet
+    size_t          header_len;
+
+    /* Datagram (change suppression) */
+    uint64_t        datagram_hash;                      // hash of datagram and source IP
+    size_t          datagram_len;
+
+    /* Source */
+    int             family;                                 // AF_INET, AF_INET6
+    char            ip          [LSSDP_IP_LEN];             // source IP
+    char            interface   [LSSDP_INTERFACE_NAME_LEN]; // interface in LAN of source IP
+
+    /* Latency Trace (ns, 0: not traced) */
+    long long       recv_ns;                            // kernel receive timestamp
+    long long       stage_ns;                           // start time of neighbor list update
 } lssdp_packet;
 
 
+/** Struct: lssdp_batch **/
+#ifndef LSSDP_BATCH_SIZE
+#define LSSDP_BATCH_SIZE    LSSDP_PROFILE_SELECT(1, 16, 64)    // packets of a sendmmsg, the batch is on stack
+#endif
+typedef struct lssdp_batch {
+    int                 fd;                                         // socket to send packets
+    struct sockaddr_storage address;                                // destination address
+    socklen_t           address_len;                                // destination address length
+    struct sockaddr_storage * to;                                   // destination address of each packet (NULL: address)
+    size_t              num;                                        // packet number in batch
+    size_t              len     [LSSDP_BATCH_SIZE];                 // packet length
+    char                packet  [LSSDP_BATCH_SIZE][LSSDP_BUFFER_LEN];
+} lssdp_batch;
+
+
+/** Struct: lssdp_snapshot **/
+#define LSSDP_SNAPSHOT_MAGIC        0x424E534C              // "LSNB" in little endian
+#define LSSDP_SNAPSHOT_VERSION      2
+typedef struct lssdp_snapshot_header {
+    uint32_t            magic;                              // LSSDP_SNAPSHOT_MAGIC (host byte order)
+    uint16_t            version;                            // LSSDP_SNAPSHOT_VERSION
+    uint16_t            header_len;                         // sizeof(lssdp_snapshot_header)
+    uint32_t            neighbor_num;                       // neighbor record number
+    uint32_t            checksum;                           // FNV-1a of records
+    int64_t             save_time;                          // milliseconds
+    uint64_t            record_len;                         // total length of records
+} lssdp_snapshot_header;
+
+/* neighbor record:
+ *   int64_t update_time, uint8_t family,
+ *   then ip, interface (without null), header fields: each is uint32_t length + data
+ */
+#define LSSDP_SNAPSHOT_FIELD_NUM    3
+
+
+/** Struct: lssdp_shm_table **/
+#define LSSDP_SHM_MAGIC             0x4D48534C              // "LSHM" in little endian
+#define LSSDP_SHM_VERSION           1
+#define LSSDP_SHM_READ_RETRY        1000
+typedef struct lssdp_shm_table {
+    uint32_t            magic;                              // LSSDP_SHM_MAGIC, 0: destroyed
+    uint32_t            version;                            // LSSDP_SHM_VERSION
+    uint32_t            slot_size;                          // sizeof(lssdp_shm_nbr)
+    uint32_t            capacity;                           // slot number
+    uint32_t            seq;                                // sequence lock: odd while writer is updating
+    uint32_t            neighbor_num;                       // published neighbor number (neighbor[0] ~ neighbor[neighbor_num - 1])
+    uint32_t            overflow_num;                       // neighbor number which is not published (table is full)
+    uint32_t            reserved;
+    int64_t             update_time;                        // milliseconds
+    lssdp_shm_nbr       neighbor[];
+} lssdp_shm_table;
+
+
+/** Announce Scheduler **/
+#define LSSDP_MAX_AGE                   120                 // default CACHE-CONTROL max-age (seconds)
+#define LSSDP_ANNOUNCE_BURST            3                   // NOTIFY number of initial burst
+#define LSSDP_ANNOUNCE_BURST_INTERVAL   1000                // max NOTIFY interval of initial burst (ms)
+#define LSSDP_ANNOUNCE_DELAY            100                 // max random delay of the first NOTIFY / M-SEARCH (ms)
+#define LSSDP_ANNOUNCE_JITTER           25                  // max jitter of interval (percent, subtracted)
+#define LSSDP_ANNOUNCE_MSEARCH_MIN      2000                // default announce.msearch_min (ms)
+#define LSSDP_ANNOUNCE_MSEARCH_MAX      300000              // default announce.msearch_max (ms)
+
+
+/** Struct: lssdp_pcap **/
+#define LSSDP_PCAP_INTERFACE_SIZE   16
+#ifndef LSSDP_PCAP_PACKET_LEN
+#define LSSDP_PCAP_PACKET_LEN       LSSDP_PROFILE_SELECT(65536, 262144, 262144)     // max snapshot length
+#endif
+typedef struct lssdp_pcap {
+    FILE *              fp;
+    bool                is_swap;                            // byte order of file is different from host
+    bool                is_realtime;                        // replay at recorded pace
+    long long           first_time;                         // timestamp of the first packet (us)
+    long long           start_time;                         // replay start time (us)
+    size_t              packet_num;                         // replayed SSDP packet number
+    size_t              interface_num;                      // pcapng interface number
+    struct {
+        int             linktype;
+        uint8_t         tsresol;                            // pcapng if_tsresol (default 6: us)
+    } interface[LSSDP_PCAP_INTERFACE_SIZE];
+} lssdp_pcap;
+
+
+/** Struct: lssdp_fetcher (description fetcher) **/
+#define LSSDP_FETCH_CONCURRENCY     8
+#define LSSDP_FETCH_TIMEOUT         5000                    // ms
+#ifndef LSSDP_FETCH_MAX_SIZE
+#define LSSDP_FETCH_MAX_SIZE        LSSDP_PROFILE_SELECT(16 * 1024, 64 * 1024, 64 * 1024)
+#endif
+#ifndef LSSDP_FETCH_CACHE_MAX
+#define LSSDP_FETCH_CACHE_MAX       LSSDP_PROFILE_SELECT(16, 256, 1024)
+#endif
+#ifndef LSSDP_FETCH_CONN_MAX
+#define LSSDP_FETCH_CONN_MAX        LSSDP_PROFILE_SELECT(8, 64, 256)    // max connections, in flight and idle
+#endif
+#define LSSDP_FETCH_IDLE_TIME       10000                   // idle keep-alive connection is closed (ms)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL        0                               // SO_NOSIGPIPE is set instead
+#endif
+
+enum {
+    FETCH_CONNECTING = 0,
+    FETCH_SENDING,
+    FETCH_RECEIVING,
+    FETCH_IDLE                                              // keep-alive, in connection pool
+};
+
+typedef struct lssdp_desc {
+    struct lssdp_desc * prev;                               // cache list, the most recently used first
+    struct lssdp_desc * next;
+    struct lssdp_desc * hash_next;                          // next entry in the same slot of cache table
+    uint32_t            hash;                               // hash of key
+    size_t              ref;                                // neighbors using the description
+    size_t              len;                                // description length
+    size_t              size;                               // allocation size (counted in neighbor_memory)
+    const char *        key;                                // key, after description in data
+    char                data[];                             // "description\0key\0"
+} lssdp_desc;
+
+typedef struct lssdp_fetch_conn {
+    int                 fd;
+    int                 state;                              // FETCH_*
+    bool                is_reused;                          // request is sent on an idle connection
+    struct sockaddr_storage address;                        // server address (connection pool key)
+    socklen_t           address_len;
+    lssdp_nbr *         nbr;                                // NULL: neighbor is removed or changed, the response is cached only
+    uint32_t            hash;                               // hash of description key
+    char *              key;                                // description key
+    char                request[LSSDP_BUFFER_LEN];
+    size_t              request_len;
+    size_t              sent_len;
+    char *              response;                           // null-terminated
+    size_t              response_len;
+    size_t              response_size;                      // buffer size
+    long long           time;                               // request start time, or idle start time (ms)
+    struct lssdp_fetch_conn * next;
+} lssdp_fetch_conn;
+
+typedef struct lssdp_fetcher {
+    lssdp_fetch_conn *  conn_list;
+    size_t              conn_num;
+    lssdp_nbr *         queue;                              // neighbors waiting for request
+    lssdp_nbr *         queue_last;
+    lssdp_desc *        cache;                              // the most recently used first
+    lssdp_desc *        cache_last;
+    lssdp_desc **       cache_table;                        // hash table of cache
+    size_t              cache_table_size;
+    size_t              cache_num;
+    size_t              cache_unused_num;                   // entries which are not used by neighbors
+    size_t              cache_memory;                       // memory of cache entries (counted in neighbor_memory)
+} lssdp_fetcher;
+
+
 /** Internal Function **/
-static int send_multicast_data(const char * data, const struct lssdp_interface interface, unsigned short ssdp_port);
-static int lssdp_send_response(lssdp_ctx * lssdp, struct sockaddr_in address);
-static int lssdp_packet_parser(const char * data, size_t data_len, lssdp_packet * packet);
-static int parse_field_line(const char * data, size_t start, size_t end, lssdp_packet * packet);
-static int get_colon_index(const char * string, size_t start, size_t end);
+static int lssdp_packet_handler(lssdp_ctx * lssdp, const char * buffer, size_t buffer_len, const struct sockaddr * address, long long timestamp, long long recv_ns);
+static int ssdp_socket_create(lssdp_ctx * lssdp, int family);
+static int netns_enter(lssdp_ctx * lssdp, int * original_fd);
+static int netns_leave(lssdp_ctx * lssdp, int original_fd);
+static void netns_close(lssdp_ctx * lssdp);
+static void multicast_membership_update(lssdp_ctx * lssdp, const struct lssdp_interface * original_list, size_t original_num);
+static int multicast_membership(lssdp_ctx * lssdp, const struct lssdp_interface * interface, bool is_join);
+static bool interface_list_has_group(const struct lssdp_interface * list, size_t num, const struct lssdp_interface * interface);
+static int multicast_batch_open(lssdp_ctx * lssdp, const struct lssdp_interface * interface, lssdp_batch * batch);
+static bool is_loopback_interface(const struct lssdp_interface * interface);
+static bool is_link_local_interface(const struct lssdp_interface * interface);
+static const char * get_multicast_host(const struct lssdp_interface * interface);
+static const char * get_location_host(const struct lssdp_interface * interface, char * host);
+static int get_address_ip(lssdp_ctx * lssdp, const struct sockaddr * address, char * ip);
+static socklen_t get_address_len(const struct sockaddr_storage * address);
+static int batch_add(lssdp_ctx * lssdp, lssdp_batch * batch, int packet_len);
+static int batch_flush(lssdp_ctx * lssdp, lssdp_batch * batch);
+static int lssdp_send_response(lssdp_ctx * lssdp, const struct sockaddr * address, const char * search_target);
+static int socket_close(lssdp_ctx * lssdp);
+static int send_notify(lssdp_ctx * lssdp, const char * nts);
+static int set_notify_packet(lssdp_ctx * lssdp, const struct lssdp_interface * interface, const lssdp_service * service, const char * nts, char * buffer);
+static int set_response_packet(lssdp_ctx * lssdp, const struct lssdp_interface * interface, const lssdp_service * service, char * buffer);
+static int set_msearch_packet(lssdp_ctx * lssdp, const char * host, const char * search_target, char * buffer);
+static int get_max_age(lssdp_ctx * lssdp);
+static void announce_reset(lssdp_ctx * lssdp, long long current_time);
+static uint32_t announce_header_hash(lssdp_ctx * lssdp);
+static long announce_jitter(lssdp_ctx * lssdp, long interval);
+static bool get_header_service(lssdp_ctx * lssdp, lssdp_service * service);
+static bool match_search_target(lssdp_ctx * lssdp, const char * search_target, lssdp_subscription ** subscription);
+static void subscription_prefix_mask_update(lssdp_ctx * lssdp);
+static uint32_t match_generation_update(lssdp_ctx * lssdp);
+static uint32_t get_hash(const char * string);
+static uint32_t get_prefix_hash(const char * string, size_t len);
+static uint32_t hash_update(uint32_t hash, char c);
+static uint64_t get_datagram_hash(const char * buffer, size_t buffer_len, const struct sockaddr * address);
+static int lssdp_packet_parser(lssdp_ctx * lssdp, const char * data, size_t data_len, lssdp_packet * packet);
+static void packet_header_link(lssdp_packet * packet);
+static const char * header_find(const char * header, size_t header_len, const char * name);
+static int parse_field_line(lssdp_ctx * lssdp, const char * data, size_t start, size_t end, lssdp_packet * packet);
 static int trim_spaces(const char * string, size_t * start, size_t * end);
+static bool is_trim_char(char c);
 static long long get_current_time();
-static int lssdp_log(int level, int line, const char * func, const char * format, ...);
-static int neighbor_list_add(lssdp_ctx * lssdp, const lssdp_packet packet);
+static long long get_current_time_ns();
+static long long receive_control_parse(lssdp_ctx * lssdp, struct msghdr * message, size_t sock_index);
+static int socket_buffer_set(lssdp_ctx * lssdp, int fd, int force_option, int option, int size);
+static void latency_add(lssdp_ctx * lssdp, int stage, long long latency_ns);
+static long long latency_record(lssdp_ctx * lssdp, int stage, long long start_ns);
+static int lssdp_log(lssdp_ctx * lssdp, int level, int line, const char * func, const char * format, ...);
+static bool allocator_is_set(const lssdp_ctx * lssdp);
+static void * lssdp_malloc(lssdp_ctx * lssdp, size_t size);
+static void * lssdp_calloc(lssdp_ctx * lssdp, size_t num, size_t size);
+static void * lssdp_realloc(lssdp_ctx * lssdp, void * ptr, size_t size);
+static void lssdp_free(lssdp_ctx * lssdp, void * ptr);
+static int neighbor_list_add(lssdp_ctx * lssdp, const lssdp_packet packet, lssdp_subscription * subscription);
+static lssdp_nbr * neighbor_find(lssdp_ctx * lssdp, const lssdp_packet * packet);
+static lssdp_nbr * neighbor_find_datagram(lssdp_ctx * lssdp, uint64_t datagram_hash, size_t datagram_len);
+static void neighbor_packet_view(const lssdp_packet * packet, lssdp_nbr * view);
+static uint32_t neighbor_key_hash(lssdp_ctx * lssdp, const lssdp_nbr * nbr);
+static bool neighbor_key_equal(lssdp_ctx * lssdp, const lssdp_nbr * a, const lssdp_nbr * b);
+static const char * neighbor_custom_key(lssdp_ctx * lssdp, const lssdp_nbr * nbr, char * key);
+static int neighbor_list_remove_usn(lssdp_ctx * lssdp, const char * usn);
+static void neighbor_list_remove(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static int neighbor_list_remove_interface(lssdp_ctx * lssdp);
+static int neighbor_set_header(lssdp_ctx * lssdp, lssdp_nbr * nbr, const lssdp_packet * packet);
+static int neighbor_list_evict(lssdp_ctx * lssdp, const lssdp_packet * packet);
+static void neighbor_evict(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void neighbor_age_touch(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void neighbor_age_unlink(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void neighbor_age_sort(lssdp_ctx * lssdp);
+static int neighbor_probe(lssdp_ctx * lssdp, lssdp_nbr * nbr, long long current_time, lssdp_batch * batch);
+static void neighbor_probe_wait(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void neighbor_probe_unlink(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void neighbor_subscription_link(lssdp_nbr * nbr, lssdp_subscription * subscription);
+static void neighbor_subscription_unlink(lssdp_nbr * nbr);
+static const char * neighbor_index_key(const lssdp_nbr * nbr, int index);
+static bool neighbor_index_is_optional(int index);
+static bool neighbor_index_skip(const lssdp_nbr * nbr, int index);
+static void neighbor_index_link(struct lssdp_nbr_index * index, lssdp_nbr * nbr, int i);
+static int neighbor_index_add(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void neighbor_index_remove(lssdp_nbr * nbr);
+static int neighbor_index_rebuild(lssdp_ctx * lssdp, size_t size);
 static int lssdp_neighbor_remove_all(lssdp_ctx * lssdp);
-static void neighbor_list_free(lssdp_nbr * list);
-static struct lssdp_interface * find_interface_in_LAN(lssdp_ctx * lssdp, uint32_t address);
+static void neighbor_list_free(lssdp_ctx * lssdp, lssdp_nbr * list);
+static size_t snapshot_fields(const lssdp_nbr * nbr, const char * fields[], size_t lens[]);
+static uint32_t snapshot_checksum(const uint8_t * data, size_t len);
+static void shm_publish(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void shm_unpublish(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void shm_refresh(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void shm_clear(lssdp_ctx * lssdp);
+static void shm_write_begin(lssdp_shm_table * table);
+static void shm_write_end(lssdp_ctx * lssdp, lssdp_shm_table * table);
+static int pcap_replay(lssdp_ctx * lssdp, lssdp_pcap * pcap, uint32_t magic);
+static int pcapng_replay(lssdp_ctx * lssdp, lssdp_pcap * pcap);
+static int pcap_packet_handler(lssdp_ctx * lssdp, lssdp_pcap * pcap, int linktype, const uint8_t * data, size_t len, long long timestamp);
+static void pcap_replay_wait(lssdp_pcap * pcap, long long timestamp);
+static long long pcap_time_us(uint64_t timestamp, uint8_t tsresol);
+static uint16_t pcap_u16(const lssdp_pcap * pcap, const uint8_t * data);
+static uint32_t pcap_u32(const lssdp_pcap * pcap, const uint8_t * data);
+static uint32_t fetch_key(const lssdp_nbr * nbr, char * key);
+static void fetch_neighbor_update(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void fetch_neighbor_release(lssdp_ctx * lssdp, lssdp_nbr * nbr);
+static void fetch_neighbor_done(lssdp_ctx * lssdp, lssdp_nbr * nbr, int status);
+static void fetch_queue_add(lssdp_fetcher * fetcher, lssdp_nbr * nbr);
+static void fetch_queue_remove(lssdp_fetcher * fetcher, lssdp_nbr * nbr);
+static int fetch_queue_start(lssdp_ctx * lssdp, long long current_time);
+static lssdp_desc * fetch_cache_find(lssdp_fetcher * fetcher, uint32_t hash, const char * key);
+static lssdp_desc * fetch_cache_add(lssdp_ctx * lssdp, uint32_t hash, const char * key, const char * data, size_t len);
+static void fetch_cache_attach(lssdp_ctx * lssdp, lssdp_desc * desc, lssdp_nbr * nbr);
+static void fetch_cache_trim(lssdp_ctx * lssdp, size_t memory);
+static int fetch_location_parse(lssdp_ctx * lssdp, const lssdp_nbr * nbr, struct sockaddr_storage * address, socklen_t * address_len, char * host, const char ** path);
+static int fetch_start(lssdp_ctx * lssdp, lssdp_nbr * nbr, const char * key, long long current_time);
+static lssdp_fetch_conn * fetch_conn_open(lssdp_ctx * lssdp, const struct sockaddr_storage * address, socklen_t address_len);
+static void fetch_conn_progress(lssdp_ctx * lssdp, lssdp_fetch_conn * conn, short revents, long long current_time);
+static int fetch_conn_receive(lssdp_ctx * lssdp, lssdp_fetch_conn * conn, long long current_time);
+static void fetch_conn_done(lssdp_ctx * lssdp, lssdp_fetch_conn * conn, const char * body, size_t body_len, bool is_keep_alive, long long current_time);
+static void fetch_conn_fail(lssdp_ctx * lssdp, lssdp_fetch_conn * conn, const char * reason);
+static void fetch_conn_close(lssdp_ctx * lssdp, lssdp_fetch_conn * conn);
+static int http_response_check(lssdp_ctx * lssdp, char * response, size_t response_len, bool is_eof, size_t * body_start, size_t * body_len, bool * is_keep_alive);
+static const char * http_header_value(const char * header, size_t header_len, const char * name, size_t * value_len);
+static int http_chunked_decode(char * data, size_t len, size_t * decode_len, bool is_decode);
+static struct lssdp_interface * find_interface_in_LAN(lssdp_ctx * lssdp, const struct sockaddr * address);
+static bool is_self_address(lssdp_ctx * lssdp, const struct sockaddr * address);
 
 
 /** Global Variable **/
@@ -67,6 +399,16 @@ static struct {
 
     const char * ADDR_LOCALHOST;
     const char * ADDR_MULTICAST;
+    const char * ADDR_MULTICAST6_LINK;
+    const char * ADDR_MULTICAST6_SITE;
+    const char * HOST_MULTICAST6_LINK;
+    const char * HOST_MULTICAST6_SITE;
+
+    const char * ST_ALL;
+
+    const char * NTS_ALIVE;
+    const char * NTS_BYEBYE;
+    const char * NTS_UPDATE;
 
     void (* log_callback)(const char * file, const char * tag, int level, int line, const char * func, const char * message);
 
@@ -84,6 +426,18 @@ static struct {
     // IP Address
     .ADDR_LOCALHOST = "127.0.0.1",
     .ADDR_MULTICAST = "239.255.255.250",
+    .ADDR_MULTICAST6_LINK = "ff02::c",
+    .ADDR_MULTICAST6_SITE = "ff05::c",
+    .HOST_MULTICAST6_LINK = "[FF02::C]",
+    .HOST_MULTICAST6_SITE = "[FF05::C]",
+
+    // Search Target
+    .ST_ALL = "ssdp:all",
+
+    // Notification Sub Type
+    .NTS_ALIVE  = "ssdp:alive",
+    .NTS_BYEBYE = "ssdp:byebye",
+    .NTS_UPDATE = "ssdp:update",
 
     // Log Callback
     .log_callback = NULL
@@ -102,6 +456,7 @@ int lssdp_network_interface_update(lssdp_ctx * lssdp) {
     // 1. copy orginal interface
     struct lssdp_interface original_interface[LSSDP_INTERFACE_LIST_SIZE] = {};
     memcpy(original_interface, lssdp->interface, SIZE_OF_INTERFACE_LIST);
+    size_t original_interface_num = lssdp->interface_num;
 
     // 2. reset lssdp->interface
     lssdp->interface_num = 0;
@@ -109,70 +464,62 @@ int lssdp_network_interface_update(lssdp_ctx * lssdp) {
 
     int result = -1;
 
-    /* Reference to this article:
-     * http://stackoverflow.com/a/8007079
-     */
-
-    // 3. create UDP socket
-    int fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (fd < 0) {
-        lssdp_error("create socket failed, errno = %s (%d)\n", strerror(errno), errno);
+    // 3. get interface addresses (of the network namespace)
+    struct ifaddrs * ifaddr = NULL;
+    int original_fd = -1;
+    if (netns_enter(lssdp, &original_fd) != 0) {
         goto end;
     }
 
-    // 4. get ifconfig
-    char buffer[LSSDP_BUFFER_LEN] = {};
-    struct ifconf ifc = {
-        .ifc_len = sizeof(buffer),
-        .ifc_buf = (caddr_t) buffer
-    };
-
-    if (ioctl(fd, SIOCGIFCONF, &ifc) < 0) {
-        lssdp_error("ioctl SIOCGIFCONF failed, errno = %s (%d)\n", strerror(errno), errno);
+    if (getifaddrs(&ifaddr) != 0) {
+        lssdp_error("getifaddrs failed, errno = %s (%d)\n", strerror(errno), errno);
         goto end;
     }
 
-    // 5. setup lssdp->interface
-    size_t i;
-    struct ifreq * ifr;
-    for (i = 0; i < ifc.ifc_len; i += _SIZEOF_ADDR_IFREQ(*ifr)) {
-        ifr = (struct ifreq *)(buffer + i);
-        if (ifr->ifr_addr.sa_family != AF_INET) {
-            // only support IPv4
+    // 4. setup lssdp->interface
+    struct ifaddrs * ifa;
+    for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr == NULL || ifa->ifa_netmask == NULL || (ifa->ifa_flags & IFF_UP) == 0) {
             continue;
         }
 
-        // 5-1. get interface ip string
-        char ip[LSSDP_IP_LEN] = {};
-        struct sockaddr_in * addr = (struct sockaddr_in *) &ifr->ifr_addr;
-        if (inet_ntop(AF_INET, &addr->sin_addr, ip, sizeof(ip)) == NULL) {
-            lssdp_error("inet_ntop failed, errno = %s (%d)\n", strerror(errno), errno);
+        int family = ifa->ifa_addr->sa_family;
+        if (family != AF_INET && (family != AF_INET6 || lssdp->ipv6 == false)) {
+            // IPv4, and IPv6 if it is enabled
             continue;
         }
 
-        // 5-2. get network mask
-        struct ifreq netmask = {};
-        strcpy(netmask.ifr_name, ifr->ifr_name);
-        if (ioctl(fd, SIOCGIFNETMASK, &netmask) != 0) {
-            lssdp_error("ioctl SIOCGIFNETMASK failed, errno = %s (%d)\n", strerror(errno), errno);
+        // 4-1. get interface ip string
+        char ip[LSSDP_IP_LEN] = {};
+        const void * addr = family == AF_INET
+                          ? (const void *) &((struct sockaddr_in  *) ifa->ifa_addr)->sin_addr
+                          : (const void *) &((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_addr;
+        if (inet_ntop(family, addr, ip, sizeof(ip)) == NULL) {
+            lssdp_error("inet_ntop failed, errno = %s (%d)\n", strerror(errno), errno);
             continue;
         }
 
-        // 5-3. check network interface number
+        // 4-2. check network interface number
         if (lssdp->interface_num >= LSSDP_INTERFACE_LIST_SIZE) {
-            lssdp_warn("interface number is over than MAX SIZE (%d)     %s %s\n", LSSDP_INTERFACE_LIST_SIZE, ifr->ifr_name, ip);
+            lssdp_warn("interface number is over than MAX SIZE (%d)     %s %s\n", LSSDP_INTERFACE_LIST_SIZE, ifa->ifa_name, ip);
             continue;
         }
 
-        // 5-4. set interface
-        size_t n = lssdp->interface_num;
-        snprintf(lssdp->interface[n].name, LSSDP_INTERFACE_NAME_LEN, "%s", ifr->ifr_name); // name
-        snprintf(lssdp->interface[n].ip,   LSSDP_IP_LEN,             "%s", ip);            // ip string
-        lssdp->interface[n].addr = addr->sin_addr.s_addr;                                  // address in network byte order
-
-        // set network mask
-        addr = (struct sockaddr_in *) &netmask.ifr_addr;
-        lssdp->interface[n].netmask = addr->sin_addr.s_addr;                               // mask in network byte order
+        // 4-3. set interface
+        struct lssdp_interface * interface = &lssdp->interface[lssdp->interface_num];
+        snprintf(interface->name, LSSDP_INTERFACE_NAME_LEN, "%s", ifa->ifa_name);  // name
+        snprintf(interface->ip,   LSSDP_IP_LEN,             "%s", ip);             // ip string
+        interface->family = family;
+        interface->index  = if_nametoindex(ifa->ifa_name);
+
+        if (family == AF_INET) {
+            // address and network mask in network byte order
+            interface->addr    = ((struct sockaddr_in *) ifa->ifa_addr)->sin_addr.s_addr;
+            interface->netmask = ((struct sockaddr_in *) ifa->ifa_netmask)->sin_addr.s_addr;
+        } else {
+            memcpy(interface->addr6,    &((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_addr,    16);
+            memcpy(interface->netmask6, &((struct sockaddr_in6 *) ifa->ifa_netmask)->sin6_addr, 16);
+        }
 
         // increase interface number
         lssdp->interface_num++;
@@ -180,9 +527,11 @@ int lssdp_network_interface_update(lssdp_ctx * lssdp) {
 
     result = 0;
 end:
-    // close socket
-    if (fd >= 0 && close(fd) != 0) {
-        lssdp_error("close fd %d failed, errno = %s (%d)\n", strerror(errno), errno);
+    if (netns_leave(lssdp, original_fd) != 0) {
+        result = -1;
+    }
+    if (ifaddr != NULL) {
+        freeifaddrs(ifaddr);
     }
 
     // compare with original interface
@@ -192,11 +541,18 @@ end:
     }
 
     /* Network Interface is changed */
+    lssdp_probe(interface_change, original_interface_num, lssdp->interface_num);
 
-    // 1. force clean up neighbor_list
-    lssdp_neighbor_remove_all(lssdp);
+    // 1. join / drop multicast group of the added / removed interfaces
+    multicast_membership_update(lssdp, original_interface, original_interface_num);
+
+    // 2. remove the neighbors of the removed interfaces
+    neighbor_list_remove_interface(lssdp);
 
-    // 2. invoke network interface changed callback
+    // 3. re-announce on the changed interfaces (lssdp_announce)
+    lssdp->announce.header_hash = 0;
+
+    // 4. invoke network interface changed callback
     if (lssdp->network_interface_changed_callback != NULL) {
         lssdp->network_interface_changed_callback(lssdp);
     }
@@ -216,70 +572,32 @@ int lssdp_socket_create(lssdp_ctx * lssdp) {
         return -1;
     }
 
-    // close original SSDP socket
-    lssdp_socket_close(lssdp);
+    // close original SSDP socket (re-bind: no ssdp:byebye)
+    socket_close(lssdp);
+    memset(lssdp->stats.drop_counter, 0, sizeof(lssdp->stats.drop_counter));
 
-    // create UDP socket
-    lssdp->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    // create IPv4 SSDP socket
+    lssdp->sock = ssdp_socket_create(lssdp, AF_INET);
     if (lssdp->sock < 0) {
-        lssdp_error("create socket failed, errno = %s (%d)\n", strerror(errno), errno);
-        return -1;
-    }
-
-    int result = -1;
-
-    // set non-blocking
-    int opt = 1;
-    if (ioctl(lssdp->sock, FIONBIO, &opt) != 0) {
-        lssdp_error("ioctl FIONBIO failed, errno = %s (%d)\n", strerror(errno), errno);
-        goto end;
-    }
-
-    // set reuse address
-    if (setsockopt(lssdp->sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) != 0) {
-        lssdp_error("setsockopt SO_REUSEADDR failed, errno = %s (%d)\n", strerror(errno), errno);
-        goto end;
+        goto err;
     }
+    lssdp_info("create SSDP socket %d\n", lssdp->sock);
 
-    // set FD_CLOEXEC (http://kaivy2001.pixnet.net/blog/post/32726732)
-    int sock_opt = fcntl(lssdp->sock, F_GETFD);
-    if (sock_opt == -1) {
-        lssdp_error("fcntl F_GETFD failed, errno = %s (%d)\n", strerror(errno), errno);
-    } else {
-        // F_SETFD
-        if (fcntl(lssdp->sock, F_SETFD, sock_opt | FD_CLOEXEC) == -1) {
-            lssdp_error("fcntl F_SETFD FD_CLOEXEC failed, errno = %s (%d)\n", strerror(errno), errno);
+    // create IPv6 SSDP socket
+    if (lssdp->ipv6) {
+        lssdp->sock6 = ssdp_socket_create(lssdp, AF_INET6);
+        if (lssdp->sock6 < 0) {
+            goto err;
         }
+        lssdp_info("create SSDP socket %d (IPv6)\n", lssdp->sock6);
     }
 
-    // bind socket
-    struct sockaddr_in addr = {
-        .sin_family      = AF_INET,
-        .sin_port        = htons(lssdp->port),
-        .sin_addr.s_addr = htonl(INADDR_ANY)
-    };
-    if (bind(lssdp->sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
-        lssdp_error("bind failed, errno = %s (%d)\n", strerror(errno), errno);
-        goto end;
-    }
-
-    // set IP_ADD_MEMBERSHIP
-    struct ip_mreq imr = {
-        .imr_multiaddr.s_addr = inet_addr(Global.ADDR_MULTICAST),
-        .imr_interface.s_addr = htonl(INADDR_ANY)
-    };
-    if (setsockopt(lssdp->sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &imr, sizeof(struct ip_mreq)) != 0) {
-        lssdp_error("setsockopt IP_ADD_MEMBERSHIP failed: %s (%d)\n", strerror(errno), errno);
-        goto end;
-    }
-
-    lssdp_info("create SSDP socket %d\n", lssdp->sock);
-    result = 0;
-end:
-    if (result == -1) {
-        lssdp_socket_close(lssdp);
-    }
-    return result;
+    // join multicast group on each interface
+    multicast_membership_update(lssdp, NULL, 0);
+    return 0;
+err:
+    socket_close(lssdp);
+    return -1;
 }
 
 // 03. lssdp_socket_close
@@ -289,24 +607,13 @@ int lssdp_socket_close(lssdp_ctx * lssdp) {
         return -1;
     }
 
-    // check lssdp->sock
-    if (lssdp->sock <= 0) {
-        lssdp_warn("SSDP socket is %d, ignore socket_close request.\n", lssdp->sock);
-        goto end;
+    // send ssdp:byebye burst before closing
+    if ((lssdp->sock > 0 || lssdp->sock6 > 0) && lssdp->port != 0 && lssdp->interface_num > 0) {
+        send_notify(lssdp, Global.NTS_BYEBYE);
     }
 
-    // close socket
-    if (close(lssdp->sock) != 0) {
-        lssdp_error("close socket %d failed, errno = %s (%d)\n", lssdp->sock, strerror(errno), errno);
-        return -1;
-    };
-
-    // close socket success
-    lssdp_info("close SSDP socket %d\n", lssdp->sock);
-end:
-    lssdp->sock = -1;
-    lssdp_neighbor_remove_all(lssdp);  // force clean up neighbor_list
-    return 0;
+    netns_close(lssdp);
+    return socket_close(lssdp);
 }
 
 // 04. lssdp_socket_read
@@ -317,7 +624,7 @@ int lssdp_socket_read(lssdp_ctx * lssdp) {
     }
 
     // check socket and port
-    if (lssdp->sock <= 0) {
+    if (lssdp->sock <= 0 && lssdp->sock6 <= 0) {
         lssdp_error("SSDP socket (%d) has not been setup.\n", lssdp->sock);
         return -1;
     }
@@ -327,59 +634,47 @@ int lssdp_socket_read(lssdp_ctx * lssdp) {
         return -1;
     }
 
-    char buffer[LSSDP_BUFFER_LEN] = {};
-    struct sockaddr_in address = {};
-    socklen_t address_len = sizeof(struct sockaddr_in);
-
-    ssize_t recv_len = recvfrom(lssdp->sock, buffer, sizeof(buffer), 0, (struct sockaddr *)&address, &address_len);
-    if (recv_len == -1) {
-        lssdp_error("recvfrom fd %d failed, errno = %s (%d)\n", lssdp->sock, strerror(errno), errno);
-        return -1;
-    }
-
-    // ignore the SSDP packet received from self
+    // read one packet from each SSDP socket (IPv4, IPv6)
+    int result = -1;
+    int sock[2] = {lssdp->sock, lssdp->sock6};
     size_t i;
-    for (i = 0; i < lssdp->interface_num; i++) {
-        if (lssdp->interface[i].addr == address.sin_addr.s_addr) {
-            goto end;
+    for (i = 0; i < 2; i++) {
+        if (sock[i] <= 0) {
+            continue;
         }
-    }
-
-    // parse SSDP packet to struct
-    lssdp_packet packet = {};
-    if (lssdp_packet_parser(buffer, recv_len, &packet) != 0) {
-        goto end;
-    }
 
-    // check search target
-    if (strcmp(packet.st, lssdp->header.search_target) != 0) {
-        // search target is not match
-        if (lssdp->debug) {
-            lssdp_info("RECV <- %-8s   not match with %-14s %s\n", packet.method, lssdp->header.search_target, packet.location);
+        char buffer[LSSDP_BUFFER_LEN] = {};
+        struct sockaddr_storage address = {};
+        char control[LSSDP_CONTROL_LEN];
+        struct iovec iov = {
+            .iov_base = buffer,
+            .iov_len  = sizeof(buffer) - 1
+        };
+        struct msghdr message = {
+            .msg_name       = &address,
+            .msg_namelen    = sizeof(address),
+            .msg_iov        = &iov,
+            .msg_iovlen     = 1,
+            .msg_control    = control,
+            .msg_controllen = sizeof(control)
+        };
+
+        ssize_t recv_len = recvmsg(sock[i], &message, 0);
+        if (recv_len == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                lssdp_error("recvmsg fd %d failed, errno = %s (%d)\n", sock[i], strerror(errno), errno);
+            }
+            continue;
         }
-        goto end;
-    }
-
-    // M-SEARCH: send RESPONSE back
-    if (strcmp(packet.method, Global.MSEARCH) == 0) {
-        lssdp_send_response(lssdp, address);
-        goto end;
-    }
-
-    // RESPONSE, NOTIFY: add to neighbor_list
-    neighbor_list_add(lssdp, packet);
-
-    if (lssdp->debug) {
-        lssdp_info("RECV <- %-8s   %-28s  %s\n", packet.method, packet.location, packet.sm_id);
-    }
 
-end:
-    // invoke packet received callback
-    if (lssdp->packet_received_callback != NULL) {
-        lssdp->packet_received_callback(lssdp, buffer, recv_len);
+        // kernel receive timestamp is the neighbor update_time, current time if it is not found
+        long long recv_ns = receive_control_parse(lssdp, &message, i);
+        long long timestamp = recv_ns > 0 ? recv_ns / 1000000 : get_current_time();
+        lssdp_packet_handler(lssdp, buffer, recv_len, (struct sockaddr *)&address, timestamp, recv_ns);
+        result = 0;
     }
 
-    return 0;
+    return result;
 }
 
 // 05. lssdp_send_msearch
@@ -400,20 +695,22 @@ int lssdp_send_msearch(lssdp_ctx * lssdp) {
         return -1;
     }
 
-    // 1. set M-SEARCH packet
-    char msearch[LSSDP_BUFFER_LEN] = {};
-    snprintf(msearch, sizeof(msearch),
-        "%s"
-        "HOST:%s:%d\r\n"
-        "MAN:\"ssdp:discover\"\r\n"
-        "MX:1\r\n"
-        "ST:%s\r\n"
-        "USER-AGENT:OS/version product/version\r\n"
-        "\r\n",
-        Global.HEADER_MSEARCH,              // HEADER
-        Global.ADDR_MULTICAST, lssdp->port, // HOST
-        lssdp->header.search_target         // ST (Search Target)
-    );
+    // 1. collect search targets: header, exact subscriptions, "ssdp:all" for prefix subscriptions
+    size_t st_num = 0;
+    const char * st_list[2];
+    if (strlen(lssdp->header.search_target) > 0) {
+        st_list[st_num++] = lssdp->header.search_target;
+    }
+
+    bool has_prefix = false;
+    lssdp_subscription * subscription;
+    for (subscription = lssdp->subscription_list; subscription != NULL; subscription = subscription->next) {
+        has_prefix |= subscription->is_prefix;
+    }
+
+    if (has_prefix) {
+        st_list[st_num++] = Global.ST_ALL;
+    }
 
     // 2. send M-SEARCH to each interface
     size_t i;
@@ -421,12 +718,37 @@ int lssdp_send_msearch(lssdp_ctx * lssdp) {
         struct lssdp_interface * interface = &lssdp->interface[i];
 
         // avoid sending multicast to localhost
-        if (interface->addr == inet_addr(Global.ADDR_LOCALHOST)) {
+        if (is_loopback_interface(interface)) {
+            continue;
+        }
+
+        // create multicast socket of the interface
+        lssdp_batch batch = {};
+        if (multicast_batch_open(lssdp, interface, &batch) != 0) {
             continue;
         }
 
+        // set M-SEARCH packet of each search target
+        int ret = 0;
+        size_t j;
+        for (j = 0; j < st_num; j++) {
+            ret |= batch_add(lssdp, &batch, set_msearch_packet(lssdp, get_multicast_host(interface), st_list[j], batch.packet[batch.num]));
+        }
+
+        for (subscription = lssdp->subscription_list; subscription != NULL; subscription = subscription->next) {
+            if (subscription->is_prefix) {
+                continue;
+            }
+            ret |= batch_add(lssdp, &batch, set_msearch_packet(lssdp, get_multicast_host(interface), subscription->search_target, batch.packet[batch.num]));
+        }
+
         // send M-SEARCH
-        int ret = send_multicast_data(msearch, *interface, lssdp->port);
+        ret |= batch_flush(lssdp, &batch);
+        if (close(batch.fd) != 0) {
+            lssdp_error("close fd %d failed, errno = %s (%d)\n", batch.fd, strerror(errno), errno);
+        }
+
+        lssdp_probe(multicast_send, Global.MSEARCH, interface->name, interface->ip, ret);
         if (ret == 0 && lssdp->debug) {
             lssdp_info("SEND => %-8s   %s => MULTICAST\n", Global.MSEARCH, interface->ip);
         }
@@ -453,52 +775,7 @@ int lssdp_send_notify(lssdp_ctx * lssdp) {
         return -1;
     }
 
-    size_t i;
-    for (i = 0; i < lssdp->interface_num; i++) {
-        struct lssdp_interface * interface = &lssdp->interface[i];
-
-        // avoid sending multicast to localhost
-        if (interface->addr == inet_addr(Global.ADDR_LOCALHOST)) {
-            continue;
-        }
-
-        // set notify packet
-        char notify[LSSDP_BUFFER_LEN] = {};
-        char * domain = lssdp->header.location.domain;
-        snprintf(notify, sizeof(notify),
-            "%s"
-            "HOST:%s:%d\r\n"
-            "CACHE-CONTROL:max-age=120\r\n"
-            "LOCATION:%s%s%s\r\n"
-            "SERVER:OS/version product/version\r\n"
-            "NT:%s\r\n"
-            "NTS:ssdp:alive\r\n"
-            "USN:%s\r\n"
-            "SM_ID:%s\r\n"
-            "DEV_TYPE:%s\r\n"
-            "\r\n",
-            Global.HEADER_NOTIFY,                       // HEADER
-            Global.ADDR_MULTICAST, lssdp->port,         // HOST
-            lssdp->header.location.prefix,              // LOCATION
-            strlen(domain) > 0 ? domain : interface->ip,
-            lssdp->header.location.suffix,
-            lssdp->header.search_target,                // NT (Notify Type)
-            lssdp->header.unique_service_name,          // USN
-            lssdp->header.sm_id,                        // SM_ID    (addtional field)
-            lssdp->header.device_type                   // DEV_TYPE (addtional field)
-        );
-
-        // send NOTIFY
-        int ret = send_multicast_data(notify, *interface, lssdp->port);
-        if (ret == 0 && lssdp->debug) {
-            lssdp_info("SEND => %-8s   %s => MULTICAST\n", Global.NOTIFY, interface->ip);
-        }
-    }
-
-    // network inerface is empty
-    if (i == 0) lssdp_warn("Network Interface is empty, no destination to send %s\n", Global.NOTIFY);
-
-    return 0;
+    return send_notify(lssdp, Global.NTS_ALIVE);
 }
 
 // 07. lssdp_neighbor_check_timeout
@@ -521,29 +798,17 @@ int lssdp_neighbor_check_timeout(lssdp_ctx * lssdp) {
     }
 
     bool is_changed = false;
-    lssdp_nbr * prev = NULL;
-    lssdp_nbr * nbr  = lssdp->neighbor_list;
+    lssdp_nbr * nbr = lssdp->neighbor_list;
     while (nbr != NULL) {
+        lssdp_nbr * next = nbr->next;
         long pass_time = current_time - nbr->update_time;
-        if (pass_time < lssdp->neighbor_timeout) {
-            prev = nbr;
-            nbr  = nbr->next;
-            continue;
-        }
-
-        is_changed = true;
-        lssdp_warn("remove timeout SSDP neighbor: %s (%s) (%ldms)\n", nbr->sm_id, nbr->location, pass_time);
-
-        if (prev == NULL) {
-            // it's first neighbor in list
-            lssdp->neighbor_list = nbr->next;
-            free(nbr);
-            nbr = lssdp->neighbor_list;
-        } else {
-            prev->next = nbr->next;
-            free(nbr);
-            nbr = prev->next;
+        if (pass_time >= lssdp->neighbor_timeout) {
+            is_changed = true;
+            lssdp_warn("remove timeout SSDP neighbor: %s (%s) (%ldms)\n", nbr->sm_id, nbr->location, pass_time);
+            lssdp_probe(neighbor_expire, nbr->usn, nbr->location, nbr->ip, pass_time);
+            neighbor_list_remove(lssdp, nbr);
         }
+        nbr = next;
     }
 
     // invoke neighbor list changed callback
@@ -558,430 +823,4958 @@ void lssdp_set_log_callback(void (* callback)(const char * file, const char * ta
     Global.log_callback = callback;
 }
 
-
-/** Internal Function **/
-
-static int send_multicast_data(const char * data, const struct lssdp_interface interface, unsigned short ssdp_port) {
-    if (data == NULL) {
-        lssdp_error("data should not be NULL\n");
-        return -1;
-    }
-
-    size_t data_len = strlen(data);
-    if (data_len == 0) {
-        lssdp_error("data length should not be empty\n");
+// 09. lssdp_service_add
+int lssdp_service_add(lssdp_ctx * lssdp, const lssdp_service * service) {
+    if (lssdp == NULL || service == NULL) {
+        lssdp_error("lssdp and service should not be NULL\n");
         return -1;
     }
 
-    if (strlen(interface.name) == 0) {
-        lssdp_error("interface.name should not be empty\n");
+    if (strlen(service->search_target) == 0) {
+        lssdp_error("service search_target should not be empty\n");
         return -1;
     }
 
-    int result = -1;
-
-    // 1. create UDP socket
-    int fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (fd < 0) {
-        lssdp_error("create socket failed, errno = %s (%d)\n", strerror(errno), errno);
-        goto end;
-    }
-
-    // 2. bind socket
-    struct sockaddr_in addr = {
-        .sin_family      = AF_INET,
-        .sin_addr.s_addr = interface.addr
-    };
-    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        lssdp_error("bind failed, errno = %s (%d)\n", strerror(errno), errno);
-        goto end;
+    // 1. the service is already registered: update it
+    size_t index = get_hash(service->search_target) % LSSDP_SERVICE_TABLE_SIZE;
+    lssdp_service * s;
+    for (s = lssdp->service_table[index]; s != NULL; s = s->hash_next) {
+        if (strcmp(s->search_target, service->search_target) == 0
+         && strcmp(s->unique_service_name, service->unique_service_name) == 0) {
+            memcpy(s->sm_id,       service->sm_id,       LSSDP_FIELD_LEN);
+            memcpy(s->device_type, service->device_type, LSSDP_FIELD_LEN);
+            lssdp->announce.header_hash = 0;
+            return 0;
+        }
     }
 
-    // 3. disable IP_MULTICAST_LOOP
-    char opt = 0;
-    if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &opt, sizeof(opt)) < 0) {
-        lssdp_error("setsockopt IP_MULTICAST_LOOP failed, errno = %s (%d)\n", strerror(errno), errno);
-        goto end;
+    // 2. memory allocate lssdp_service
+    s = (lssdp_service *) lssdp_malloc(lssdp, sizeof(lssdp_service));
+    if (s == NULL) {
+        lssdp_error("malloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
     }
+    memcpy(s, service, sizeof(lssdp_service));
+    s->next = NULL;
 
-    // 4. set destination address
-    struct sockaddr_in dest_addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(ssdp_port)
-    };
-    if (inet_aton(Global.ADDR_MULTICAST, &dest_addr.sin_addr) == 0) {
-        lssdp_error("inet_aton failed, errno = %s (%d)\n", strerror(errno), errno);
-        goto end;
+    // 3. add to the end of service list
+    lssdp_service ** last = &lssdp->service_list;
+    while (*last != NULL) {
+        last = &(*last)->next;
     }
+    *last = s;
 
-    // 5. send data
-    if (sendto(fd, data, data_len, 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) == -1) {
-        lssdp_error("sendto %s (%s) failed, errno = %s (%d)\n", interface.name, interface.ip, strerror(errno), errno);
-        goto end;
-    }
+    // 4. add to service table
+    s->hash_next = lssdp->service_table[index];
+    lssdp->service_table[index] = s;
 
-    result = 0;
-end:
-    if (fd >= 0 && close(fd) != 0) {
-        lssdp_error("close fd %d failed, errno = %s (%d)\n", strerror(errno), errno);
-    }
-    return result;
+    lssdp->service_num++;
+    lssdp->announce.header_hash = 0;
+    return 0;
 }
 
-static int lssdp_send_response(lssdp_ctx * lssdp, struct sockaddr_in address) {
-    // get M-SEARCH IP
-    char msearch_ip[LSSDP_IP_LEN] = {};
-    if (inet_ntop(AF_INET, &address.sin_addr, msearch_ip, sizeof(msearch_ip)) == NULL) {
-        lssdp_error("inet_ntop failed, errno = %s (%d)\n", strerror(errno), errno);
+// 10. lssdp_service_remove
+int lssdp_service_remove(lssdp_ctx * lssdp, const char * search_target, const char * unique_service_name) {
+    if (lssdp == NULL || search_target == NULL || unique_service_name == NULL) {
+        lssdp_error("lssdp, search_target and unique_service_name should not be NULL\n");
         return -1;
     }
 
-    // 1. find the interface which is in LAN
-    struct lssdp_interface * interface = find_interface_in_LAN(lssdp, address.sin_addr.s_addr);
-    if (interface == NULL) {
-        if (lssdp->debug) {
-            lssdp_info("RECV <- %-8s   Interface is not found        %s\n", Global.MSEARCH, msearch_ip);
+    // 1. remove from service table
+    lssdp_service ** s = &lssdp->service_table[get_hash(search_target) % LSSDP_SERVICE_TABLE_SIZE];
+    while (*s != NULL) {
+        if (strcmp((*s)->search_target, search_target) == 0
+         && strcmp((*s)->unique_service_name, unique_service_name) == 0) {
+            break;
         }
+        s = &(*s)->hash_next;
+    }
 
-        if (lssdp->interface_num == 0) {
-            lssdp_warn("Network Interface is empty, no destination to send %s\n", Global.RESPONSE);
-        }
+    lssdp_service * service = *s;
+    if (service == NULL) {
+        lssdp_warn("service %s (%s) is not found\n", search_target, unique_service_name);
         return -1;
     }
+    *s = service->hash_next;
 
-    // 2. set response packet
-    char response[LSSDP_BUFFER_LEN] = {};
-    char * domain = lssdp->header.location.domain;
-    int response_len = snprintf(response, sizeof(response),
-        "%s"
-        "CACHE-CONTROL:max-age=120\r\n"
-        "DATE:\r\n"
-        "EXT:\r\n"
-        "LOCATION:%s%s%s\r\n"
-        "SERVER:OS/version product/version\r\n"
-        "ST:%s\r\n"
-        "USN:%s\r\n"
-        "SM_ID:%s\r\n"
-        "DEV_TYPE:%s\r\n"
-        "\r\n",
-        Global.HEADER_RESPONSE,                     // HEADER
-        lssdp->header.location.prefix,              // LOCATION
-        strlen(domain) > 0 ? domain : interface->ip,
-        lssdp->header.location.suffix,
-        lssdp->header.search_target,                // ST (Search Target)
-        lssdp->header.unique_service_name,          // USN
-        lssdp->header.sm_id,                        // SM_ID    (addtional field)
-        lssdp->header.device_type                   // DEV_TYPE (addtional field)
-    );
-
-    // 3. set port to address
-    address.sin_port = htons(lssdp->port);
+    // 2. remove from service list
+    for (s = &lssdp->service_list; *s != service; s = &(*s)->next);
+    *s = service->next;
 
-    if (lssdp->debug) {
-        lssdp_info("RECV <- %-8s   %s <- %s\n", Global.MSEARCH, interface->ip, msearch_ip);
-    }
+    lssdp_free(lssdp, service);
+    lssdp->service_num--;
+    lssdp->announce.header_hash = 0;
+    return 0;
+}
 
-    // 4. send data
-    if (sendto(lssdp->sock, response, response_len, 0, (struct sockaddr *)&address, sizeof(struct sockaddr_in)) == -1) {
-        lssdp_error("send RESPONSE to %s failed, errno = %s (%d)\n", msearch_ip, strerror(errno), errno);
+// 11. lssdp_service_remove_all
+int lssdp_service_remove_all(lssdp_ctx * lssdp) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
         return -1;
     }
 
-    if (lssdp->debug) {
-        lssdp_info("SEND => %-8s   %s => %s\n", Global.RESPONSE, interface->ip, msearch_ip);
+    lssdp_service * service = lssdp->service_list;
+    while (service != NULL) {
+        lssdp_service * next = service->next;
+        lssdp_free(lssdp, service);
+        service = next;
     }
 
+    lssdp->service_num  = 0;
+    lssdp->service_list = NULL;
+    memset(lssdp->service_table, 0, sizeof(lssdp->service_table));
+    lssdp->announce.header_hash = 0;
     return 0;
 }
 
-static int lssdp_packet_parser(const char * data, size_t data_len, lssdp_packet * packet) {
-    if (data == NULL) {
-        lssdp_error("data should not be NULL\n");
+// 12. lssdp_subscription_add
+int lssdp_subscription_add(lssdp_ctx * lssdp, const char * search_target) {
+    if (lssdp == NULL || search_target == NULL) {
+        lssdp_error("lssdp and search_target should not be NULL\n");
         return -1;
     }
 
-    if (data_len != strlen(data)) {
-        lssdp_error("data_len (%zu) is not match to the data length (%zu)\n", data_len, strlen(data));
+    size_t len = strlen(search_target);
+    if (len == 0 || len >= LSSDP_FIELD_LEN) {
+        lssdp_error("search_target length (%zu) is invalid\n", len);
         return -1;
     }
 
-    if (packet == NULL) {
-        lssdp_error("packet should not be NULL\n");
+    // 1. compile search target: prefix or exact
+    bool is_prefix = search_target[len - 1] == '*';
+    size_t prefix_len = is_prefix ? len - 1 : len;
+    size_t index = get_prefix_hash(search_target, prefix_len) % LSSDP_SUBSCRIPTION_TABLE_SIZE;
+
+    // 2. check the search target is already subscribed
+    lssdp_subscription * s;
+    for (s = lssdp->subscription_table[index]; s != NULL; s = s->hash_next) {
+        if (strcmp(s->search_target, search_target) == 0) {
+            return 0;
+        }
+    }
+
+    // 3. memory allocate lssdp_subscription
+    s = (lssdp_subscription *) lssdp_calloc(lssdp, 1, sizeof(lssdp_subscription));
+    if (s == NULL) {
+        lssdp_error("calloc failed, errno = %s (%d)\n", strerror(errno), errno);
         return -1;
     }
+    memcpy(s->search_target, search_target, len);
+    s->prefix_len = prefix_len;
+    s->is_prefix  = is_prefix;
+
+    // 4. add to the end of subscription list
+    lssdp_subscription ** last = &lssdp->subscription_list;
+    while (*last != NULL) {
+        last = &(*last)->next;
+    }
+    *last = s;
 
-    // 1. compare SSDP Method Header: M-SEARCH, NOTIFY, RESPONSE
-    size_t i;
-    if ((i = strlen(Global.HEADER_MSEARCH)) < data_len && memcmp(data, Global.HEADER_MSEARCH, i) == 0) {
-        strcpy(packet->method, Global.MSEARCH);
-    } else if ((i = strlen(Global.HEADER_NOTIFY)) < data_len && memcmp(data, Global.HEADER_NOTIFY, i) == 0) {
-        strcpy(packet->method, Global.NOTIFY);
-    } else if ((i = strlen(Global.HEADER_RESPONSE)) < data_len && memcmp(data, Global.HEADER_RESPONSE, i) == 0) {
-        strcpy(packet->method, Global.RESPONSE);
-    } else {
-        lssdp_warn("received unknown SSDP packet\n");
-        lssdp_debug("%s\n", data);
+    // 5. add to subscription table
+    s->hash_next = lssdp->subscription_table[index];
+    lssdp->subscription_table[index] = s;
+
+    lssdp->subscription_num++;
+    lssdp->match_generation++;
+    subscription_prefix_mask_update(lssdp);
+    return 0;
+}
+
+// 13. lssdp_subscription_remove
+int lssdp_subscription_remove(lssdp_ctx * lssdp, const char * search_target) {
+    if (lssdp == NULL || search_target == NULL) {
+        lssdp_error("lssdp and search_target should not be NULL\n");
         return -1;
     }
 
-    // 2. parse each field line
-    size_t start = i;
-    for (i = start; i < data_len; i++) {
-        if (data[i] == '\n' && i - 1 > start && data[i - 1] == '\r') {
-            parse_field_line(data, start, i - 2, packet);
-            start = i + 1;
+    // 1. find the subscription
+    lssdp_subscription * subscription;
+    for (subscription = lssdp->subscription_list; subscription != NULL; subscription = subscription->next) {
+        if (strcmp(subscription->search_target, search_target) == 0) {
+            break;
         }
     }
 
-    // 3. set update_time
-    long long current_time = get_current_time();
-    if (current_time < 0) {
-        lssdp_error("got invalid timestamp %lld\n", current_time);
+    if (subscription == NULL) {
+        lssdp_warn("subscription %s is not found\n", search_target);
         return -1;
     }
-    packet->update_time = current_time;
+
+    // 2. remove neighbors of the subscription
+    bool is_changed = subscription->neighbor_list != NULL;
+    while (subscription->neighbor_list != NULL) {
+        neighbor_list_remove(lssdp, subscription->neighbor_list);
+    }
+
+    // 3. remove from subscription table and list
+    lssdp_subscription ** s;
+    for (s = &lssdp->subscription_table[get_prefix_hash(search_target, subscription->prefix_len) % LSSDP_SUBSCRIPTION_TABLE_SIZE]; *s != subscription; s = &(*s)->hash_next);
+    *s = subscription->hash_next;
+
+    for (s = &lssdp->subscription_list; *s != subscription; s = &(*s)->next);
+    *s = subscription->next;
+
+    lssdp_free(lssdp, subscription);
+    lssdp->subscription_num--;
+    lssdp->match_generation++;
+    subscription_prefix_mask_update(lssdp);
+
+    // invoke neighbor list changed callback
+    if (is_changed == true && lssdp->neighbor_list_changed_callback != NULL) {
+        lssdp->neighbor_list_changed_callback(lssdp);
+    }
     return 0;
 }
 
-static int parse_field_line(const char * data, size_t start, size_t end, lssdp_packet * packet) {
-    // 1. find the colon
-    if (data[start] == ':') {
-        lssdp_warn("the first character of line should not be colon\n");
-        lssdp_debug("%s\n", data);
+// 14. lssdp_subscription_remove_all
+int lssdp_subscription_remove_all(lssdp_ctx * lssdp) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
         return -1;
     }
 
-    int colon = get_colon_index(data, start + 1, end);
-    if (colon == -1) {
-        lssdp_warn("there is no colon in line\n");
-        lssdp_debug("%s\n", data);
+    while (lssdp->subscription_list != NULL) {
+        lssdp_subscription_remove(lssdp, lssdp->subscription_list->search_target);
+    }
+    return 0;
+}
+
+// 15. lssdp_send_byebye
+int lssdp_send_byebye(lssdp_ctx * lssdp) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
         return -1;
     }
 
-    if (colon == end) {
-        // value is empty
+    if (lssdp->port == 0) {
+        lssdp_error("SSDP port (%d) has not been setup.\n", lssdp->port);
         return -1;
     }
 
+    // check network inerface number
+    if (lssdp->interface_num == 0) {
+        lssdp_warn("Network Interface is empty, no destination to send %s\n", Global.NTS_BYEBYE);
+        return -1;
+    }
 
-    // 2. get field, field_len
-    size_t i = start;
-    size_t j = colon - 1;
-    if (trim_spaces(data, &i, &j) == -1) {
+    return send_notify(lssdp, Global.NTS_BYEBYE);
+}
+
+// 16. lssdp_pcap_replay
+int lssdp_pcap_replay(lssdp_ctx * lssdp, const char * file, bool is_realtime) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
         return -1;
     }
-    const char * field = &data[i];
-    size_t field_len = j - i + 1;
 
+    if (file == NULL) {
+        lssdp_error("file should not be NULL\n");
+        return -1;
+    }
 
-    // 3. get value, value_len
-    i = colon + 1;
-    j = end;
-    if (trim_spaces(data, &i, &j) == -1) {
+    if (lssdp->port == 0) {
+        lssdp_error("SSDP port (%d) has not been setup.\n", lssdp->port);
         return -1;
+    }
+
+    lssdp_pcap pcap = {
+        .fp          = fopen(file, "rb"),
+        .is_realtime = is_realtime,
+        .first_time  = -1
     };
-    const char * value = &data[i];
-    size_t value_len = j - i + 1;
+    if (pcap.fp == NULL) {
+        lssdp_error("open %s failed, errno = %s (%d)\n", file, strerror(errno), errno);
+        return -1;
+    }
 
+    // 1. check file format by magic number
+    int result = -1;
+    uint8_t magic[4];
+    if (fread(magic, sizeof(magic), 1, pcap.fp) != 1) {
+        lssdp_error("read %s failed, file is too short\n", file);
+        goto end;
+    }
 
-    // 4. set each field's value to packet
-    if (field_len == strlen("st") && strncasecmp(field, "st", field_len) == 0) {
-        memcpy(packet->st, value, value_len < LSSDP_FIELD_LEN ? value_len : LSSDP_FIELD_LEN - 1);
-        return 0;
+    // 2. replay packets
+    uint32_t value = pcap_u32(&pcap, magic);
+    if (value == 0x0A0D0D0A) {
+        // pcapng: Section Header Block (byte order is read from the block)
+        rewind(pcap.fp);
+        result = pcapng_replay(lssdp, &pcap);
+    } else {
+        result = pcap_replay(lssdp, &pcap, value);
     }
 
-    if (field_len == strlen("nt") && strncasecmp(field, "nt", field_len) == 0) {
-        memcpy(packet->st, value, value_len < LSSDP_FIELD_LEN ? value_len : LSSDP_FIELD_LEN - 1);
-        return 0;
+    if (result == 0) {
+        result = pcap.packet_num;
     }
 
-    if (field_len == strlen("usn") && strncasecmp(field, "usn", field_len) == 0) {
-        memcpy(packet->usn, value, value_len < LSSDP_FIELD_LEN ? value_len : LSSDP_FIELD_LEN - 1);
-        return 0;
+    if (lssdp->debug) {
+        lssdp_info("replay %s: %zu SSDP packets\n", file, pcap.packet_num);
     }
+end:
+    fclose(pcap.fp);
+    return result;
+}
 
-    if (field_len == strlen("location") && strncasecmp(field, "location", field_len) == 0) {
-        memcpy(packet->location, value, value_len < LSSDP_LOCATION_LEN ? value_len : LSSDP_LOCATION_LEN - 1);
-        return 0;
+// 17. lssdp_ingest
+int lssdp_ingest(lssdp_ctx * lssdp, const char * buffer, size_t buffer_len, const struct sockaddr * address, long long timestamp) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
+        return -1;
     }
 
-    if (field_len == strlen("sm_id") && strncasecmp(field, "sm_id", field_len) == 0) {
-        memcpy(packet->sm_id, value, value_len < LSSDP_FIELD_LEN ? value_len : LSSDP_FIELD_LEN - 1);
-        return 0;
+    if (buffer == NULL || buffer_len == 0) {
+        lssdp_error("buffer should not be empty\n");
+        return -1;
     }
 
-    if (field_len == strlen("dev_type") && strncasecmp(field, "dev_type", field_len) == 0) {
-        memcpy(packet->device_type, value, value_len < LSSDP_FIELD_LEN ? value_len : LSSDP_FIELD_LEN - 1);
-        return 0;
+    if (address == NULL || (address->sa_family != AF_INET && address->sa_family != AF_INET6)) {
+        lssdp_error("address should be AF_INET or AF_INET6\n");
+        return -1;
     }
 
-    // the field is not in the struct packet
-    return 0;
+    // timestamp <= 0: current time
+    if (timestamp <= 0) {
+        timestamp = get_current_time();
+        if (timestamp < 0) {
+            lssdp_error("got invalid timestamp %lld\n", timestamp);
+            return -1;
+        }
+    }
+
+    return lssdp_packet_handler(lssdp, buffer, buffer_len, address, timestamp, 0);
 }
 
-static int get_colon_index(const char * string, size_t start, size_t end) {
+// 18. lssdp_ingest_batch
+int lssdp_ingest_batch(lssdp_ctx * lssdp, const lssdp_ingest_packet * packets, size_t packet_num) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
+        return -1;
+    }
+
+    if (packets == NULL && packet_num > 0) {
+        lssdp_error("packets should not be NULL\n");
+        return -1;
+    }
+
+    // current time is got once for the packets without timestamp
+    long long current_time = 0;
+
+    int ingest_num = 0;
     size_t i;
-    for (i = start; i <= end; i++) {
-        if (string[i] == ':') {
-            return i;
+    for (i = 0; i < packet_num; i++) {
+        long long timestamp = packets[i].timestamp;
+        if (timestamp <= 0) {
+            if (current_time <= 0) {
+                current_time = get_current_time();
+            }
+            timestamp = current_time;
+        }
+
+        if (lssdp_ingest(lssdp, packets[i].buffer, packets[i].buffer_len, packets[i].address, timestamp) == 0) {
+            ingest_num++;
         }
     }
-    return -1;
+    return ingest_num;
 }
 
-static int trim_spaces(const char * string, size_t * start, size_t * end) {
-    int i = *start;
-    int j = *end;
+// 19. lssdp_neighbor_save
+int lssdp_neighbor_save(lssdp_ctx * lssdp, const char * file) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
+        return -1;
+    }
 
-    while (i <= *end   && (!isprint(string[i]) || isspace(string[i]))) i++;
-    while (j >= *start && (!isprint(string[j]) || isspace(string[j]))) j--;
+    if (file == NULL) {
+        lssdp_error("file should not be NULL\n");
+        return -1;
+    }
 
-    if (i > j) {
+    // 1. compute records length
+    size_t record_len = 0;
+    lssdp_nbr * nbr;
+    for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+        const char * fields[LSSDP_SNAPSHOT_FIELD_NUM];
+        size_t lens[LSSDP_SNAPSHOT_FIELD_NUM];
+        size_t i, n = snapshot_fields(nbr, fields, lens);
+
+        record_len += sizeof(int64_t) + sizeof(uint8_t);
+        for (i = 0; i < n; i++) {
+            record_len += sizeof(uint32_t) + lens[i];
+        }
+    }
+
+    // 2. write header and records to buffer
+    size_t buffer_len = sizeof(lssdp_snapshot_header) + record_len;
+    uint8_t * buffer = (uint8_t *) lssdp_malloc(lssdp, buffer_len);
+    if (buffer == NULL) {
+        lssdp_error("malloc failed, errno = %s (%d)\n", strerror(errno), errno);
         return -1;
     }
 
-    *start = i;
-    *end   = j;
-    return 0;
+    uint8_t * p = buffer + sizeof(lssdp_snapshot_header);
+    for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+        const char * fields[LSSDP_SNAPSHOT_FIELD_NUM];
+        size_t lens[LSSDP_SNAPSHOT_FIELD_NUM];
+        size_t i, n = snapshot_fields(nbr, fields, lens);
+
+        int64_t update_time = nbr->update_time;
+        memcpy(p, &update_time, sizeof(update_time));
+        p += sizeof(update_time);
+        *p++ = (uint8_t) nbr->family;
+
+        for (i = 0; i < n; i++) {
+            uint32_t len = lens[i];
+            memcpy(p, &len, sizeof(len));
+            memcpy(p + sizeof(len), fields[i], len);
+            p += sizeof(len) + len;
+        }
+    }
+
+    lssdp_snapshot_header header = {
+        .magic        = LSSDP_SNAPSHOT_MAGIC,
+        .version      = LSSDP_SNAPSHOT_VERSION,
+        .header_len   = sizeof(lssdp_snapshot_header),
+        .neighbor_num = lssdp->neighbor_num,
+        .checksum     = snapshot_checksum(buffer + sizeof(header), record_len),
+        .save_time    = get_current_time(),
+        .record_len   = record_len
+    };
+    memcpy(buffer, &header, sizeof(header));
+
+    // 3. write to temporary file, then rename (the original snapshot is kept if failed)
+    int result = -1;
+    char temp_file[PATH_MAX];
+    if (snprintf(temp_file, sizeof(temp_file), "%s.tmp", file) >= (int) sizeof(temp_file)) {
+        lssdp_error("file path %s is too long\n", file);
+        goto end;
+    }
+
+    int fd = open(temp_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        lssdp_error("open %s failed, errno = %s (%d)\n", temp_file, strerror(errno), errno);
+        goto end;
+    }
+
+    size_t offset = 0;
+    while (offset < buffer_len) {
+        ssize_t len = write(fd, buffer + offset, buffer_len - offset);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            lssdp_error("write %s failed, errno = %s (%d)\n", temp_file, strerror(errno), errno);
+            close(fd);
+            unlink(temp_file);
+            goto end;
+        }
+        offset += len;
+    }
+
+    if (close(fd) != 0 || rename(temp_file, file) != 0) {
+        lssdp_error("save %s failed, errno = %s (%d)\n", file, strerror(errno), errno);
+        unlink(temp_file);
+        goto end;
+    }
+
+    if (lssdp->debug) {
+        lssdp_info("save %zu neighbors to %s (%zu bytes)\n", lssdp->neighbor_num, file, buffer_len);
+    }
+    result = 0;
+end:
+    lssdp_free(lssdp, buffer);
+    return result;
 }
 
-static long long get_current_time() {
-    struct timeval time = {};
-    if (gettimeofday(&time, NULL) == -1) {
-        lssdp_error("gettimeofday failed, errno = %s (%d)\n", strerror(errno), errno);
+// 20. lssdp_neighbor_load
+int lssdp_neighbor_load(lssdp_ctx * lssdp, const char * file) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
         return -1;
     }
-    return (long long) time.tv_sec * 1000 + (long long) time.tv_usec / 1000;
-}
 
-static int lssdp_log(int level, int line, const char * func, const char * format, ...) {
-    if (Global.log_callback == NULL) {
+    if (file == NULL) {
+        lssdp_error("file should not be NULL\n");
         return -1;
     }
 
-    char message[LSSDP_BUFFER_LEN] = {};
+    long long current_time = get_current_time();
+    if (current_time < 0) {
+        lssdp_error("got invalid timestamp %lld\n", current_time);
+        return -1;
+    }
 
-    // create message by va_list
-    va_list args;
-    va_start(args, format);
-    vsnprintf(message, LSSDP_BUFFER_LEN, format, args);
-    va_end(args);
+    // 1. map snapshot file
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        lssdp_error("open %s failed, errno = %s (%d)\n", file, strerror(errno), errno);
+        return -1;
+    }
 
-    // invoke log callback function
-    Global.log_callback(__FILE__, "SSDP", level, line, func, message);
-    return 0;
-}
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(lssdp_snapshot_header)) {
+        lssdp_error("snapshot %s is invalid\n", file);
+        close(fd);
+        return -1;
+    }
 
-static int neighbor_list_add(lssdp_ctx * lssdp, const lssdp_packet packet) {
-    lssdp_nbr * last_nbr = lssdp->neighbor_list;
+    size_t file_len = st.st_size;
+    const uint8_t * data = (const uint8_t *) mmap(NULL, file_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        lssdp_error("mmap %s failed, errno = %s (%d)\n", file, strerror(errno), errno);
+        return -1;
+    }
 
-    bool is_changed = false;
-    lssdp_nbr * nbr;
-    for (nbr = lssdp->neighbor_list; nbr != NULL; last_nbr = nbr, nbr = nbr->next) {
-        if (strcmp(nbr->location, packet.location) != 0) {
-            // location is not match
-            continue;
+    // 2. check header and checksum
+    int result = -1;
+    lssdp_snapshot_header header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != LSSDP_SNAPSHOT_MAGIC || header.version != LSSDP_SNAPSHOT_VERSION
+     || header.header_len != sizeof(header) || header.record_len != file_len - sizeof(header)) {
+        lssdp_error("snapshot %s header is invalid\n", file);
+        goto end;
+    }
+
+    const uint8_t * p   = data + sizeof(header);
+    const uint8_t * end = data + file_len;
+    if (snapshot_checksum(p, header.record_len) != header.checksum) {
+        lssdp_error("snapshot %s checksum is not match\n", file);
+        goto end;
+    }
+
+    // 3. add neighbors, neighbor list changed callback is invoked once
+    int (* callback)(struct lssdp_ctx * lssdp) = lssdp->neighbor_list_changed_callback;
+    lssdp->neighbor_list_changed_callback = NULL;
+
+    size_t load_num = 0, expire_num = 0;
+    uint32_t n;
+    for (n = 0; n < header.neighbor_num; n++) {
+        if (end - p < (ptrdiff_t) (sizeof(int64_t) + sizeof(uint8_t))) {
+            break;
         }
 
-        /* location is not found in SSDP list: update neighbor */
+        lssdp_packet packet = {};
+        int64_t update_time;
+        memcpy(&update_time, p, sizeof(update_time));
+        p += sizeof(update_time);
+        packet.update_time = update_time;
+        packet.family      = *p++;
+
+        const uint8_t * fields[LSSDP_SNAPSHOT_FIELD_NUM];
+        uint32_t lens[LSSDP_SNAPSHOT_FIELD_NUM];
+        size_t i;
+        for (i = 0; i < LSSDP_SNAPSHOT_FIELD_NUM; i++) {
+            if (end - p < (ptrdiff_t) sizeof(lens[i])) {
+                break;
+            }
+            memcpy(&lens[i], p, sizeof(lens[i]));
+            p += sizeof(lens[i]);
+            if ((size_t) (end - p) < lens[i]) {
+                break;
+            }
+            fields[i] = p;
+            p += lens[i];
+        }
 
-        // usn
-        if (strcmp(nbr->usn, packet.usn) != 0) {
-            lssdp_debug("neighbor usn is changed. (%s -> %s)\n", nbr->usn, packet.usn);
-            memcpy(nbr->usn, packet.usn, LSSDP_FIELD_LEN);
-            is_changed = true;
+        if (i < LSSDP_SNAPSHOT_FIELD_NUM) {
+            lssdp_error("snapshot %s record is truncated\n", file);
+            break;
         }
 
-        // sm_id
-        if (strcmp(nbr->sm_id, packet.sm_id) != 0) {
-            lssdp_debug("neighbor sm_id is changed. (%s -> %s)\n", nbr->sm_id, packet.sm_id);
-            memcpy(nbr->sm_id, packet.sm_id, LSSDP_FIELD_LEN);
-            is_changed = true;
+        // ip, interface, and header fields which are end with null
+        if (lens[0] >= LSSDP_IP_LEN || lens[1] >= LSSDP_INTERFACE_NAME_LEN || lens[2] == 0 || fields[2][lens[2] - 1] != '\0') {
+            continue;
+        }
+        memcpy(packet.ip,        fields[0], lens[0]);
+        memcpy(packet.interface, fields[1], lens[1]);
+        packet.header     = (char *) fields[2];     // read only, it is copied by neighbor_list_add
+        packet.header_len = lens[2];
+        packet_header_link(&packet);
+
+        // the neighbor is timeout (remaining TTL <= 0)
+        if (lssdp->neighbor_timeout > 0 && current_time - packet.update_time >= lssdp->neighbor_timeout) {
+            expire_num++;
+            continue;
         }
 
-        // device type
-        if (strcmp(nbr->device_type, packet.device_type) != 0) {
-            lssdp_debug("neighbor device_type is changed. (%s -> %s)\n", nbr->device_type, packet.device_type);
-            memcpy(nbr->device_type, packet.device_type, LSSDP_FIELD_LEN);
-            is_changed = true;
+        // the neighbor received after restart is newer than snapshot
+        if (neighbor_find(lssdp, &packet) != NULL) {
+            continue;
         }
 
-        // update_time
-        nbr->update_time = packet.update_time;
-        goto end;
+        // search target should be match to header.search_target or subscriptions
+        lssdp_subscription * subscription = NULL;
+        if (match_search_target(lssdp, packet.st, &subscription) == false) {
+            continue;
+        }
+
+        if (neighbor_list_add(lssdp, packet, subscription) == 0) {
+            load_num++;
+        }
     }
 
+    lssdp->neighbor_list_changed_callback = callback;
+    lssdp_info("load %zu neighbors from %s (%zu expired)\n", load_num, file, expire_num);
 
-    /* location is not found in SSDP list: add to list */
+    // records are in list order: sort age list by update_time once
+    if (load_num > 0) {
+        neighbor_age_sort(lssdp);
+    }
 
-    // 1. memory allocate lssdp_nbr
-    nbr = (lssdp_nbr *) malloc(sizeof(lssdp_nbr));
-    if (nbr == NULL) {
-        lssdp_error("malloc failed, errno = %s (%d)\n", strerror(errno), errno);
+    // invoke neighbor list changed callback
+    if (load_num > 0 && lssdp->neighbor_list_changed_callback != NULL) {
+        lssdp->neighbor_list_changed_callback(lssdp);
+    }
+    result = load_num;
+end:
+    munmap((void *) data, file_len);
+    return result;
+}
+
+
+// 21. lssdp_shm_create
+int lssdp_shm_create(lssdp_ctx * lssdp, const char * name, size_t capacity) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
         return -1;
     }
 
-    // 2. setup neighbor
-    memcpy(nbr->usn,         packet.usn,         LSSDP_FIELD_LEN);
-    memcpy(nbr->sm_id,       packet.sm_id,       LSSDP_FIELD_LEN);
-    memcpy(nbr->device_type, packet.device_type, LSSDP_FIELD_LEN);
-    memcpy(nbr->location,    packet.location,    LSSDP_LOCATION_LEN);
-    nbr->update_time = packet.update_time;
-    nbr->next = NULL;
+    if (name == NULL || name[0] != '/' || strlen(name) >= LSSDP_SHM_NAME_LEN) {
+        lssdp_error("shared memory name %s is invalid\n", name != NULL ? name : "(null)");
+        return -1;
+    }
 
-    // 3. add neighbor to the end of list
-    if (last_nbr == NULL) {
-        // it's the first neighbor
-        lssdp->neighbor_list = nbr;
-    } else {
-        last_nbr->next = nbr;
+    if (capacity == 0 || capacity > UINT32_MAX) {
+        lssdp_error("shared memory capacity %zu is invalid\n", capacity);
+        return -1;
     }
 
-    is_changed = true;
-end:
-    // invoke neighbor list changed callback
-    if (lssdp->neighbor_list_changed_callback != NULL && is_changed == true) {
-        lssdp->neighbor_list_changed_callback(lssdp);
+#ifdef __ANDROID__
+    lssdp_error("POSIX shared memory is not supported\n");
+    return -1;
+#else
+    // destroy the original table
+    lssdp_shm_destroy(lssdp);
+
+    lssdp_nbr ** slot = (lssdp_nbr **) lssdp_calloc(lssdp, capacity, sizeof(lssdp_nbr *));
+    if (slot == NULL) {
+        lssdp_error("calloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    // 1. create shared memory (the readers of the stale one keep their mapping)
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        lssdp_error("shm_open %s failed, errno = %s (%d)\n", name, strerror(errno), errno);
+        lssdp_free(lssdp, slot);
+        return -1;
+    }
+
+    size_t size = sizeof(lssdp_shm_table) + capacity * sizeof(lssdp_shm_nbr);
+    if (ftruncate(fd, size) != 0) {
+        lssdp_error("ftruncate %s failed, errno = %s (%d)\n", name, strerror(errno), errno);
+        goto err;
     }
 
+    lssdp_shm_table * table = (lssdp_shm_table *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (table == MAP_FAILED) {
+        lssdp_error("mmap %s failed, errno = %s (%d)\n", name, strerror(errno), errno);
+        goto err;
+    }
+    close(fd);
+
+    // 2. setup table, magic is set at last
+    table->version   = LSSDP_SHM_VERSION;
+    table->slot_size = sizeof(lssdp_shm_nbr);
+    table->capacity  = capacity;
+
+    snprintf(lssdp->shm.name, LSSDP_SHM_NAME_LEN, "%s", name);
+    lssdp->shm.size  = size;
+    lssdp->shm.table = table;
+    lssdp->shm.slot  = slot;
+
+    // 3. publish the neighbors in list
+    lssdp_nbr * nbr;
+    for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+        shm_publish(lssdp, nbr);
+    }
+
+    __atomic_store_n(&table->magic, LSSDP_SHM_MAGIC, __ATOMIC_RELEASE);
+    lssdp_info("publish %u neighbors to shared memory %s (capacity %zu)\n", table->neighbor_num, name, capacity);
     return 0;
+
+err:
+    close(fd);
+    shm_unlink(name);
+    lssdp_free(lssdp, slot);
+    return -1;
+#endif
 }
 
-static int lssdp_neighbor_remove_all(lssdp_ctx * lssdp) {
-    if (lssdp->neighbor_list == NULL) {
+// 22. lssdp_shm_destroy
+int lssdp_shm_destroy(lssdp_ctx * lssdp) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
+        return -1;
+    }
+
+    lssdp_shm_table * table = lssdp->shm.table;
+    if (table == NULL) {
         return 0;
     }
 
-    // free neighbor_list
-    neighbor_list_free(lssdp->neighbor_list);
-    lssdp->neighbor_list = NULL;
+    // notify the readers
+    shm_write_begin(table);
+    table->magic = 0;
+    shm_write_end(lssdp, table);
 
-    lssdp_info("neighbor list has been force clean up.\n");
+    if (munmap(table, lssdp->shm.size) != 0) {
+        lssdp_warn("munmap %s failed, errno = %s (%d)\n", lssdp->shm.name, strerror(errno), errno);
+    }
 
-    // invoke neighbor list changed callback
-    if (lssdp->neighbor_list_changed_callback != NULL) {
-        lssdp->neighbor_list_changed_callback(lssdp);
+#ifndef __ANDROID__
+    if (shm_unlink(lssdp->shm.name) != 0) {
+        lssdp_warn("shm_unlink %s failed, errno = %s (%d)\n", lssdp->shm.name, strerror(errno), errno);
+    }
+#endif
+
+    lssdp_nbr * nbr;
+    for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+        nbr->shm_slot           = 0;
+        nbr->shm_overflow_next  = NULL;
+        nbr->shm_overflow_pprev = NULL;
     }
+
+    lssdp_free(lssdp, lssdp->shm.slot);
+    memset(&lssdp->shm, 0, sizeof(lssdp->shm));
     return 0;
 }
 
-static void neighbor_list_free(lssdp_nbr * list) {
-    if (list != NULL) {
-        neighbor_list_free(list->next);
-        free(list);
+// 23. lssdp_shm_reader_open
+int lssdp_shm_reader_open(lssdp_shm_reader * reader, const char * name) {
+    lssdp_ctx * lssdp = NULL;   // no context: default log callback
+
+    if (reader == NULL || name == NULL) {
+        lssdp_error("reader and name should not be NULL\n");
+        return -1;
     }
-}
 
-static struct lssdp_interface * find_interface_in_LAN(lssdp_ctx * lssdp, uint32_t address) {
-    struct lssdp_interface * ifc;
+#ifdef __ANDROID__
+    lssdp_error("POSIX shared memory is not supported\n");
+    return -1;
+#else
+    int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+        lssdp_error("shm_open %s failed, errno = %s (%d)\n", name, strerror(errno), errno);
+        return -1;
+    }
+
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(lssdp_shm_table)) {
+        lssdp_error("shared memory %s is invalid\n", name);
+        close(fd);
+        return -1;
+    }
+
+    size_t size = st.st_size;
+    const lssdp_shm_table * table = (const lssdp_shm_table *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (table == MAP_FAILED) {
+        lssdp_error("mmap %s failed, errno = %s (%d)\n", name, strerror(errno), errno);
+        return -1;
+    }
+
+    // check the table layout is same as this library
+    if (__atomic_load_n(&table->magic, __ATOMIC_ACQUIRE) != LSSDP_SHM_MAGIC
+     || table->version != LSSDP_SHM_VERSION || table->slot_size != sizeof(lssdp_shm_nbr)
+     || (size - sizeof(lssdp_shm_table)) / sizeof(lssdp_shm_nbr) < table->capacity) {
+        lssdp_error("shared memory %s is not a SSDP neighbor table (version %u)\n", name, table->version);
+        munmap((void *) table, size);
+        return -1;
+    }
+
+    reader->table = table;
+    reader->size  = size;
+    return 0;
+#endif
+}
+
+// 24. lssdp_shm_reader_read
+int lssdp_shm_reader_read(const lssdp_shm_reader * reader, lssdp_shm_nbr * list, size_t size) {
+    lssdp_ctx * lssdp = NULL;   // no context: default log callback
+
+    if (reader == NULL || reader->table == NULL) {
+        lssdp_error("reader is not opened\n");
+        return -1;
+    }
+
+    if (list == NULL && size > 0) {
+        lssdp_error("list should not be NULL\n");
+        return -1;
+    }
+
+    const lssdp_shm_table * table = reader->table;
+    size_t capacity = (reader->size - sizeof(lssdp_shm_table)) / sizeof(lssdp_shm_nbr);
+    size_t retry;
+    for (retry = 0; retry < LSSDP_SHM_READ_RETRY; retry++) {
+        uint32_t seq = __atomic_load_n(&table->seq, __ATOMIC_ACQUIRE);
+        if (seq % 2 == 0) {
+            if (__atomic_load_n(&table->magic, __ATOMIC_RELAXED) != LSSDP_SHM_MAGIC) {
+                lssdp_error("shared memory table has been destroyed\n");
+                return -1;
+            }
+
+            size_t num = __atomic_load_n(&table->neighbor_num, __ATOMIC_RELAXED);
+            num = num < capacity ? num : capacity;
+            num = num < size ? num : size;
+            memcpy(list, table->neighbor, num * sizeof(lssdp_shm_nbr));
+
+            // the table is not changed during copy
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&table->seq, __ATOMIC_RELAXED) == seq) {
+                return num;
+            }
+        }
+
+        // writer is updating
+        sched_yield();
+    }
+
+    lssdp_warn("shared memory table is busy, retry %zu times\n", retry);
+    return -1;
+}
+
+// 25. lssdp_shm_reader_close
+int lssdp_shm_reader_close(lssdp_shm_reader * reader) {
+    lssdp_ctx * lssdp = NULL;   // no context: default log callback
+
+    if (reader == NULL) {
+        lssdp_error("reader should not be NULL\n");
+        return -1;
+    }
+
+    if (reader->table != NULL && munmap((void *) reader->table, reader->size) != 0) {
+        lssdp_error("munmap failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    reader->table = NULL;
+    reader->size  = 0;
+    return 0;
+}
+
+// 26. lssdp_neighbor_header
+const char * lssdp_neighbor_header(const lssdp_nbr * nbr, const char * name) {
+    lssdp_ctx * lssdp = NULL;   // no context: default log callback
+
+    if (nbr == NULL || name == NULL) {
+        lssdp_error("nbr and name should not be NULL\n");
+        return NULL;
+    }
+
+    if (nbr->header == NULL) {
+        return NULL;
+    }
+    return header_find(nbr->header, nbr->header_len, name);
+}
+
+// 27. lssdp_neighbor_probe
+int lssdp_neighbor_probe(lssdp_ctx * lssdp) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
+        return -1;
+    }
+
+    if (lssdp->port == 0) {
+        lssdp_error("SSDP port (%d) has not been setup.\n", lssdp->port);
+        return -1;
+    }
+
+    // probe is disabled
+    if (lssdp->neighbor_probe_time <= 0 || lssdp->neighbor_timeout <= 0) {
+        return 0;
+    }
+
+    long long current_time = get_current_time();
+    if (current_time < 0) {
+        lssdp_error("got invalid timestamp %lld\n", current_time);
+        return -1;
+    }
+
+    // unicast to the source of each neighbor, the batch is flushed when the socket is changed
+    struct sockaddr_storage to[LSSDP_BATCH_SIZE];
+    lssdp_batch batch = {
+        .fd = -1,
+        .to = to
+    };
+
+    int ret = 0;
+    size_t probe_num = 0;
+    lssdp_nbr * nbr;
+
+    // 1. probe again: wait list is in probe_time order, stop at the first one which is not due
+    //    (at least 1 ms, the neighbor probed in this call is moved to the end and is never due again)
+    long retry_time = lssdp->neighbor_probe_time / 2 > 0 ? lssdp->neighbor_probe_time / 2 : 1;
+    while ((nbr = lssdp->neighbor_probe_wait) != NULL) {
+        if (lssdp->neighbor_probe_max > 0 && probe_num >= lssdp->neighbor_probe_max) {
+            break;
+        }
+
+        if (current_time - nbr->probe_time < retry_time) {
+            break;
+        }
+
+        // the neighbor is moved to the end of wait list
+        if (neighbor_probe(lssdp, nbr, current_time, &batch) == 0) {
+            probe_num++;
+        }
+    }
+
+    // 2. first probe: the neighbors before neighbor_probe_next are waiting, age list is in update_time order (LRU: received order)
+    while ((nbr = lssdp->neighbor_probe_next) != NULL) {
+        if (lssdp->neighbor_probe_max > 0 && probe_num >= lssdp->neighbor_probe_max) {
+            break;
+        }
+
+        if (nbr->update_time + lssdp->neighbor_timeout - current_time > lssdp->neighbor_probe_time) {
+            break;
+        }
+
+        lssdp->neighbor_probe_next = nbr->age_next;
+
+        // probed with a neighbor of the same source IP and ST
+        if (nbr->probe_pprev != NULL) {
+            continue;
+        }
+
+        if (neighbor_probe(lssdp, nbr, current_time, &batch) == 0) {
+            probe_num++;
+        }
+    }
+
+    if (batch_flush(lssdp, &batch) != 0) {
+        ret = -1;
+    }
+
+    lssdp->neighbor_probe_num += probe_num;
+    return ret == 0 ? (int) probe_num : -1;
+}
+
+// 28. lssdp_announce
+int lssdp_announce(lssdp_ctx * lssdp) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
+        return -1;
+    }
+
+    long long current_time = get_current_time();
+    if (current_time < 0) {
+        lssdp_error("got invalid timestamp %lld\n", current_time);
+        return -1;
+    }
+
+    // 1. startup, or header / service / interface is changed: re-announce
+    uint32_t header_hash = announce_header_hash(lssdp);
+    if (lssdp->announce.header_hash != header_hash) {
+        lssdp->announce.header_hash = header_hash;
+        announce_reset(lssdp, current_time);
+    }
+
+    // 2. NOTIFY: initial burst, then half of max-age
+    if (current_time >= lssdp->announce.notify_time) {
+        lssdp_send_notify(lssdp);
+
+        long interval = (long) get_max_age(lssdp) * 1000 / 2;
+        if (lssdp->announce.burst > 0) {
+            lssdp->announce.burst--;
+            interval = LSSDP_ANNOUNCE_BURST_INTERVAL;
+        }
+        lssdp->announce.notify_time = current_time + announce_jitter(lssdp, interval);
+    }
+
+    // 3. M-SEARCH: exponential backoff when neighbor number is stable
+    if (current_time >= lssdp->announce.msearch_time) {
+        lssdp_send_msearch(lssdp);
+
+        long msearch_max = lssdp->announce.msearch_max > 0 ? lssdp->announce.msearch_max : LSSDP_ANNOUNCE_MSEARCH_MAX;
+        if (lssdp->announce.neighbor_num == lssdp->neighbor_num) {
+            lssdp->announce.msearch_interval = lssdp->announce.msearch_interval < msearch_max / 2 ? lssdp->announce.msearch_interval * 2 : msearch_max;
+        }
+        lssdp->announce.neighbor_num = lssdp->neighbor_num;
+        lssdp->announce.msearch_time = current_time + announce_jitter(lssdp, lssdp->announce.msearch_interval);
+    }
+
+    // 4. time to the next announce
+    long long next_time = lssdp->announce.notify_time < lssdp->announce.msearch_time ? lssdp->announce.notify_time : lssdp->announce.msearch_time;
+    return next_time > current_time ? (int) (next_time - current_time) : 0;
+}
+
+// 29. lssdp_ctx_new
+lssdp_ctx * lssdp_ctx_new(const lssdp_ctx * config) {
+    lssdp_ctx template = {
+        .sock  = -1,
+        .sock6 = -1,
+        .port  = 1900
+    };
+
+    if (config == NULL) {
+        config = &template;
+    }
+
+    // the context is allocated by its own allocator, and logs to its own log callback
+    lssdp_ctx * lssdp = (lssdp_ctx *) config;
+
+    // allocator hooks are one unit, memory of one heap must not be freed by the other
+    bool is_allocator_set = allocator_is_set(lssdp);
+    if (is_allocator_set == false && (lssdp->allocator.malloc != NULL || lssdp->allocator.realloc != NULL || lssdp->allocator.free != NULL)) {
+        lssdp_error("allocator malloc, realloc and free should be set together\n");
+        return NULL;
+    }
+
+    lssdp_ctx * context = (lssdp_ctx *) lssdp_malloc(lssdp, sizeof(lssdp_ctx));
+    if (context == NULL) {
+        lssdp_error("malloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return NULL;
+    }
+
+    memcpy(context, config, sizeof(lssdp_ctx));
+    return context;
+}
+
+// 30. lssdp_ctx_free
+int lssdp_ctx_free(lssdp_ctx * lssdp) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
+        return -1;
+    }
+
+    // 1. the caller has given up the context, it is not notified during teardown
+    lssdp->network_interface_changed_callback = NULL;
+    lssdp->neighbor_list_changed_callback     = NULL;
+    lssdp->description_fetched_callback       = NULL;
+
+    // 2. send ssdp:byebye and close socket
+    if (lssdp->sock > 0 || lssdp->sock6 > 0) {
+        lssdp_socket_close(lssdp);
+    }
+
+    // 3. free description fetcher, shared memory table, neighbors, services and subscriptions
+    lssdp_fetch_close(lssdp);
+    lssdp_shm_destroy(lssdp);
+    lssdp_neighbor_remove_all(lssdp);
+    lssdp_service_remove_all(lssdp);
+    lssdp_subscription_remove_all(lssdp);
+    netns_close(lssdp);
+
+    // 4. free context by its allocator
+    lssdp_ctx context = *lssdp;
+    lssdp_free(&context, lssdp);
+    return 0;
+}
+
+// 31. lssdp_latency_percentile
+long long lssdp_latency_percentile(lssdp_ctx * lssdp, int stage, double percentile) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
+        return -1;
+    }
+
+    if (stage < 0 || stage >= LSSDP_LATENCY_NUM || percentile < 0 || percentile > 100) {
+        lssdp_error("invalid stage (%d) or percentile (%.2f)\n", stage, percentile);
+        return -1;
+    }
+
+#if LSSDP_LATENCY_TRACE
+    const struct lssdp_latency * latency = &lssdp->stats.latency[stage];
+    if (latency->num == 0) {
+        return -1;
+    }
+
+    // the bucket where the rank is reached, its upper bound (not over max)
+    double rank = percentile / 100 * latency->num;
+    size_t count = 0;
+    size_t i;
+    for (i = 0; i < LSSDP_LATENCY_BUCKET_NUM - 1; i++) {
+        count += latency->bucket[i];
+        if (count > 0 && count >= rank) {
+            break;
+        }
+    }
+
+    long long upper = (2LL << i) - 1;
+    return upper < latency->max ? upper : latency->max;
+#else
+    return -1;  // compiled out
+#endif
+}
+
+// 32. lssdp_fetch_process
+int lssdp_fetch_process(lssdp_ctx * lssdp, fd_set * read_fds, fd_set * write_fds) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
+        return -1;
+    }
+
+    // no neighbor is queued yet
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+    if (fetcher == NULL) {
+        return -1;
+    }
+
+    long long current_time = get_current_time();
+    if (current_time < 0) {
+        lssdp_error("got invalid timestamp %lld\n", current_time);
+        return -1;
+    }
+
+    // 1. progress connections without blocking: connect, send, receive, timeout
+    struct pollfd fds[LSSDP_FETCH_CONN_MAX] = {};
+    lssdp_fetch_conn * conns[LSSDP_FETCH_CONN_MAX];
+    size_t i, num = 0;
+    lssdp_fetch_conn * conn;
+    for (conn = fetcher->conn_list; conn != NULL && num < LSSDP_FETCH_CONN_MAX; conn = conn->next) {
+        fds[num].fd     = conn->fd;
+        fds[num].events = conn->state == FETCH_CONNECTING || conn->state == FETCH_SENDING ? POLLOUT : POLLIN;
+        conns[num++]    = conn;
+    }
+
+    if (num > 0 && poll(fds, num, 0) < 0) {
+        lssdp_error("poll failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    for (i = 0; i < num; i++) {
+        fetch_conn_progress(lssdp, conns[i], fds[i].revents, current_time);
+    }
+
+    // 2. start the queued neighbors
+    fetch_queue_start(lssdp, current_time);
+
+    // 3. add sockets to fd sets (idle connection: readable when it is closed by server)
+    int max_fd = -1;
+    for (conn = fetcher->conn_list; conn != NULL; conn = conn->next) {
+        if (conn->fd >= FD_SETSIZE) {
+            continue;
+        }
+
+        bool is_write = conn->state == FETCH_CONNECTING || conn->state == FETCH_SENDING;
+        if (is_write && write_fds != NULL) {
+            FD_SET(conn->fd, write_fds);
+        }
+        if (is_write == false && read_fds != NULL) {
+            FD_SET(conn->fd, read_fds);
+        }
+        max_fd = conn->fd > max_fd ? conn->fd : max_fd;
+    }
+    return max_fd;
+}
+
+// 33. lssdp_fetch_close
+int lssdp_fetch_close(lssdp_ctx * lssdp) {
+    if (lssdp == NULL) {
+        lssdp_error("lssdp should not be NULL\n");
+        return -1;
+    }
+
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+    if (fetcher == NULL) {
+        return 0;
+    }
+
+    // 1. detach descriptions, and dequeue neighbors
+    lssdp_nbr * nbr;
+    for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+        fetch_neighbor_release(lssdp, nbr);
+    }
+
+    // 2. close connections
+    while (fetcher->conn_list != NULL) {
+        fetch_conn_close(lssdp, fetcher->conn_list);
+    }
+
+    // 3. free description cache
+    while (fetcher->cache != NULL) {
+        lssdp_desc * next = fetcher->cache->next;
+        lssdp->neighbor_memory -= fetcher->cache->size;
+        lssdp_free(lssdp, fetcher->cache);
+        fetcher->cache = next;
+    }
+    lssdp_free(lssdp, fetcher->cache_table);
+    lssdp_free(lssdp, fetcher);
+
+    lssdp->fetch.fetcher    = NULL;
+    lssdp->fetch.active_num = 0;
+    return 0;
+}
+
+// 34. lssdp_neighbor_query
+lssdp_nbr * lssdp_neighbor_query(lssdp_ctx * lssdp, lssdp_nbr_iter * iter, int index, const char * value) {
+    if (lssdp == NULL || iter == NULL || value == NULL) {
+        lssdp_error("lssdp, iter and value should not be NULL\n");
+        return NULL;
+    }
+
+    // identity key and datagram are not field values
+    *iter = (lssdp_nbr_iter) {};
+    if (index < 0 || index >= LSSDP_NBR_INDEX_FIELD_NUM || index == LSSDP_NBR_INDEX_KEY || index == LSSDP_NBR_INDEX_DATAGRAM) {
+        lssdp_error("index %d can not be queried\n", index);
+        return NULL;
+    }
+
+    iter->index = index;
+    iter->value = value;
+    iter->hash  = get_hash(value);
+
+    // empty optional field, or index is compiled out (LSSDP_NBR_QUERY_INDEX): scan neighbor list
+    if (index >= LSSDP_NBR_INDEX_NUM || (neighbor_index_is_optional(index) && strlen(value) == 0)) {
+        iter->is_scan = true;
+        iter->next    = lssdp->neighbor_list;
+    } else if (lssdp->neighbor_index[index].size > 0) {
+        struct lssdp_nbr_index * table = &lssdp->neighbor_index[index];
+        iter->next = table->table[iter->hash % table->size];
+    }
+    return lssdp_neighbor_query_next(iter);
+}
+
+// 35. lssdp_neighbor_query_next
+lssdp_nbr * lssdp_neighbor_query_next(lssdp_nbr_iter * iter) {
+    if (iter == NULL) {
+        lssdp_ctx * lssdp = NULL;   // no context: default log callback
+        lssdp_error("iter should not be NULL\n");
+        return NULL;
+    }
+
+    // the other values of the same bucket are skipped
+    while (iter->next != NULL) {
+        lssdp_nbr * nbr = iter->next;
+        iter->next = iter->is_scan ? nbr->next : nbr->index_next[iter->index];
+        if ((iter->is_scan || nbr->index_hash[iter->index] == iter->hash) && strcmp(neighbor_index_key(nbr, iter->index), iter->value) == 0) {
+            return nbr;
+        }
+    }
+    return NULL;
+}
+
+// 36. lssdp_neighbor_query_array
+int lssdp_neighbor_query_array(lssdp_ctx * lssdp, int index, const char * value, lssdp_nbr ** array, size_t array_size) {
+    if (array == NULL && array_size > 0) {
+        lssdp_error("array should not be NULL\n");
+        return -1;
+    }
+
+    lssdp_nbr_iter iter;
+    lssdp_nbr * nbr = lssdp_neighbor_query(lssdp, &iter, index, value);
+    if (nbr == NULL && iter.value == NULL) {
+        return -1;  // invalid argument
+    }
+
+    int num = 0;
+    for (; nbr != NULL; nbr = lssdp_neighbor_query_next(&iter)) {
+        if ((size_t) num < array_size) {
+            array[num] = nbr;
+        }
+        num++;
+    }
+    return num;
+}
+
+
+/** Internal Function **/
+
+static int lssdp_packet_handler(lssdp_ctx * lssdp, const char * buffer, size_t buffer_len, const struct sockaddr * address, long long timestamp, long long recv_ns) {
+    int result = -1;
+    char header[LSSDP_BUFFER_LEN];
+    lssdp_packet packet = {
+        .recv_ns = recv_ns
+    };
+
+    lssdp->stats.packet_recv_num++;
+    lssdp->packet_time_ns = recv_ns;
+    lssdp_probe(packet_recv, buffer, buffer_len, address, recv_ns);
+
+    // latency trace: kernel queue (receive timestamp -> read)
+    long long read_ns = LSSDP_LATENCY_TRACE && lssdp->latency_trace ? get_current_time_ns() : 0;
+    if (read_ns > 0 && recv_ns > 0) {
+        latency_add(lssdp, LSSDP_LATENCY_QUEUE, read_ns - recv_ns);
+    }
+
+    // ignore the SSDP packet received from self
+    if (is_self_address(lssdp, address)) {
+        lssdp->stats.packet_self_num++;
+        goto end;
+    }
+
+    // age list is in update_time order (eviction, probe): an out-of-order timestamp is clamped to the newest one
+    if (lssdp->neighbor_age_last != NULL && timestamp < lssdp->neighbor_age_last->update_time) {
+        timestamp = lssdp->neighbor_age_last->update_time;
+    }
+
+    // the same datagram as the last one of a neighbor from the same source: only refresh update_time,
+    // unless subscriptions or header.search_target are changed after its search target was matched
+    packet.datagram_hash = get_datagram_hash(buffer, buffer_len, address);
+    packet.datagram_len  = buffer_len;
+    lssdp_nbr * nbr = neighbor_find_datagram(lssdp, packet.datagram_hash, packet.datagram_len);
+    if (nbr != NULL && nbr->match_generation == match_generation_update(lssdp)) {
+        nbr->update_time = timestamp;
+        neighbor_age_touch(lssdp, nbr);
+        shm_refresh(lssdp, nbr);
+        if (lssdp->debug) {
+            lssdp_info("RECV <- %-8s   %-28s  %s\n", "(same)", nbr->location, nbr->sm_id);
+        }
+        result = 0;
+        goto end;
+    }
+
+    // header fields are copied to packet.header, which is not longer than the packet
+    packet.header = buffer_len <= sizeof(header) ? header : (char *) lssdp_malloc(lssdp, buffer_len);
+    if (packet.header == NULL) {
+        lssdp_error("malloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        goto end;
+    }
+
+    // parse SSDP packet to struct
+    if (lssdp_packet_parser(lssdp, buffer, buffer_len, &packet) != 0) {
+        lssdp->stats.packet_invalid_num++;
+        goto end;
+    }
+    result = 0;     // valid packet, unless neighbor list rejects it
+    packet.update_time = timestamp;
+    packet.stage_ns    = latency_record(lssdp, LSSDP_LATENCY_PARSE, read_ns);
+    lssdp_probe(packet_parse, packet.method, packet.st, buffer_len);
+
+    // M-SEARCH: send RESPONSE back for each matched service
+    if (strcmp(packet.method, Global.MSEARCH) == 0) {
+        if (lssdp_send_response(lssdp, address, packet.st) == 0 && lssdp->debug) {
+            lssdp_info("RECV <- %-8s   not match with any service    %s\n", packet.method, packet.st);
+        }
+        goto end;
+    }
+
+    // check search target (header.search_target and subscriptions)
+    lssdp_subscription * subscription = NULL;
+    if (match_search_target(lssdp, packet.st, &subscription) == false) {
+        // search target is not match
+        lssdp_probe(st_mismatch, packet.method, packet.st, packet.location);
+        if (lssdp->debug) {
+            lssdp_info("RECV <- %-8s   not match with %-14s %s\n", packet.method, packet.st, packet.location);
+        }
+        goto end;
+    }
+
+    // NOTIFY ssdp:byebye: remove from neighbor_list
+    if (strcmp(packet.nts, Global.NTS_BYEBYE) == 0) {
+        neighbor_list_remove_usn(lssdp, packet.usn);
+        if (lssdp->debug) {
+            lssdp_info("RECV <- %-8s   %-28s  %s\n", packet.nts, packet.usn, packet.sm_id);
+        }
+        goto end;
+    }
+
+    // set packet source
+    packet.family = address->sa_family;
+    get_address_ip(lssdp, address, packet.ip);
+    struct lssdp_interface * interface = find_interface_in_LAN(lssdp, address);
+    if (interface != NULL) {
+        snprintf(packet.interface, LSSDP_INTERFACE_NAME_LEN, "%s", interface->name);
+    }
+
+    // RESPONSE, NOTIFY (ssdp:alive, ssdp:update): add to neighbor_list
+    result = neighbor_list_add(lssdp, packet, subscription);
+
+    if (lssdp->debug) {
+        lssdp_info("RECV <- %-8s   %-28s  %s\n", packet.method, packet.location, packet.sm_id);
+    }
+
+end:
+    // invoke packet received callback
+    if (lssdp->packet_received_callback != NULL) {
+        lssdp->packet_received_callback(lssdp, buffer, buffer_len);
+    }
+
+    if (packet.header != header) {
+        lssdp_free(lssdp, packet.header);
+    }
+    lssdp->packet_time_ns = 0;
+    return result;
+}
+
+static int socket_close(lssdp_ctx * lssdp) {
+    // check lssdp->sock
+    if (lssdp->sock <= 0 && lssdp->sock6 <= 0) {
+        lssdp_warn("SSDP socket is %d, ignore socket_close request.\n", lssdp->sock);
+        goto end;
+    }
+
+    // close socket (IPv4, IPv6)
+    int result = 0;
+    int * sock[2] = {&lssdp->sock, &lssdp->sock6};
+    size_t i;
+    for (i = 0; i < 2; i++) {
+        if (*sock[i] <= 0) {
+            continue;
+        }
+
+        if (close(*sock[i]) != 0) {
+            lssdp_error("close socket %d failed, errno = %s (%d)\n", *sock[i], strerror(errno), errno);
+            result = -1;
+            continue;
+        }
+
+        // close socket success
+        lssdp_info("close SSDP socket %d\n", *sock[i]);
+        *sock[i] = -1;
+    }
+
+    if (result != 0) {
+        return -1;
+    }
+end:
+    lssdp->sock  = -1;
+    lssdp->sock6 = -1;
+    lssdp_neighbor_remove_all(lssdp);  // force clean up neighbor_list
+    return 0;
+}
+
+static int send_notify(lssdp_ctx * lssdp, const char * nts) {
+    // primary service (lssdp.header)
+    lssdp_service primary = {};
+    bool has_primary = get_header_service(lssdp, &primary);
+    if (!has_primary && lssdp->service_list == NULL) {
+        // nothing to advertise
+        return 0;
+    }
+
+    size_t i;
+    for (i = 0; i < lssdp->interface_num; i++) {
+        struct lssdp_interface * interface = &lssdp->interface[i];
+
+        // avoid sending multicast to localhost
+        if (is_loopback_interface(interface)) {
+            continue;
+        }
+
+        // 1. create multicast socket of the interface
+        lssdp_batch batch = {};
+        if (multicast_batch_open(lssdp, interface, &batch) != 0) {
+            continue;
+        }
+
+        // 2. set NOTIFY packet of each service
+        size_t packet_num = 0;
+        int ret = 0;
+        if (has_primary) {
+            ret |= batch_add(lssdp, &batch, set_notify_packet(lssdp, interface, &primary, nts, batch.packet[batch.num]));
+            packet_num++;
+        }
+
+        lssdp_service * service;
+        for (service = lssdp->service_list; service != NULL; service = service->next) {
+            ret |= batch_add(lssdp, &batch, set_notify_packet(lssdp, interface, service, nts, batch.packet[batch.num]));
+            packet_num++;
+        }
+
+        // 3. send NOTIFY
+        ret |= batch_flush(lssdp, &batch);
+        if (close(batch.fd) != 0) {
+            lssdp_error("close fd %d failed, errno = %s (%d)\n", batch.fd, strerror(errno), errno);
+        }
+
+        lssdp_probe(multicast_send, nts, interface->name, interface->ip, ret);
+        if (ret == 0 && lssdp->debug) {
+            lssdp_info("SEND => %-8s   %s => MULTICAST (%zu %s)\n", Global.NOTIFY, interface->ip, packet_num, nts);
+        }
+    }
+
+    return 0;
+}
+
+static int ssdp_socket_create(lssdp_ctx * lssdp, int family) {
+    // 1. create UDP socket (in the network namespace)
+    int original_fd;
+    if (netns_enter(lssdp, &original_fd) != 0) {
+        return -1;
+    }
+
+    int fd = socket(family, SOCK_DGRAM, 0);
+    if (netns_leave(lssdp, original_fd) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    if (fd < 0) {
+        lssdp_error("create socket failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    // 2. set non-blocking
+    int opt = 1;
+    if (ioctl(fd, FIONBIO, &opt) != 0) {
+        lssdp_error("ioctl FIONBIO failed, errno = %s (%d)\n", strerror(errno), errno);
+        goto err;
+    }
+
+    // 3. set reuse address
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) != 0) {
+        lssdp_error("setsockopt SO_REUSEADDR failed, errno = %s (%d)\n", strerror(errno), errno);
+        goto err;
+    }
+
+    // 4. kernel receive timestamp of each datagram (neighbor update_time, latency trace), and drop counter
+#ifdef SO_TIMESTAMPNS
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt)) != 0) {
+        lssdp_warn("setsockopt SO_TIMESTAMPNS failed, errno = %s (%d)\n", strerror(errno), errno);
+    }
+#endif
+#ifdef SO_RXQ_OVFL
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &opt, sizeof(opt)) != 0) {
+        lssdp_warn("setsockopt SO_RXQ_OVFL failed, errno = %s (%d)\n", strerror(errno), errno);
+    }
+#endif
+
+    // receive / send buffer size
+    socket_buffer_set(lssdp, fd, SO_RCVBUFFORCE, SO_RCVBUF, lssdp->recv_buffer_size);
+    socket_buffer_set(lssdp, fd, SO_SNDBUFFORCE, SO_SNDBUF, lssdp->send_buffer_size);
+
+    // 5. set FD_CLOEXEC (http://kaivy2001.pixnet.net/blog/post/32726732)
+    int sock_opt = fcntl(fd, F_GETFD);
+    if (sock_opt == -1) {
+        lssdp_error("fcntl F_GETFD failed, errno = %s (%d)\n", strerror(errno), errno);
+    } else {
+        // F_SETFD
+        if (fcntl(fd, F_SETFD, sock_opt | FD_CLOEXEC) == -1) {
+            lssdp_error("fcntl F_SETFD FD_CLOEXEC failed, errno = %s (%d)\n", strerror(errno), errno);
+        }
+    }
+
+    // 6. bind socket
+    if (family == AF_INET) {
+        struct sockaddr_in addr = {
+            .sin_family      = AF_INET,
+            .sin_port        = htons(lssdp->port),
+            .sin_addr.s_addr = htonl(INADDR_ANY)
+        };
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            lssdp_error("bind failed, errno = %s (%d)\n", strerror(errno), errno);
+            goto err;
+        }
+    } else {
+        // IPv6 socket only receives IPv6 packet
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt)) != 0) {
+            lssdp_error("setsockopt IPV6_V6ONLY failed, errno = %s (%d)\n", strerror(errno), errno);
+            goto err;
+        }
+
+        struct sockaddr_in6 addr = {
+            .sin6_family = AF_INET6,
+            .sin6_port   = htons(lssdp->port),
+            .sin6_addr   = in6addr_any
+        };
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            lssdp_error("bind failed, errno = %s (%d)\n", strerror(errno), errno);
+            goto err;
+        }
+    }
+
+    return fd;
+err:
+    if (close(fd) != 0) {
+        lssdp_error("close fd %d failed, errno = %s (%d)\n", fd, strerror(errno), errno);
+    }
+    return -1;
+}
+
+static int netns_enter(lssdp_ctx * lssdp, int * original_fd) {
+    *original_fd = -1;
+    if (strlen(lssdp->netns) == 0) {
+        return 0;
+    }
+
+#ifdef __linux__
+    // 1. open the network namespace once, it is kept until lssdp_socket_close / lssdp_ctx_free
+    if (lssdp->netns_fd <= 0) {
+        // name in /var/run/netns (ip netns), or path, e.g. /proc/<pid>/ns/net
+        char path[PATH_MAX] = {};
+        if (lssdp->netns[0] == '/') {
+            snprintf(path, sizeof(path), "%s", lssdp->netns);
+        } else {
+            snprintf(path, sizeof(path), "/var/run/netns/%s", lssdp->netns);
+        }
+
+        lssdp->netns_fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (lssdp->netns_fd < 0) {
+            lssdp_error("open network namespace %s failed, errno = %s (%d)\n", path, strerror(errno), errno);
+            return -1;
+        }
+    }
+
+    // 2. setns is per thread: keep the network namespace of the calling thread
+    *original_fd = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+    if (*original_fd < 0) {
+        lssdp_error("open network namespace of thread failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    if (setns(lssdp->netns_fd, CLONE_NEWNET) != 0) {
+        lssdp_error("setns %s failed, errno = %s (%d)\n", lssdp->netns, strerror(errno), errno);
+        close(*original_fd);
+        *original_fd = -1;
+        return -1;
+    }
+    return 0;
+#else
+    lssdp_error("network namespace %s is not supported\n", lssdp->netns);
+    return -1;
+#endif
+}
+
+static int netns_leave(lssdp_ctx * lssdp, int original_fd) {
+    if (original_fd < 0) {
+        return 0;
+    }
+
+    int result = 0;
+#ifdef __linux__
+    // the calling thread is left in the network namespace of context, the caller must not go on
+    if (setns(original_fd, CLONE_NEWNET) != 0) {
+        lssdp_error("setns back from %s failed, errno = %s (%d)\n", lssdp->netns, strerror(errno), errno);
+        result = -1;
+    }
+#endif
+    close(original_fd);
+    return result;
+}
+
+static void netns_close(lssdp_ctx * lssdp) {
+    if (lssdp->netns_fd <= 0) {
+        return;
+    }
+
+    if (close(lssdp->netns_fd) != 0) {
+        lssdp_error("close fd %d failed, errno = %s (%d)\n", lssdp->netns_fd, strerror(errno), errno);
+    }
+    lssdp->netns_fd = -1;
+}
+
+static void multicast_membership_update(lssdp_ctx * lssdp, const struct lssdp_interface * original_list, size_t original_num) {
+    size_t i;
+
+    // 1. drop multicast group of the removed interfaces
+    for (i = 0; i < original_num; i++) {
+        const struct lssdp_interface * interface = &original_list[i];
+        if (interface_list_has_group(original_list, i, interface)) {
+            // the group has been checked
+            continue;
+        }
+
+        if (interface_list_has_group(lssdp->interface, lssdp->interface_num, interface) == false) {
+            multicast_membership(lssdp, interface, false);
+        }
+    }
+
+    // 2. join multicast group of the added interfaces
+    for (i = 0; i < lssdp->interface_num; i++) {
+        const struct lssdp_interface * interface = &lssdp->interface[i];
+        if (interface_list_has_group(lssdp->interface, i, interface)) {
+            // the group has been checked
+            continue;
+        }
+
+        if (interface_list_has_group(original_list, original_num, interface) == false) {
+            multicast_membership(lssdp, interface, true);
+        }
+    }
+}
+
+static int multicast_membership(lssdp_ctx * lssdp, const struct lssdp_interface * interface, bool is_join) {
+    // the multicast group is joined per interface (index), loopback is excluded
+    if (is_loopback_interface(interface)) {
+        return 0;
+    }
+
+    const char * action = is_join ? "join" : "drop";
+    if (interface->family == AF_INET) {
+        if (lssdp->sock <= 0) {
+            return 0;
+        }
+
+#ifdef __linux__
+        struct ip_mreqn imr = {
+            .imr_multiaddr.s_addr = inet_addr(Global.ADDR_MULTICAST),
+            .imr_ifindex          = interface->index
+        };
+#else
+        struct ip_mreq imr = {
+            .imr_multiaddr.s_addr = inet_addr(Global.ADDR_MULTICAST),
+            .imr_interface.s_addr = interface->addr
+        };
+#endif
+        int option = is_join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP;
+        if (setsockopt(lssdp->sock, IPPROTO_IP, option, &imr, sizeof(imr)) != 0) {
+            lssdp_warn("%s multicast group %s on %s failed: %s (%d)\n", action, Global.ADDR_MULTICAST, interface->name, strerror(errno), errno);
+            return -1;
+        }
+
+        lssdp_info("%s multicast group %s on %s\n", action, Global.ADDR_MULTICAST, interface->name);
+        return 0;
+    }
+
+    if (lssdp->sock6 <= 0) {
+        return 0;
+    }
+
+    // IPv6: link-local and site-local group
+    int result = 0;
+    const char * group[2] = {Global.ADDR_MULTICAST6_LINK, Global.ADDR_MULTICAST6_SITE};
+    size_t i;
+    for (i = 0; i < 2; i++) {
+        struct ipv6_mreq mreq = {
+            .ipv6mr_interface = interface->index
+        };
+        inet_pton(AF_INET6, group[i], &mreq.ipv6mr_multiaddr);
+
+        int option = is_join ? IPV6_JOIN_GROUP : IPV6_LEAVE_GROUP;
+        if (setsockopt(lssdp->sock6, IPPROTO_IPV6, option, &mreq, sizeof(mreq)) != 0) {
+            lssdp_warn("%s multicast group %s on %s failed: %s (%d)\n", action, group[i], interface->name, strerror(errno), errno);
+            result = -1;
+            continue;
+        }
+
+        lssdp_info("%s multicast group %s on %s\n", action, group[i], interface->name);
+    }
+    return result;
+}
+
+static bool interface_list_has_group(const struct lssdp_interface * list, size_t num, const struct lssdp_interface * interface) {
+    // multicast group membership is per (family, interface index)
+    size_t i;
+    for (i = 0; i < num; i++) {
+        if (list[i].family == interface->family && list[i].index == interface->index && is_loopback_interface(&list[i]) == is_loopback_interface(interface)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int multicast_batch_open(lssdp_ctx * lssdp, const struct lssdp_interface * interface, lssdp_batch * batch) {
+    if (strlen(interface->name) == 0) {
+        lssdp_error("interface.name should not be empty\n");
+        return -1;
+    }
+
+    // 1. create UDP socket (in the network namespace)
+    int original_fd;
+    if (netns_enter(lssdp, &original_fd) != 0) {
+        return -1;
+    }
+
+    int fd = socket(interface->family, SOCK_DGRAM, 0);
+    if (netns_leave(lssdp, original_fd) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    if (fd < 0) {
+        lssdp_error("create socket failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    socket_buffer_set(lssdp, fd, SO_SNDBUFFORCE, SO_SNDBUF, lssdp->send_buffer_size);
+
+    if (interface->family == AF_INET) {
+        // 2. bind socket
+        struct sockaddr_in addr = {
+            .sin_family      = AF_INET,
+            .sin_addr.s_addr = interface->addr
+        };
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            lssdp_error("bind failed, errno = %s (%d)\n", strerror(errno), errno);
+            goto err;
+        }
+
+        // 3. disable IP_MULTICAST_LOOP
+        char opt = 0;
+        if (setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &opt, sizeof(opt)) < 0) {
+            lssdp_error("setsockopt IP_MULTICAST_LOOP failed, errno = %s (%d)\n", strerror(errno), errno);
+            goto err;
+        }
+
+        // 4. set destination address
+        struct sockaddr_in * dest_addr = (struct sockaddr_in *) &batch->address;
+        dest_addr->sin_family      = AF_INET;
+        dest_addr->sin_port        = htons(lssdp->port);
+        dest_addr->sin_addr.s_addr = inet_addr(Global.ADDR_MULTICAST);
+        batch->address_len = sizeof(struct sockaddr_in);
+    } else {
+        // 2. bind socket
+        struct sockaddr_in6 addr = {
+            .sin6_family   = AF_INET6,
+            .sin6_scope_id = interface->index
+        };
+        memcpy(&addr.sin6_addr, interface->addr6, 16);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            lssdp_error("bind failed, errno = %s (%d)\n", strerror(errno), errno);
+            goto err;
+        }
+
+        // 3. set IPV6_MULTICAST_IF, disable IPV6_MULTICAST_LOOP
+        unsigned int index = interface->index;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_IF, &index, sizeof(index)) < 0) {
+            lssdp_error("setsockopt IPV6_MULTICAST_IF failed, errno = %s (%d)\n", strerror(errno), errno);
+            goto err;
+        }
+
+        unsigned int opt = 0;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &opt, sizeof(opt)) < 0) {
+            lssdp_error("setsockopt IPV6_MULTICAST_LOOP failed, errno = %s (%d)\n", strerror(errno), errno);
+            goto err;
+        }
+
+        // 4. set destination address: link-local address to ff02::c, others to ff05::c
+        struct sockaddr_in6 * dest_addr = (struct sockaddr_in6 *) &batch->address;
+        dest_addr->sin6_family   = AF_INET6;
+        dest_addr->sin6_port     = htons(lssdp->port);
+        dest_addr->sin6_scope_id = interface->index;
+        inet_pton(AF_INET6, is_link_local_interface(interface) ? Global.ADDR_MULTICAST6_LINK : Global.ADDR_MULTICAST6_SITE, &dest_addr->sin6_addr);
+        batch->address_len = sizeof(struct sockaddr_in6);
+    }
+
+    batch->fd  = fd;
+    batch->num = 0;
+    return 0;
+err:
+    if (close(fd) != 0) {
+        lssdp_error("close fd %d failed, errno = %s (%d)\n", fd, strerror(errno), errno);
+    }
+    return -1;
+}
+
+static int get_address_ip(lssdp_ctx * lssdp, const struct sockaddr * address, char * ip) {
+    const void * addr = address->sa_family == AF_INET
+                      ? (const void *) &((const struct sockaddr_in *) address)->sin_addr
+                      : (const void *) &((const struct sockaddr_in6 *) address)->sin6_addr;
+    if (inet_ntop(address->sa_family, addr, ip, LSSDP_IP_LEN) == NULL) {
+        lssdp_error("inet_ntop failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    return 0;
+}
+
+static socklen_t get_address_len(const struct sockaddr_storage * address) {
+    return address->ss_family == AF_INET ? sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
+}
+
+static bool is_loopback_interface(const struct lssdp_interface * interface) {
+    if (interface->family == AF_INET) {
+        return interface->addr == inet_addr(Global.ADDR_LOCALHOST);
+    }
+    return IN6_IS_ADDR_LOOPBACK((const struct in6_addr *) interface->addr6);
+}
+
+static bool is_link_local_interface(const struct lssdp_interface * interface) {
+    return interface->family == AF_INET6 && IN6_IS_ADDR_LINKLOCAL((const struct in6_addr *) interface->addr6);
+}
+
+static const char * get_multicast_host(const struct lssdp_interface * interface) {
+    if (interface->family == AF_INET) {
+        return Global.ADDR_MULTICAST;
+    }
+    return is_link_local_interface(interface) ? Global.HOST_MULTICAST6_LINK : Global.HOST_MULTICAST6_SITE;
+}
+
+static const char * get_location_host(const struct lssdp_interface * interface, char * host) {
+    if (interface->family == AF_INET) {
+        return interface->ip;
+    }
+
+    // IPv6 address in URL: [xxxx::xxxx]
+    snprintf(host, LSSDP_IP_LEN + 2, "[%s]", interface->ip);
+    return host;
+}
+
+static int batch_add(lssdp_ctx * lssdp, lssdp_batch * batch, int packet_len) {
+    if (packet_len <= 0 || packet_len >= LSSDP_BUFFER_LEN) {
+        lssdp_error("invalid packet length %d\n", packet_len);
+        return -1;
+    }
+
+    batch->len[batch->num++] = packet_len;
+
+    // batch is full: send it out
+    if (batch->num == LSSDP_BATCH_SIZE) {
+        return batch_flush(lssdp, batch);
+    }
+    return 0;
+}
+
+static int batch_flush(lssdp_ctx * lssdp, lssdp_batch * batch) {
+    if (batch->num == 0) {
+        return 0;
+    }
+
+    int result = 0;
+    size_t i, sent_num = 0;
+#ifdef __linux__
+    // send all packets with one system call
+    struct iovec   iov[LSSDP_BATCH_SIZE] = {};
+    struct mmsghdr msg[LSSDP_BATCH_SIZE] = {};
+    for (i = 0; i < batch->num; i++) {
+        iov[i].iov_base = batch->packet[i];
+        iov[i].iov_len  = batch->len[i];
+        msg[i].msg_hdr.msg_name    = batch->to != NULL ? &batch->to[i] : &batch->address;
+        msg[i].msg_hdr.msg_namelen = batch->to != NULL ? get_address_len(&batch->to[i]) : batch->address_len;
+        msg[i].msg_hdr.msg_iov     = &iov[i];
+        msg[i].msg_hdr.msg_iovlen  = 1;
+    }
+
+    for (i = 0; i < batch->num; ) {
+        int ret = sendmmsg(batch->fd, &msg[i], batch->num - i, 0);
+        if (ret <= 0) {
+            lssdp_error("sendmmsg fd %d failed, errno = %s (%d)\n", batch->fd, strerror(errno), errno);
+            result = -1;
+            break;
+        }
+        i += ret;
+    }
+    sent_num = i;
+#else
+    for (i = 0; i < batch->num; i++) {
+        struct sockaddr_storage * address = batch->to != NULL ? &batch->to[i] : &batch->address;
+        socklen_t address_len = batch->to != NULL ? get_address_len(address) : batch->address_len;
+        if (sendto(batch->fd, batch->packet[i], batch->len[i], 0, (struct sockaddr *) address, address_len) == -1) {
+            lssdp_error("sendto fd %d failed, errno = %s (%d)\n", batch->fd, strerror(errno), errno);
+            result = -1;
+            continue;
+        }
+        sent_num++;
+    }
+#endif
+
+    lssdp->stats.packet_send_num       += sent_num;
+    lssdp->stats.packet_send_error_num += batch->num - sent_num;
+    batch->num = 0;
+    return result;
+}
+
+static int lssdp_send_response(lssdp_ctx * lssdp, const struct sockaddr * address, const char * search_target) {
+    // SSDP socket has not been setup (e.g. replay), RESPONSE is not sent
+    int fd = address->sa_family == AF_INET ? lssdp->sock : lssdp->sock6;
+    if (fd <= 0) {
+        return 0;
+    }
+
+    // get M-SEARCH IP
+    char msearch_ip[LSSDP_IP_LEN] = {};
+    if (get_address_ip(lssdp, address, msearch_ip) != 0) {
+        return -1;
+    }
+
+    // 1. find the interface which is in LAN
+    struct lssdp_interface * interface = find_interface_in_LAN(lssdp, address);
+    if (interface == NULL) {
+        if (lssdp->debug) {
+            lssdp_info("RECV <- %-8s   Interface is not found        %s\n", Global.MSEARCH, msearch_ip);
+        }
+
+        if (lssdp->interface_num == 0) {
+            lssdp_warn("Network Interface is empty, no destination to send %s\n", Global.RESPONSE);
+        }
+        return -1;
+    }
+
+    // 2. set port to address
+    lssdp_batch batch = {
+        .fd = fd
+    };
+
+    if (address->sa_family == AF_INET) {
+        batch.address_len = sizeof(struct sockaddr_in);
+        memcpy(&batch.address, address, batch.address_len);
+        ((struct sockaddr_in *) &batch.address)->sin_port = htons(lssdp->port);
+    } else {
+        batch.address_len = sizeof(struct sockaddr_in6);
+        memcpy(&batch.address, address, batch.address_len);
+        ((struct sockaddr_in6 *) &batch.address)->sin6_port = htons(lssdp->port);
+    }
+
+    // 3. set response packet of each matched service
+    int ret = 0;
+    size_t packet_num = 0;
+    bool is_all = strcmp(search_target, Global.ST_ALL) == 0;
+
+    lssdp_service primary = {};
+    if (get_header_service(lssdp, &primary) && (is_all || strcmp(search_target, primary.search_target) == 0)) {
+        ret |= batch_add(lssdp, &batch, set_response_packet(lssdp, interface, &primary, batch.packet[batch.num]));
+        packet_num++;
+    }
+
+    lssdp_service * service;
+    if (is_all) {
+        // ssdp:all: every registered service
+        for (service = lssdp->service_list; service != NULL; service = service->next) {
+            ret |= batch_add(lssdp, &batch, set_response_packet(lssdp, interface, service, batch.packet[batch.num]));
+            packet_num++;
+        }
+    } else {
+        // lookup the service table by search target
+        service = lssdp->service_table[get_hash(search_target) % LSSDP_SERVICE_TABLE_SIZE];
+        for (; service != NULL; service = service->hash_next) {
+            if (strcmp(service->search_target, search_target) != 0) {
+                continue;
+            }
+            ret |= batch_add(lssdp, &batch, set_response_packet(lssdp, interface, service, batch.packet[batch.num]));
+            packet_num++;
+        }
+    }
+
+    if (packet_num == 0) {
+        // search target is not match
+        return 0;
+    }
+
+    if (lssdp->debug) {
+        lssdp_info("RECV <- %-8s   %s <- %s\n", Global.MSEARCH, interface->ip, msearch_ip);
+    }
+
+    // 4. send data
+    ret |= batch_flush(lssdp, &batch);
+    if (ret != 0) {
+        lssdp_error("send RESPONSE to %s failed\n", msearch_ip);
+        return -1;
+    }
+
+    lssdp_probe(response_send, search_target, interface->name, msearch_ip, packet_num);
+    if (lssdp->debug) {
+        lssdp_info("SEND => %-8s   %s => %s (%zu)\n", Global.RESPONSE, interface->ip, msearch_ip, packet_num);
+    }
+
+    return packet_num;
+}
+
+static int set_msearch_packet(lssdp_ctx * lssdp, const char * host, const char * search_target, char * buffer) {
+    return snprintf(buffer, LSSDP_BUFFER_LEN,
+        "%s"
+        "HOST:%s:%d\r\n"
+        "MAN:\"ssdp:discover\"\r\n"
+        "MX:1\r\n"
+        "ST:%s\r\n"
+        "USER-AGENT:OS/version product/version\r\n"
+        "\r\n",
+        Global.HEADER_MSEARCH,                      // HEADER
+        host, lssdp->port,                          // HOST
+        search_target                               // ST (Search Target)
+    );
+}
+
+static int set_notify_packet(lssdp_ctx * lssdp, const struct lssdp_interface * interface, const lssdp_service * service, const char * nts, char * buffer) {
+    const char * domain = lssdp->header.location.domain;
+    char host[LSSDP_IP_LEN + 2] = {};
+    return snprintf(buffer, LSSDP_BUFFER_LEN,
+        "%s"
+        "HOST:%s:%d\r\n"
+        "CACHE-CONTROL:max-age=%d\r\n"
+        "LOCATION:%s%s%s\r\n"
+        "SERVER:OS/version product/version\r\n"
+        "NT:%s\r\n"
+        "NTS:%s\r\n"
+        "USN:%s\r\n"
+        "SM_ID:%s\r\n"
+        "DEV_TYPE:%s\r\n"
+        "\r\n",
+        Global.HEADER_NOTIFY,                       // HEADER
+        get_multicast_host(interface), lssdp->port, // HOST
+        get_max_age(lssdp),                         // CACHE-CONTROL
+        lssdp->header.location.prefix,              // LOCATION
+        strlen(domain) > 0 ? domain : get_location_host(interface, host),
+        lssdp->header.location.suffix,
+        service->search_target,                     // NT (Notify Type)
+        nts,                                        // NTS (ssdp:alive, ssdp:byebye)
+        service->unique_service_name,               // USN
+        service->sm_id,                             // SM_ID    (addtional field)
+        service->device_type                        // DEV_TYPE (addtional field)
+    );
+}
+
+static int set_response_packet(lssdp_ctx * lssdp, const struct lssdp_interface * interface, const lssdp_service * service, char * buffer) {
+    const char * domain = lssdp->header.location.domain;
+    char host[LSSDP_IP_LEN + 2] = {};
+    return snprintf(buffer, LSSDP_BUFFER_LEN,
+        "%s"
+        "CACHE-CONTROL:max-age=%d\r\n"
+        "DATE:\r\n"
+        "EXT:\r\n"
+        "LOCATION:%s%s%s\r\n"
+        "SERVER:OS/version product/version\r\n"
+        "ST:%s\r\n"
+        "USN:%s\r\n"
+        "SM_ID:%s\r\n"
+        "DEV_TYPE:%s\r\n"
+        "\r\n",
+        Global.HEADER_RESPONSE,                     // HEADER
+        get_max_age(lssdp),                         // CACHE-CONTROL
+        lssdp->header.location.prefix,              // LOCATION
+        strlen(domain) > 0 ? domain : get_location_host(interface, host),
+        lssdp->header.location.suffix,
+        service->search_target,                     // ST (Search Target)
+        service->unique_service_name,               // USN
+        service->sm_id,                             // SM_ID    (addtional field)
+        service->device_type                        // DEV_TYPE (addtional field)
+    );
+}
+
+static int get_max_age(lssdp_ctx * lssdp) {
+    return lssdp->header.max_age > 0 ? lssdp->header.max_age : LSSDP_MAX_AGE;
+}
+
+static bool get_header_service(lssdp_ctx * lssdp, lssdp_service * service) {
+    memcpy(service->search_target,       lssdp->header.search_target,       LSSDP_FIELD_LEN);
+    memcpy(service->unique_service_name, lssdp->header.unique_service_name, LSSDP_FIELD_LEN);
+    memcpy(service->sm_id,               lssdp->header.sm_id,               LSSDP_FIELD_LEN);
+    memcpy(service->device_type,         lssdp->header.device_type,         LSSDP_FIELD_LEN);
+    service->next      = NULL;
+    service->hash_next = NULL;
+
+    // header is advertised only when search target is set
+    return strlen(service->search_target) > 0;
+}
+
+static bool match_search_target(lssdp_ctx * lssdp, const char * search_target, lssdp_subscription ** subscription) {
+    lssdp_subscription * prefix_match = NULL;
+    lssdp_subscription * s;
+
+    // 1. hash the search target once, probe the prefix subscriptions at each subscribed prefix length
+    uint32_t hash = get_prefix_hash("", 0);
+    size_t i;
+    for (i = 0; ; i++) {
+        if (i < LSSDP_FIELD_LEN && (lssdp->subscription_prefix_mask[i / 32] & (1u << (i % 32))) != 0) {
+            for (s = lssdp->subscription_table[hash % LSSDP_SUBSCRIPTION_TABLE_SIZE]; s != NULL; s = s->hash_next) {
+                if (s->is_prefix && s->prefix_len == i && strncmp(s->search_target, search_target, i) == 0) {
+                    prefix_match = s;   // the longer prefix wins
+                    break;
+                }
+            }
+        }
+
+        if (search_target[i] == '\0') {
+            break;
+        }
+        hash = hash_update(hash, search_target[i]);
+    }
+
+    // 2. exact subscription
+    for (s = lssdp->subscription_table[hash % LSSDP_SUBSCRIPTION_TABLE_SIZE]; s != NULL; s = s->hash_next) {
+        if (!s->is_prefix && strcmp(s->search_target, search_target) == 0) {
+            *subscription = s;
+            return true;
+        }
+    }
+
+    // 3. header search target
+    if (strcmp(search_target, lssdp->header.search_target) == 0) {
+        *subscription = NULL;
+        return true;
+    }
+
+    // 4. the longest prefix subscription
+    *subscription = prefix_match;
+    return prefix_match != NULL;
+}
+
+static void subscription_prefix_mask_update(lssdp_ctx * lssdp) {
+    memset(lssdp->subscription_prefix_mask, 0, sizeof(lssdp->subscription_prefix_mask));
+
+    lssdp_subscription * s;
+    for (s = lssdp->subscription_list; s != NULL; s = s->next) {
+        if (s->is_prefix) {
+            lssdp->subscription_prefix_mask[s->prefix_len / 32] |= 1u << (s->prefix_len % 32);
+        }
+    }
+}
+
+static uint32_t match_generation_update(lssdp_ctx * lssdp) {
+    // header.search_target is set by caller directly, its change is detected by hash
+    uint32_t hash = get_hash(lssdp->header.search_target);
+    if (hash != lssdp->match_hash) {
+        lssdp->match_hash = hash;
+        lssdp->match_generation++;
+    }
+    return lssdp->match_generation;
+}
+
+static uint32_t get_hash(const char * string) {
+    return get_prefix_hash(string, (size_t) -1);
+}
+
+static uint32_t get_prefix_hash(const char * string, size_t len) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    size_t i;
+    for (i = 0; i < len && string[i] != '\0'; i++) {
+        hash = hash_update(hash, string[i]);
+    }
+    return hash;
+}
+
+static uint32_t hash_update(uint32_t hash, char c) {
+    return (hash ^ (unsigned char) c) * 16777619u;
+}
+
+static uint64_t get_datagram_hash(const char * buffer, size_t buffer_len, const struct sockaddr * address) {
+    // FNV-1a (64 bits) of datagram and source IP
+    uint64_t hash = 14695981039346656037ull;
+    size_t i;
+    for (i = 0; i < buffer_len; i++) {
+        hash = (hash ^ (unsigned char) buffer[i]) * 1099511628211ull;
+    }
+
+    const uint8_t * ip = NULL;
+    size_t ip_len = 0;
+    if (address->sa_family == AF_INET) {
+        ip     = (const uint8_t *) &((const struct sockaddr_in *) address)->sin_addr;
+        ip_len = sizeof(struct in_addr);
+    } else if (address->sa_family == AF_INET6) {
+        ip     = (const uint8_t *) &((const struct sockaddr_in6 *) address)->sin6_addr;
+        ip_len = sizeof(struct in6_addr);
+    }
+    for (i = 0; i < ip_len; i++) {
+        hash = (hash ^ ip[i]) * 1099511628211ull;
+    }
+
+    // 0 is reserved for none
+    return hash != 0 ? hash : 1;
+}
+
+static int lssdp_packet_parser(lssdp_ctx * lssdp, const char * data, size_t data_len, lssdp_packet * packet) {
+    if (data == NULL) {
+        lssdp_error("data should not be NULL\n");
+        return -1;
+    }
+
+    // data is not necessary to be null-terminated, but should not contain null character
+    if (memchr(data, '\0', data_len) != NULL) {
+        lssdp_error("data_len (%zu) is not match to the data length (%zu)\n", data_len, strlen(data));
+        return -1;
+    }
+
+    if (packet == NULL || packet->header == NULL) {
+        lssdp_error("packet and packet header should not be NULL\n");
+        return -1;
+    }
+
+    // the field which is not found is empty
+    packet->st = packet->usn = packet->location = packet->nts = packet->sm_id = packet->device_type = "";
+    packet->header_len = 0;
+
+    // 1. compare SSDP Method Header: M-SEARCH, NOTIFY, RESPONSE
+    size_t i;
+    if ((i = strlen(Global.HEADER_MSEARCH)) < data_len && memcmp(data, Global.HEADER_MSEARCH, i) == 0) {
+        strcpy(packet->method, Global.MSEARCH);
+    } else if ((i = strlen(Global.HEADER_NOTIFY)) < data_len && memcmp(data, Global.HEADER_NOTIFY, i) == 0) {
+        strcpy(packet->method, Global.NOTIFY);
+    } else if ((i = strlen(Global.HEADER_RESPONSE)) < data_len && memcmp(data, Global.HEADER_RESPONSE, i) == 0) {
+        strcpy(packet->method, Global.RESPONSE);
+    } else {
+        lssdp_warn("received unknown SSDP packet\n");
+        lssdp_debug("%.*s\n", (int) data_len, data);
+        return -1;
+    }
+
+    // 2. parse each field line "field:value\r\n" (bare '\n' is a part of line), until the empty line
+    size_t start = i, search = i;
+    while (search < data_len) {
+        const char * lf = (const char *) memchr(&data[search], '\n', data_len - search);
+        if (lf == NULL) {
+            break;
+        }
+
+        size_t end = lf - data;
+        search = end + 1;
+        if (end == start || data[end - 1] != '\r') {
+            continue;
+        }
+
+        if (end - 1 == start) {
+            // empty line: end of header
+            break;
+        }
+
+        parse_field_line(lssdp, data, start, end - 2, packet);
+        start = search;
+    }
+
+    return 0;
+}
+
+static int parse_field_line(lssdp_ctx * lssdp, const char * data, size_t start, size_t end, lssdp_packet * packet) {
+    // 1. find the colon in line [start, end]
+    if (data[start] == ':') {
+        lssdp_warn("the first character of line should not be colon\n");
+        lssdp_debug("%.*s\n", (int) (end - start + 1), &data[start]);
+        return -1;
+    }
+
+    const char * colon_char = (const char *) memchr(&data[start + 1], ':', end - start);
+    if (colon_char == NULL) {
+        lssdp_warn("there is no colon in line\n");
+        lssdp_debug("%.*s\n", (int) (end - start + 1), &data[start]);
+        return -1;
+    }
+    size_t colon = colon_char - data;
+
+
+    // 2. get field, field_len
+    size_t i = start;
+    size_t j = colon - 1;
+    if (trim_spaces(data, &i, &j) == -1) {
+        return -1;
+    }
+    const char * field = &data[i];
+    size_t field_len = j - i + 1;
+
+
+    // 3. get value, value_len (value may be empty, e.g. "EXT:")
+    i = colon + 1;
+    j = end;
+    const char * value = "";
+    size_t value_len = 0;
+    if (colon < end && trim_spaces(data, &i, &j) == 0) {
+        value = &data[i];
+        value_len = j - i + 1;
+    }
+
+
+    // 4. append "field\0value\0" to packet header (not longer than the line "field:value\r\n")
+    char * header = &packet->header[packet->header_len];
+    memcpy(header, field, field_len);
+    header[field_len] = '\0';
+    memcpy(&header[field_len + 1], value, value_len);
+    header[field_len + 1 + value_len] = '\0';
+    packet->header_len += field_len + value_len + 2;
+    value = &header[field_len + 1];
+
+
+    // 5. set each field's value to packet (dispatch by field length, the other fields are only kept in packet header)
+    switch (field_len) {
+        case 2:
+            if (strncasecmp(field, "st", 2) == 0 || strncasecmp(field, "nt", 2) == 0) {
+                packet->st = value;
+            }
+            break;
+        case 3:
+            if (strncasecmp(field, "nts", 3) == 0) {
+                packet->nts = value;
+            } else if (strncasecmp(field, "usn", 3) == 0) {
+                packet->usn = value;
+            }
+            break;
+        case 5:
+            if (strncasecmp(field, "sm_id", 5) == 0) {
+                packet->sm_id = value;
+            }
+            break;
+        case 8:
+            if (strncasecmp(field, "location", 8) == 0) {
+                packet->location = value;
+            } else if (strncasecmp(field, "dev_type", 8) == 0) {
+                packet->device_type = value;
+            }
+            break;
+    }
+    return 0;
+}
+
+static void packet_header_link(lssdp_packet * packet) {
+    const char * st = header_find(packet->header, packet->header_len, "st");
+    if (st == NULL) {
+        st = header_find(packet->header, packet->header_len, "nt");
+    }
+
+    const char * value;
+    packet->st          = st != NULL ? st : "";
+    packet->usn         = (value = header_find(packet->header, packet->header_len, "usn"))      != NULL ? value : "";
+    packet->location    = (value = header_find(packet->header, packet->header_len, "location")) != NULL ? value : "";
+    packet->nts         = (value = header_find(packet->header, packet->header_len, "nts"))      != NULL ? value : "";
+    packet->sm_id       = (value = header_find(packet->header, packet->header_len, "sm_id"))    != NULL ? value : "";
+    packet->device_type = (value = header_find(packet->header, packet->header_len, "dev_type")) != NULL ? value : "";
+}
+
+static const char * header_find(const char * header, size_t header_len, const char * name) {
+    // header: "NAME\0VALUE\0NAME\0VALUE\0..."
+    const char * end = header + header_len;
+    while (header < end) {
+        const char * value = header + strnlen(header, end - header) + 1;
+        if (value >= end) {
+            break;
+        }
+
+        size_t value_len = strnlen(value, end - value);
+        if (strcasecmp(header, name) == 0) {
+            return value;
+        }
+        header = value + value_len + 1;
+    }
+    return NULL;
+}
+
+static int trim_spaces(const char * string, size_t * start, size_t * end) {
+    // [start, end] should not be empty (start <= end)
+    size_t i = *start;
+    size_t j = *end;
+
+    while (i <= j && is_trim_char(string[i])) i++;
+    if (i > j) {
+        return -1;
+    }
+    while (j > i && is_trim_char(string[j])) j--;
+
+    *start = i;
+    *end   = j;
+    return 0;
+}
+
+static bool is_trim_char(char c) {
+    // not printable or space in "C" locale (!isprint || isspace), independent of locale and sign of char
+    return (unsigned char) c <= ' ' || (unsigned char) c >= 0x7F;
+}
+
+static long long get_current_time_ns() {
+    // same clock as kernel receive timestamp (SO_TIMESTAMPNS)
+    struct timespec time = {};
+    if (clock_gettime(CLOCK_REALTIME, &time) != 0) {
+        return 0;
+    }
+    return (long long) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static long long receive_control_parse(lssdp_ctx * lssdp, struct msghdr * message, size_t sock_index) {
+    // return kernel receive timestamp (ns, 0: not found), and count the dropped packets
+    long long recv_ns = 0;
+    struct cmsghdr * cmsg;
+    for (cmsg = CMSG_FIRSTHDR(message); cmsg != NULL; cmsg = CMSG_NXTHDR(message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+
+#ifdef SCM_TIMESTAMPNS
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec time;
+            memcpy(&time, CMSG_DATA(cmsg), sizeof(time));
+            recv_ns = (long long) time.tv_sec * 1000000000 + time.tv_nsec;
+        }
+#endif
+
+#ifdef SO_RXQ_OVFL
+        // drop counter of socket (wraps around), it is attached when it is not 0
+        if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t counter;
+            memcpy(&counter, CMSG_DATA(cmsg), sizeof(counter));
+            uint32_t drop_num = counter - lssdp->stats.drop_counter[sock_index];
+            if (drop_num > 0) {
+                lssdp->stats.packet_drop_num += drop_num;
+                lssdp->stats.drop_counter[sock_index] = counter;
+                if (lssdp->debug) {
+                    lssdp_info("RECV <- %u packets are dropped by kernel, receive buffer is full\n", drop_num);
+                }
+            }
+        }
+#endif
+    }
+
+    if (message->msg_flags & MSG_CTRUNC) {
+        lssdp_warn("ancillary data of recvmsg is truncated\n");
+    }
+    return recv_ns;
+}
+
+static int socket_buffer_set(lssdp_ctx * lssdp, int fd, int force_option, int option, int size) {
+    // size = 0: system default
+    if (size <= 0) {
+        return 0;
+    }
+
+    // force option is not permitted: capped by rmem_max / wmem_max
+    if (setsockopt(fd, SOL_SOCKET, force_option, &size, sizeof(size)) != 0
+        && setsockopt(fd, SOL_SOCKET, option, &size, sizeof(size)) != 0) {
+        lssdp_warn("setsockopt %s %d failed, errno = %s (%d)\n", option == SO_RCVBUF ? "SO_RCVBUF" : "SO_SNDBUF", size, strerror(errno), errno);
+        return -1;
+    }
+
+    // receive buffer is capped by rmem_max
+    int actual_size = 0;
+    socklen_t len = sizeof(actual_size);
+    if (option != SO_RCVBUF || getsockopt(fd, SOL_SOCKET, option, &actual_size, &len) != 0) {
+        return 0;
+    }
+
+#ifdef __linux__
+    // Linux doubles the set size for bookkeeping overhead, getsockopt returns the doubled one
+    actual_size /= 2;
+#endif
+    if (actual_size < size) {
+        lssdp_warn("SO_RCVBUF of socket %d is %d (request %d), it is capped by system limit\n", fd, actual_size, size);
+    }
+    return 0;
+}
+
+static void latency_add(lssdp_ctx * lssdp, int stage, long long latency_ns) {
+#if LSSDP_LATENCY_TRACE
+    // clock may be adjusted between the stages
+    latency_ns = latency_ns > 0 ? latency_ns : 0;
+
+    // bucket n: [2^n, 2^(n+1)) ns, the last one is unbounded
+    size_t bucket = latency_ns < 2 ? 0 : 63 - __builtin_clzll((unsigned long long) latency_ns);
+    bucket = bucket < LSSDP_LATENCY_BUCKET_NUM ? bucket : LSSDP_LATENCY_BUCKET_NUM - 1;
+
+    struct lssdp_latency * latency = &lssdp->stats.latency[stage];
+    latency->num++;
+    latency->sum += latency_ns;
+    latency->max  = latency_ns > latency->max ? latency_ns : latency->max;
+    latency->bucket[bucket]++;
+#else
+    // latency trace is compiled out
+    (void) lssdp;
+    (void) stage;
+    (void) latency_ns;
+#endif
+}
+
+static long long latency_record(lssdp_ctx * lssdp, int stage, long long start_ns) {
+    // start_ns = 0: not traced
+    if (start_ns <= 0) {
+        return 0;
+    }
+
+    long long current_ns = get_current_time_ns();
+    latency_add(lssdp, stage, current_ns - start_ns);
+    return current_ns;
+}
+
+static long long get_current_time() {
+    lssdp_ctx * lssdp = NULL;   // no context: default log callback
+
+    struct timeval time = {};
+    if (gettimeofday(&time, NULL) == -1) {
+        lssdp_error("gettimeofday failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    return (long long) time.tv_sec * 1000 + (long long) time.tv_usec / 1000;
+}
+
+static int lssdp_log(lssdp_ctx * lssdp, int level, int line, const char * func, const char * format, ...) {
+    // log callback of context, or the default one (lssdp_set_log_callback)
+    if ((lssdp == NULL || lssdp->log_callback == NULL) && Global.log_callback == NULL) {
+        return -1;
+    }
+
+#if LSSDP_LOG_FORMAT
+    char message[LSSDP_BUFFER_LEN] = {};
+
+    // create message by va_list
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, LSSDP_BUFFER_LEN, format, args);
+    va_end(args);
+#else
+    const char * message = format;  // not formatted
+#endif
+
+    // invoke log callback function
+    if (lssdp != NULL && lssdp->log_callback != NULL) {
+        lssdp->log_callback(lssdp, __FILE__, "SSDP", level, line, func, message);
+    } else {
+        Global.log_callback(__FILE__, "SSDP", level, line, func, message);
+    }
+    return 0;
+}
+
+static bool allocator_is_set(const lssdp_ctx * lssdp) {
+    // all hooks or libc, a partial set is never mixed with libc
+    return lssdp->allocator.malloc != NULL && lssdp->allocator.realloc != NULL && lssdp->allocator.free != NULL;
+}
+
+static void * lssdp_malloc(lssdp_ctx * lssdp, size_t size) {
+    return allocator_is_set(lssdp) ? lssdp->allocator.malloc(lssdp->allocator.opaque, size) : malloc(size);
+}
+
+static void * lssdp_calloc(lssdp_ctx * lssdp, size_t num, size_t size) {
+    if (allocator_is_set(lssdp) == false) {
+        return calloc(num, size);
+    }
+
+    if (size > 0 && num > (size_t) -1 / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void * ptr = lssdp->allocator.malloc(lssdp->allocator.opaque, num * size);
+    if (ptr != NULL) {
+        memset(ptr, 0, num * size);
+    }
+    return ptr;
+}
+
+static void * lssdp_realloc(lssdp_ctx * lssdp, void * ptr, size_t size) {
+    return allocator_is_set(lssdp) ? lssdp->allocator.realloc(lssdp->allocator.opaque, ptr, size) : realloc(ptr, size);
+}
+
+static void lssdp_free(lssdp_ctx * lssdp, void * ptr) {
+    if (allocator_is_set(lssdp)) {
+        lssdp->allocator.free(lssdp->allocator.opaque, ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+static int neighbor_list_add(lssdp_ctx * lssdp, const lssdp_packet packet, lssdp_subscription * subscription) {
+    bool is_changed = false;
+    lssdp_nbr * nbr = neighbor_find(lssdp, &packet);
+    if (nbr != NULL) {
+        /* identity key is found in SSDP list: update neighbor in place */
+
+        // usn
+        bool is_usn_changed = strcmp(nbr->usn, packet.usn) != 0;
+        if (is_usn_changed) {
+            lssdp_debug("neighbor usn is changed. (%s -> %s)\n", nbr->usn, packet.usn);
+            is_changed = true;
+        }
+
+        // location (neighbor is moved, when it is not identified by location)
+        bool is_location_changed = strcmp(nbr->location, packet.location) != 0;
+        if (is_location_changed) {
+            lssdp_debug("neighbor location is changed. (%s -> %s)\n", nbr->location, packet.location);
+            is_changed = true;
+        }
+
+        // source ip, interface
+        bool is_source_changed = strcmp(nbr->ip, packet.ip) != 0 || strcmp(nbr->interface, packet.interface) != 0;
+        if (is_source_changed) {
+            lssdp_debug("neighbor source is changed. (%s %s -> %s %s)\n", nbr->ip, nbr->interface, packet.ip, packet.interface);
+            is_changed = true;
+        }
+
+        // sm_id
+        bool is_sm_id_changed = strcmp(nbr->sm_id, packet.sm_id) != 0;
+        if (is_sm_id_changed) {
+            lssdp_debug("neighbor sm_id is changed. (%s -> %s)\n", nbr->sm_id, packet.sm_id);
+            is_changed = true;
+        }
+
+        // device type
+        bool is_device_type_changed = strcmp(nbr->device_type, packet.device_type) != 0;
+        if (is_device_type_changed) {
+            lssdp_debug("neighbor device_type is changed. (%s -> %s)\n", nbr->device_type, packet.device_type);
+            is_changed = true;
+        }
+
+        // datagram hash is re-indexed together
+        bool is_reindex = is_usn_changed || is_location_changed || is_source_changed || is_sm_id_changed || is_device_type_changed
+                       || nbr->datagram_hash != packet.datagram_hash;
+        if (is_reindex) {
+            neighbor_index_remove(nbr);
+        }
+
+        // search target
+        if (strcmp(nbr->st, packet.st) != 0) {
+            lssdp_debug("neighbor st is changed. (%s -> %s)\n", nbr->st, packet.st);
+            is_changed = true;
+        }
+
+        // header fields (the fields above are updated together, the other fields are updated silently)
+        bool is_header_changed = nbr->header_len != packet.header_len || memcmp(nbr->header, packet.header, packet.header_len) != 0;
+        bool is_header_set = true;
+        if (is_header_changed) {
+            size_t header_len = nbr->header_len;
+            is_header_set = neighbor_set_header(lssdp, nbr, &packet) == 0;
+            if (is_header_set) {
+                lssdp->neighbor_memory = lssdp->neighbor_memory - header_len + nbr->header_len;
+            }
+        }
+
+        // the datagram is not kept if its header is not copied, the same datagram takes the full path again (no fast path)
+        uint64_t datagram_hash = is_header_set ? packet.datagram_hash : 0;
+        if (is_reindex == false && nbr->datagram_hash != datagram_hash) {
+            neighbor_index_remove(nbr);
+            is_reindex = true;
+        }
+
+        nbr->family = packet.family;
+        memcpy(nbr->ip,        packet.ip,        LSSDP_IP_LEN);
+        memcpy(nbr->interface, packet.interface, LSSDP_INTERFACE_NAME_LEN);
+        nbr->datagram_hash = datagram_hash;
+        nbr->datagram_len  = packet.datagram_len;
+        if (is_reindex) {
+            neighbor_index_add(lssdp, nbr);
+        }
+
+        // subscription
+        nbr->match_generation = match_generation_update(lssdp);
+        if (nbr->subscription != subscription) {
+            neighbor_subscription_unlink(nbr);
+            neighbor_subscription_link(nbr, subscription);
+            is_changed = true;
+        }
+
+        // update_time
+        nbr->update_time = packet.update_time;
+        neighbor_age_touch(lssdp, nbr);
+
+        // the grown header is over memory budget: free unused descriptions, then evict the other neighbors
+        fetch_cache_trim(lssdp, 0);
+        while (lssdp->neighbor_memory_max > 0 && lssdp->neighbor_memory > lssdp->neighbor_memory_max
+            && lssdp->neighbor_eviction != LSSDP_NBR_EVICT_REJECT && lssdp->neighbor_age_list != nbr) {
+            neighbor_evict(lssdp, lssdp->neighbor_age_list);
+            is_changed = true;
+        }
+
+        // description: fetch again when the description key is changed
+        if (lssdp->fetch.enable && (is_header_changed || nbr->description_status == LSSDP_FETCH_NONE)) {
+            fetch_neighbor_update(lssdp, nbr);
+        }
+        lssdp_probe(neighbor_update, nbr->usn, nbr->location, nbr->ip, is_changed);
+        goto end;
+    }
+
+
+    /* identity key is not found in SSDP list: add to list */
+
+    // 0. neighbor table is full: evict neighbors, or reject the new one
+    if (neighbor_list_evict(lssdp, &packet) != 0) {
+        return -1;
+    }
+
+    // 1. memory allocate lssdp_nbr
+    nbr = (lssdp_nbr *) lssdp_calloc(lssdp, 1, sizeof(lssdp_nbr));
+    if (nbr == NULL) {
+        lssdp_error("calloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    // 2. setup neighbor
+    if (neighbor_set_header(lssdp, nbr, &packet) != 0) {
+        lssdp_free(lssdp, nbr);
+        return -1;
+    }
+    memcpy(nbr->ip,          packet.ip,          LSSDP_IP_LEN);
+    memcpy(nbr->interface,   packet.interface,   LSSDP_INTERFACE_NAME_LEN);
+    nbr->family        = packet.family;
+    nbr->update_time   = packet.update_time;
+    nbr->datagram_hash = packet.datagram_hash;
+    nbr->datagram_len  = packet.datagram_len;
+    nbr->match_generation = match_generation_update(lssdp);
+    neighbor_subscription_link(nbr, subscription);
+
+    // 3. add neighbor to the end of list
+    nbr->prev = lssdp->neighbor_last;
+    if (lssdp->neighbor_last == NULL) {
+        // it's the first neighbor
+        lssdp->neighbor_list = nbr;
+    } else {
+        lssdp->neighbor_last->next = nbr;
+    }
+    lssdp->neighbor_last = nbr;
+    lssdp->neighbor_num++;
+
+    // 4. add neighbor to index and age list
+    neighbor_index_add(lssdp, nbr);
+    neighbor_age_touch(lssdp, nbr);
+    lssdp->neighbor_memory += sizeof(lssdp_nbr) + nbr->header_len;
+    lssdp_probe(neighbor_add, nbr->usn, nbr->location, nbr->ip);
+
+    // 5. description: cached, or queued for fetch
+    if (lssdp->fetch.enable) {
+        fetch_neighbor_update(lssdp, nbr);
+    }
+
+    is_changed = true;
+end:
+    // publish to shared memory table, only update_time is refreshed when nothing is changed
+    if (is_changed) {
+        shm_publish(lssdp, nbr);
+    } else {
+        shm_refresh(lssdp, nbr);
+    }
+
+    // latency trace: neighbor list update is done
+    long long update_ns = latency_record(lssdp, LSSDP_LATENCY_UPDATE, packet.stage_ns);
+
+    // invoke neighbor list changed callback
+    if (lssdp->neighbor_list_changed_callback != NULL && is_changed == true) {
+        if (update_ns > 0 && packet.recv_ns > 0) {
+            latency_add(lssdp, LSSDP_LATENCY_TOTAL, update_ns - packet.recv_ns);
+        }
+        lssdp->neighbor_list_changed_callback(lssdp);
+        latency_record(lssdp, LSSDP_LATENCY_CALLBACK, update_ns);
+    }
+
+    return 0;
+}
+
+static lssdp_nbr * neighbor_find(lssdp_ctx * lssdp, const lssdp_packet * packet) {
+    // lookup identity key index
+    struct lssdp_nbr_index * index = &lssdp->neighbor_index[LSSDP_NBR_INDEX_KEY];
+    if (index->size == 0) {
+        return NULL;
+    }
+
+    lssdp_nbr view;
+    neighbor_packet_view(packet, &view);
+    uint32_t hash = neighbor_key_hash(lssdp, &view);
+
+    lssdp_nbr * nbr;
+    for (nbr = index->table[hash % index->size]; nbr != NULL; nbr = nbr->index_next[LSSDP_NBR_INDEX_KEY]) {
+        if (nbr->index_hash[LSSDP_NBR_INDEX_KEY] == hash && neighbor_key_equal(lssdp, nbr, &view)) {
+            return nbr;
+        }
+    }
+    return NULL;
+}
+
+static lssdp_nbr * neighbor_find_datagram(lssdp_ctx * lssdp, uint64_t datagram_hash, size_t datagram_len) {
+    // lookup datagram index
+    struct lssdp_nbr_index * index = &lssdp->neighbor_index[LSSDP_NBR_INDEX_DATAGRAM];
+    if (index->size == 0) {
+        return NULL;
+    }
+
+    lssdp_nbr * nbr;
+    for (nbr = index->table[(uint32_t) datagram_hash % index->size]; nbr != NULL; nbr = nbr->index_next[LSSDP_NBR_INDEX_DATAGRAM]) {
+        if (nbr->datagram_hash == datagram_hash && nbr->datagram_len == datagram_len) {
+            return nbr;
+        }
+    }
+    return NULL;
+}
+
+static void neighbor_packet_view(const lssdp_packet * packet, lssdp_nbr * view) {
+    // the packet is viewed as a neighbor (not in list)
+    *view = (lssdp_nbr) {
+        .usn         = packet->usn,
+        .location    = packet->location,
+        .st          = packet->st,
+        .sm_id       = packet->sm_id,
+        .device_type = packet->device_type,
+        .update_time = packet->update_time,
+        .header      = packet->header,
+        .header_len  = packet->header_len,
+        .family      = packet->family
+    };
+    memcpy(view->ip,        packet->ip,        LSSDP_IP_LEN);
+    memcpy(view->interface, packet->interface, LSSDP_INTERFACE_NAME_LEN);
+}
+
+static uint32_t neighbor_key_hash(lssdp_ctx * lssdp, const lssdp_nbr * nbr) {
+    char key[LSSDP_NBR_KEY_LEN];
+    switch (lssdp->neighbor_key) {
+        case LSSDP_NBR_KEY_USN:
+            return get_hash(nbr->usn);
+
+        case LSSDP_NBR_KEY_USN_ST: {
+            // "usn\r\nst", CRLF is not in header value
+            uint32_t hash = hash_update(hash_update(get_hash(nbr->usn), '\r'), '\n');
+            const char * c;
+            for (c = nbr->st; *c != '\0'; c++) {
+                hash = hash_update(hash, *c);
+            }
+            return hash;
+        }
+
+        case LSSDP_NBR_KEY_CUSTOM:
+            return get_hash(neighbor_custom_key(lssdp, nbr, key));
+
+        default:
+            return get_hash(nbr->location);
+    }
+}
+
+static bool neighbor_key_equal(lssdp_ctx * lssdp, const lssdp_nbr * a, const lssdp_nbr * b) {
+    char key_a[LSSDP_NBR_KEY_LEN], key_b[LSSDP_NBR_KEY_LEN];
+    switch (lssdp->neighbor_key) {
+        case LSSDP_NBR_KEY_USN:
+            return strcmp(a->usn, b->usn) == 0;
+
+        case LSSDP_NBR_KEY_USN_ST:
+            return strcmp(a->usn, b->usn) == 0 && strcmp(a->st, b->st) == 0;
+
+        case LSSDP_NBR_KEY_CUSTOM:
+            return strcmp(neighbor_custom_key(lssdp, a, key_a), neighbor_custom_key(lssdp, b, key_b)) == 0;
+
+        default:
+            return strcmp(a->location, b->location) == 0;
+    }
+}
+
+static const char * neighbor_custom_key(lssdp_ctx * lssdp, const lssdp_nbr * nbr, char * key) {
+    // key is location if callback is not set or failed
+    key[0] = '\0';
+    if (lssdp->neighbor_key_callback == NULL || lssdp->neighbor_key_callback(lssdp, nbr, key, LSSDP_NBR_KEY_LEN) < 0) {
+        return nbr->location;
+    }
+    key[LSSDP_NBR_KEY_LEN - 1] = '\0';
+    return key;
+}
+
+static int neighbor_list_remove_usn(lssdp_ctx * lssdp, const char * usn) {
+    int remove_num = 0;
+
+    // lookup usn index
+    struct lssdp_nbr_index * index = &lssdp->neighbor_index[LSSDP_NBR_INDEX_USN];
+    if (index->size == 0) {
+        return 0;
+    }
+
+    lssdp_nbr * nbr = index->table[get_hash(usn) % index->size];
+    while (nbr != NULL) {
+        lssdp_nbr * next = nbr->index_next[LSSDP_NBR_INDEX_USN];
+        if (strcmp(nbr->usn, usn) == 0) {
+            lssdp_info("remove byebye SSDP neighbor: %s (%s)\n", nbr->usn, nbr->location);
+            neighbor_list_remove(lssdp, nbr);
+            remove_num++;
+        }
+        nbr = next;
+    }
+
+    // invoke neighbor list changed callback
+    if (remove_num > 0 && lssdp->neighbor_list_changed_callback != NULL) {
+        lssdp->neighbor_list_changed_callback(lssdp);
+    }
+    return remove_num;
+}
+
+static void neighbor_list_remove(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    // 1. remove from index, subscription and description fetcher
+    neighbor_index_remove(nbr);
+    neighbor_subscription_unlink(nbr);
+    fetch_neighbor_release(lssdp, nbr);
+
+    // 2. remove from list
+    if (nbr->prev == NULL) {
+        // it's first neighbor in list
+        lssdp->neighbor_list = nbr->next;
+    } else {
+        nbr->prev->next = nbr->next;
+    }
+
+    if (nbr->next == NULL) {
+        // it's last neighbor in list
+        lssdp->neighbor_last = nbr->prev;
+    } else {
+        nbr->next->prev = nbr->prev;
+    }
+
+    lssdp->neighbor_num--;
+    lssdp->neighbor_memory -= sizeof(lssdp_nbr) + nbr->header_len;
+    neighbor_age_unlink(lssdp, nbr);
+
+    // 3. remove from shared memory table, the free slot is taken by a waiting neighbor (table was full)
+    shm_unpublish(lssdp, nbr);
+    lssdp_free(lssdp, nbr->header);
+    lssdp_free(lssdp, nbr);
+}
+
+static int neighbor_list_remove_interface(lssdp_ctx * lssdp) {
+    size_t remove_num = 0;
+    lssdp_nbr * nbr = lssdp->neighbor_list;
+    while (nbr != NULL) {
+        lssdp_nbr * next = nbr->next;
+
+        // the interface of neighbor still exists (empty: interface is unknown)
+        bool is_found = strlen(nbr->interface) == 0;
+        size_t i;
+        for (i = 0; i < lssdp->interface_num && is_found == false; i++) {
+            is_found = lssdp->interface[i].family == nbr->family && strcmp(lssdp->interface[i].name, nbr->interface) == 0;
+        }
+
+        if (is_found == false) {
+            if (lssdp->debug) {
+                lssdp_info("remove neighbor %s, interface %s is removed\n", nbr->location, nbr->interface);
+            }
+            neighbor_list_remove(lssdp, nbr);
+            remove_num++;
+        }
+        nbr = next;
+    }
+
+    // invoke neighbor list changed callback
+    if (lssdp->neighbor_list_changed_callback != NULL && remove_num > 0) {
+        lssdp->neighbor_list_changed_callback(lssdp);
+    }
+
+    return remove_num;
+}
+
+static int lssdp_neighbor_remove_all(lssdp_ctx * lssdp) {
+    // free neighbor index
+    size_t i;
+    for (i = 0; i < LSSDP_NBR_INDEX_NUM; i++) {
+        lssdp_free(lssdp, lssdp->neighbor_index[i].table);
+        lssdp->neighbor_index[i].table = NULL;
+        lssdp->neighbor_index[i].size  = 0;
+    }
+
+    if (lssdp->neighbor_list == NULL) {
+        return 0;
+    }
+
+    // free neighbor_list
+    shm_clear(lssdp);
+    neighbor_list_free(lssdp, lssdp->neighbor_list);
+    lssdp->neighbor_list            = NULL;
+    lssdp->neighbor_last            = NULL;
+    lssdp->neighbor_num             = 0;
+    lssdp->neighbor_age_list        = NULL;
+    lssdp->neighbor_age_last        = NULL;
+    lssdp->neighbor_probe_next      = NULL;
+    lssdp->neighbor_probe_wait      = NULL;
+    lssdp->neighbor_probe_wait_tail = NULL;
+    lssdp->neighbor_memory          = lssdp->fetch.fetcher != NULL ? lssdp->fetch.fetcher->cache_memory : 0;    // description cache is kept
+
+    // clean up neighbors of each subscription
+    lssdp_subscription * subscription;
+    for (subscription = lssdp->subscription_list; subscription != NULL; subscription = subscription->next) {
+        subscription->neighbor_num  = 0;
+        subscription->neighbor_list = NULL;
+    }
+
+    lssdp_info("neighbor list has been force clean up.\n");
+
+    // invoke neighbor list changed callback
+    if (lssdp->neighbor_list_changed_callback != NULL) {
+        lssdp->neighbor_list_changed_callback(lssdp);
+    }
+    return 0;
+}
+
+static int neighbor_set_header(lssdp_ctx * lssdp, lssdp_nbr * nbr, const lssdp_packet * packet) {
+    // the original header is kept if failed
+    char * header = (char *) lssdp_realloc(lssdp, nbr->header, packet->header_len > 0 ? packet->header_len : 1);
+    if (header == NULL) {
+        lssdp_error("realloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    memcpy(header, packet->header, packet->header_len);
+
+    // the fields point to the same offset of the copied header
+    const char ** fields[] = {&nbr->usn, &nbr->location, &nbr->st, &nbr->sm_id, &nbr->device_type};
+    const char *  values[] = {packet->usn, packet->location, packet->st, packet->sm_id, packet->device_type};
+    size_t i;
+    for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        bool is_in_header = values[i] >= packet->header && values[i] < packet->header + packet->header_len;
+        *fields[i] = is_in_header ? header + (values[i] - packet->header) : "";
+    }
+
+    nbr->header     = header;
+    nbr->header_len = packet->header_len;
+    return 0;
+}
+
+static int neighbor_list_evict(lssdp_ctx * lssdp, const lssdp_packet * packet) {
+    bool is_evict = lssdp->neighbor_eviction != LSSDP_NBR_EVICT_REJECT;
+    size_t memory = sizeof(lssdp_nbr) + packet->header_len;
+    if (lssdp->neighbor_memory_max > 0 && memory > lssdp->neighbor_memory_max) {
+        goto reject;
+    }
+
+    // 1. per-source quota: the oldest neighbor of the source (lookup source index, at most neighbor_source_max)
+    if (lssdp->neighbor_source_max > 0 && lssdp->neighbor_index[LSSDP_NBR_INDEX_SOURCE].size > 0) {
+        struct lssdp_nbr_index * index = &lssdp->neighbor_index[LSSDP_NBR_INDEX_SOURCE];
+        size_t source_num = 0;
+        lssdp_nbr * nbr, * oldest = NULL;
+        for (nbr = index->table[get_hash(packet->ip) % index->size]; nbr != NULL; nbr = nbr->index_next[LSSDP_NBR_INDEX_SOURCE]) {
+            if (strcmp(nbr->ip, packet->ip) == 0) {
+                source_num++;
+                oldest = oldest == NULL || nbr->update_time < oldest->update_time ? nbr : oldest;
+            }
+        }
+
+        if (source_num >= lssdp->neighbor_source_max) {
+            if (is_evict == false) {
+                goto reject;
+            }
+            neighbor_evict(lssdp, oldest);
+        }
+    }
+
+    // 2. neighbor number and memory budget: unused descriptions, then the head of age list
+    fetch_cache_trim(lssdp, memory);
+    while ((lssdp->neighbor_max > 0 && lssdp->neighbor_num >= lssdp->neighbor_max)
+        || (lssdp->neighbor_memory_max > 0 && lssdp->neighbor_memory + memory > lssdp->neighbor_memory_max)) {
+        if (is_evict == false || lssdp->neighbor_age_list == NULL) {
+            goto reject;
+        }
+        neighbor_evict(lssdp, lssdp->neighbor_age_list);
+    }
+    return 0;
+
+reject:
+    lssdp->neighbor_reject_num++;
+    if (lssdp->debug) {
+        lssdp_info("neighbor table is full, reject neighbor %s (%s)\n", packet->location, packet->ip);
+    }
+    return -1;
+}
+
+static void neighbor_evict(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    if (lssdp->debug) {
+        lssdp_info("neighbor table is full, evict neighbor %s (%s)\n", nbr->location, nbr->ip);
+    }
+    lssdp->neighbor_evict_num++;
+    neighbor_list_remove(lssdp, nbr);
+}
+
+static void neighbor_age_touch(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    neighbor_age_unlink(lssdp, nbr);
+
+    // append to the end: O(1), the list is in update_time order (received timestamp is clamped to the newest one)
+    nbr->age_prev = lssdp->neighbor_age_last;
+    nbr->age_next = NULL;
+    if (lssdp->neighbor_age_last == NULL) {
+        lssdp->neighbor_age_list = nbr;
+    } else {
+        lssdp->neighbor_age_last->age_next = nbr;
+    }
+    lssdp->neighbor_age_last = nbr;
+
+    // updated neighbor is not probed yet
+    if (lssdp->neighbor_probe_next == NULL) {
+        lssdp->neighbor_probe_next = nbr;
+    }
+}
+
+static void neighbor_age_unlink(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    // updated or removed: stop waiting for probe RESPONSE
+    neighbor_probe_unlink(lssdp, nbr);
+    if (lssdp->neighbor_probe_next == nbr) {
+        lssdp->neighbor_probe_next = nbr->age_next;
+    }
+
+    if (nbr->age_prev != NULL) {
+        nbr->age_prev->age_next = nbr->age_next;
+    } else if (lssdp->neighbor_age_list == nbr) {
+        lssdp->neighbor_age_list = nbr->age_next;
+    }
+
+    if (nbr->age_next != NULL) {
+        nbr->age_next->age_prev = nbr->age_prev;
+    } else if (lssdp->neighbor_age_last == nbr) {
+        lssdp->neighbor_age_last = nbr->age_prev;
+    }
+
+    nbr->age_prev = NULL;
+    nbr->age_next = NULL;
+}
+
+static void neighbor_age_sort(lssdp_ctx * lssdp) {
+    // bottom-up merge sort by update_time (stable), O(n log n), e.g. the neighbors loaded from snapshot
+    lssdp_nbr * list = lssdp->neighbor_age_list;
+    size_t width, merge_num;
+    for (width = 1, merge_num = 2; merge_num > 1; width *= 2) {
+        lssdp_nbr * head = NULL, ** tail = &head;
+        lssdp_nbr * p = list;
+        merge_num = 0;
+        while (p != NULL) {
+            // merge two runs: p (p_len) and q (q_len)
+            lssdp_nbr * q = p;
+            size_t p_len = 0, q_len = width;
+            while (p_len < width && q != NULL) {
+                q = q->age_next;
+                p_len++;
+            }
+
+            while (p_len > 0 || (q_len > 0 && q != NULL)) {
+                lssdp_nbr * nbr;
+                if (p_len > 0 && (q_len == 0 || q == NULL || p->update_time <= q->update_time)) {
+                    nbr = p;
+                    p = p->age_next;
+                    p_len--;
+                } else {
+                    nbr = q;
+                    q = q->age_next;
+                    q_len--;
+                }
+                *tail = nbr;
+                tail  = &nbr->age_next;
+            }
+            p = q;
+            merge_num++;
+        }
+        *tail = NULL;
+        list  = head;
+    }
+
+    // relink age_prev
+    lssdp_nbr * prev = NULL, * nbr;
+    for (nbr = list; nbr != NULL; nbr = nbr->age_next) {
+        nbr->age_prev = prev;
+        prev = nbr;
+    }
+    lssdp->neighbor_age_list = list;
+    lssdp->neighbor_age_last = prev;
+
+    // probe from the oldest again, waiting neighbors are skipped
+    lssdp->neighbor_probe_next = list;
+}
+
+static void announce_reset(lssdp_ctx * lssdp, long long current_time) {
+    if (lssdp->announce.seed == 0) {
+        lssdp->announce.seed = (unsigned int) current_time ^ (unsigned int) getpid() ^ (unsigned int) (uintptr_t) lssdp;
+    }
+
+    long msearch_min = lssdp->announce.msearch_min > 0 ? lssdp->announce.msearch_min : LSSDP_ANNOUNCE_MSEARCH_MIN;
+    lssdp->announce.burst            = LSSDP_ANNOUNCE_BURST - 1;
+    lssdp->announce.msearch_interval = msearch_min;
+    lssdp->announce.neighbor_num     = (size_t) -1;
+    lssdp->announce.notify_time      = current_time + rand_r(&lssdp->announce.seed) % LSSDP_ANNOUNCE_DELAY;
+    lssdp->announce.msearch_time     = current_time + rand_r(&lssdp->announce.seed) % LSSDP_ANNOUNCE_DELAY;
+
+    if (lssdp->debug) {
+        lssdp_info("re-announce: NOTIFY x %d, M-SEARCH from %ld ms\n", LSSDP_ANNOUNCE_BURST, msearch_min);
+    }
+}
+
+static uint32_t announce_header_hash(lssdp_ctx * lssdp) {
+    const char * fields[] = {
+        lssdp->header.search_target,
+        lssdp->header.unique_service_name,
+        lssdp->header.location.prefix,
+        lssdp->header.location.domain,
+        lssdp->header.location.suffix,
+        lssdp->header.sm_id,
+        lssdp->header.device_type
+    };
+
+    // FNV-1a of header fields (null-terminated) and max-age, 0 is reserved for re-announce
+    uint32_t hash = 2166136261u;
+    size_t i, j;
+    for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        for (j = 0; j < LSSDP_FIELD_LEN && fields[i][j] != '\0'; j++) {
+            hash = hash_update(hash, fields[i][j]);
+        }
+        hash = hash_update(hash, '\0');
+    }
+
+    int max_age = get_max_age(lssdp);
+    for (i = 0; i < sizeof(max_age); i++) {
+        hash = hash_update(hash, ((const char *) &max_age)[i]);
+    }
+    return hash != 0 ? hash : 1;
+}
+
+static long announce_jitter(lssdp_ctx * lssdp, long interval) {
+    // subtract random jitter, the interval is never longer than expected
+    long jitter = interval * LSSDP_ANNOUNCE_JITTER / 100;
+    return interval - (jitter > 0 ? rand_r(&lssdp->announce.seed) % (jitter + 1) : 0);
+}
+
+static int neighbor_probe(lssdp_ctx * lssdp, lssdp_nbr * nbr, long long current_time, lssdp_batch * batch) {
+    // 1. the neighbors of the same source IP and ST are refreshed by the same RESPONSE, wait for it together
+    struct lssdp_nbr_index * index = &lssdp->neighbor_index[LSSDP_NBR_INDEX_SOURCE];
+    if (index->size > 0) {
+        lssdp_nbr * same = index->table[nbr->index_hash[LSSDP_NBR_INDEX_SOURCE] % index->size];
+        for (; same != NULL; same = same->index_next[LSSDP_NBR_INDEX_SOURCE]) {
+            if (same == nbr || strcmp(same->ip, nbr->ip) != 0 || strcmp(same->st, nbr->st) != 0) {
+                continue;
+            }
+
+            // approaching timeout too
+            if (same->update_time + lssdp->neighbor_timeout - current_time <= lssdp->neighbor_probe_time) {
+                same->probe_time = current_time;
+                neighbor_probe_wait(lssdp, same);
+            }
+        }
+    }
+    nbr->probe_time = current_time;
+    neighbor_probe_wait(lssdp, nbr);
+
+    // 2. set destination address: source IP of neighbor, SSDP port
+    int fd = nbr->family == AF_INET ? lssdp->sock : lssdp->sock6;
+    if (fd <= 0) {
+        lssdp_warn("SSDP socket has not been setup, no socket to send %s to %s\n", Global.MSEARCH, nbr->ip);
+        return -1;
+    }
+
+    // the batch is sent by one socket
+    if (batch->fd != fd && batch_flush(lssdp, batch) != 0) {
+        return -1;
+    }
+    batch->fd = fd;
+
+    struct sockaddr_storage * address = &batch->to[batch->num];
+    memset(address, 0, sizeof(struct sockaddr_storage));
+    char host[LSSDP_IP_LEN + 2] = {};
+    int ret;
+    if (nbr->family == AF_INET) {
+        struct sockaddr_in * address4 = (struct sockaddr_in *) address;
+        address4->sin_family = AF_INET;
+        address4->sin_port   = htons(lssdp->port);
+        ret = inet_pton(AF_INET, nbr->ip, &address4->sin_addr);
+        snprintf(host, sizeof(host), "%s", nbr->ip);
+    } else {
+        struct sockaddr_in6 * address6 = (struct sockaddr_in6 *) address;
+        address6->sin6_family = AF_INET6;
+        address6->sin6_port   = htons(lssdp->port);
+        ret = inet_pton(AF_INET6, nbr->ip, &address6->sin6_addr);
+        snprintf(host, sizeof(host), "[%s]", nbr->ip);
+
+        // scope id of link-local address
+        size_t i;
+        for (i = 0; i < lssdp->interface_num; i++) {
+            if (strcmp(lssdp->interface[i].name, nbr->interface) == 0) {
+                address6->sin6_scope_id = lssdp->interface[i].index;
+                break;
+            }
+        }
+    }
+
+    if (ret != 1) {
+        lssdp_error("invalid neighbor IP %s\n", nbr->ip);
+        return -1;
+    }
+
+    // 3. add unicast M-SEARCH of neighbor ST to batch
+    if (batch_add(lssdp, batch, set_msearch_packet(lssdp, host, nbr->st, batch->packet[batch->num])) != 0) {
+        return -1;
+    }
+
+    if (lssdp->debug) {
+        lssdp_info("SEND => %-8s   %s => %s (probe)\n", Global.MSEARCH, nbr->interface, nbr->ip);
+    }
+    return 0;
+}
+
+static void neighbor_probe_wait(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    neighbor_probe_unlink(lssdp, nbr);
+
+    // append to the end: O(1), the wait list is in probe_time order
+    if (lssdp->neighbor_probe_wait_tail == NULL) {
+        lssdp->neighbor_probe_wait_tail = &lssdp->neighbor_probe_wait;
+    }
+    nbr->probe_next  = NULL;
+    nbr->probe_pprev = lssdp->neighbor_probe_wait_tail;
+    *lssdp->neighbor_probe_wait_tail = nbr;
+    lssdp->neighbor_probe_wait_tail  = &nbr->probe_next;
+}
+
+static void neighbor_probe_unlink(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    if (nbr->probe_pprev == NULL) {
+        return;
+    }
+
+    *nbr->probe_pprev = nbr->probe_next;
+    if (nbr->probe_next != NULL) {
+        nbr->probe_next->probe_pprev = nbr->probe_pprev;
+    } else {
+        lssdp->neighbor_probe_wait_tail = nbr->probe_pprev;
+    }
+    nbr->probe_next  = NULL;
+    nbr->probe_pprev = NULL;
+}
+
+static void neighbor_subscription_link(lssdp_nbr * nbr, lssdp_subscription * subscription) {
+    nbr->subscription = subscription;
+    if (subscription == NULL) {
+        return;
+    }
+
+    nbr->subscription_prev = NULL;
+    nbr->subscription_next = subscription->neighbor_list;
+    if (subscription->neighbor_list != NULL) {
+        subscription->neighbor_list->subscription_prev = nbr;
+    }
+    subscription->neighbor_list = nbr;
+    subscription->neighbor_num++;
+}
+
+static void neighbor_subscription_unlink(lssdp_nbr * nbr) {
+    lssdp_subscription * subscription = nbr->subscription;
+    if (subscription == NULL) {
+        return;
+    }
+
+    if (nbr->subscription_prev == NULL) {
+        subscription->neighbor_list = nbr->subscription_next;
+    } else {
+        nbr->subscription_prev->subscription_next = nbr->subscription_next;
+    }
+
+    if (nbr->subscription_next != NULL) {
+        nbr->subscription_next->subscription_prev = nbr->subscription_prev;
+    }
+    subscription->neighbor_num--;
+
+    nbr->subscription = NULL;
+    nbr->subscription_prev = NULL;
+    nbr->subscription_next = NULL;
+}
+
+static const char * neighbor_index_key(const lssdp_nbr * nbr, int index) {
+    switch (index) {
+        case LSSDP_NBR_INDEX_USN:           return nbr->usn;
+        case LSSDP_NBR_INDEX_LOCATION:      return nbr->location;
+        case LSSDP_NBR_INDEX_SOURCE:        return nbr->ip;
+        case LSSDP_NBR_INDEX_DEVICE_TYPE:   return nbr->device_type;
+        case LSSDP_NBR_INDEX_SM_ID:         return nbr->sm_id;
+        case LSSDP_NBR_INDEX_INTERFACE:     return nbr->interface;
+        default:                            return "";
+    }
+}
+
+static bool neighbor_index_is_optional(int index) {
+    return index == LSSDP_NBR_INDEX_DEVICE_TYPE || index == LSSDP_NBR_INDEX_SM_ID || index == LSSDP_NBR_INDEX_INTERFACE;
+}
+
+static bool neighbor_index_skip(const lssdp_nbr * nbr, int index) {
+    // no datagram (e.g. loaded from snapshot)
+    if (index == LSSDP_NBR_INDEX_DATAGRAM) {
+        return nbr->datagram_hash == 0;
+    }
+
+    // empty optional field would be one long chain
+    return neighbor_index_is_optional(index) && strlen(neighbor_index_key(nbr, index)) == 0;
+}
+
+static void neighbor_index_link(struct lssdp_nbr_index * index, lssdp_nbr * nbr, int i) {
+    // add to the front of bucket, pprev makes removal O(1) in the long chain of a common value
+    lssdp_nbr ** bucket = &index->table[nbr->index_hash[i] % index->size];
+    nbr->index_next[i]  = *bucket;
+    nbr->index_pprev[i] = bucket;
+    if (*bucket != NULL) {
+        (*bucket)->index_pprev[i] = &nbr->index_next[i];
+    }
+    *bucket = nbr;
+}
+
+static int neighbor_index_add(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    int i;
+    for (i = 0; i < LSSDP_NBR_INDEX_NUM; i++) {
+        switch (i) {
+            case LSSDP_NBR_INDEX_KEY:       nbr->index_hash[i] = neighbor_key_hash(lssdp, nbr);        break;
+            case LSSDP_NBR_INDEX_DATAGRAM:  nbr->index_hash[i] = (uint32_t) nbr->datagram_hash;         break;
+            default:                        nbr->index_hash[i] = get_hash(neighbor_index_key(nbr, i)); break;
+        }
+    }
+
+    // grow the index when neighbor number is over than bucket number (nbr is already in neighbor_list)
+    if (lssdp->neighbor_num > lssdp->neighbor_index[0].size) {
+        size_t size = lssdp->neighbor_index[0].size > 0 ? lssdp->neighbor_index[0].size * 2 : 64;
+        return neighbor_index_rebuild(lssdp, size);
+    }
+
+    for (i = 0; i < LSSDP_NBR_INDEX_NUM; i++) {
+        if (neighbor_index_skip(nbr, i) == false) {
+            neighbor_index_link(&lssdp->neighbor_index[i], nbr, i);
+        }
+    }
+    return 0;
+}
+
+static void neighbor_index_remove(lssdp_nbr * nbr) {
+    int i;
+    for (i = 0; i < LSSDP_NBR_INDEX_NUM; i++) {
+        if (nbr->index_pprev[i] == NULL) {
+            continue;   // not indexed
+        }
+
+        *nbr->index_pprev[i] = nbr->index_next[i];
+        if (nbr->index_next[i] != NULL) {
+            nbr->index_next[i]->index_pprev[i] = nbr->index_pprev[i];
+        }
+        nbr->index_next[i]  = NULL;
+        nbr->index_pprev[i] = NULL;
+    }
+}
+
+static int neighbor_index_rebuild(lssdp_ctx * lssdp, size_t size) {
+    int i;
+    for (i = 0; i < LSSDP_NBR_INDEX_NUM; i++) {
+        lssdp_nbr ** table = (lssdp_nbr **) lssdp_calloc(lssdp, size, sizeof(lssdp_nbr *));
+        if (table == NULL) {
+            lssdp_error("calloc failed, errno = %s (%d)\n", strerror(errno), errno);
+            return -1;
+        }
+
+        lssdp_free(lssdp, lssdp->neighbor_index[i].table);
+        lssdp->neighbor_index[i].table = table;
+        lssdp->neighbor_index[i].size  = size;
+
+        lssdp_nbr * nbr;
+        for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+            nbr->index_next[i]  = NULL;
+            nbr->index_pprev[i] = NULL;
+            if (neighbor_index_skip(nbr, i) == false) {
+                neighbor_index_link(&lssdp->neighbor_index[i], nbr, i);
+            }
+        }
+    }
+    return 0;
+}
+
+static void neighbor_list_free(lssdp_ctx * lssdp, lssdp_nbr * list) {
+    while (list != NULL) {
+        lssdp_nbr * next = list->next;
+        fetch_neighbor_release(lssdp, list);
+        lssdp_free(lssdp, list->header);
+        lssdp_free(lssdp, list);
+        list = next;
+    }
+}
+
+static void shm_publish(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    lssdp_shm_table * table = lssdp->shm.table;
+    if (table == NULL) {
+        return;
+    }
+
+    // the neighbor is not published, and table is full: wait for a free slot
+    size_t slot = nbr->shm_slot > 0 ? nbr->shm_slot - 1 : table->neighbor_num;
+    if (slot >= table->capacity) {
+        if (nbr->shm_overflow_pprev == NULL) {
+            nbr->shm_overflow_next = lssdp->shm.overflow_list;
+            nbr->shm_overflow_pprev = &lssdp->shm.overflow_list;
+            if (lssdp->shm.overflow_list != NULL) {
+                lssdp->shm.overflow_list->shm_overflow_pprev = &nbr->shm_overflow_next;
+            }
+            lssdp->shm.overflow_list = nbr;
+        }
+        if (table->overflow_num != lssdp->neighbor_num - table->neighbor_num) {
+            shm_write_begin(table);
+            shm_write_end(lssdp, table);
+        }
+        return;
+    }
+
+    shm_write_begin(table);
+    lssdp_shm_nbr * shm_nbr = &table->neighbor[slot];
+    snprintf(shm_nbr->usn,         LSSDP_FIELD_LEN,    "%s", nbr->usn);
+    snprintf(shm_nbr->location,    LSSDP_LOCATION_LEN, "%s", nbr->location);
+    snprintf(shm_nbr->st,          LSSDP_FIELD_LEN,    "%s", nbr->st);
+    snprintf(shm_nbr->sm_id,       LSSDP_FIELD_LEN,    "%s", nbr->sm_id);
+    snprintf(shm_nbr->device_type, LSSDP_FIELD_LEN,    "%s", nbr->device_type);
+    memcpy(shm_nbr->ip,          nbr->ip,          LSSDP_IP_LEN);
+    memcpy(shm_nbr->interface,   nbr->interface,   LSSDP_INTERFACE_NAME_LEN);
+    shm_nbr->update_time = nbr->update_time;
+    shm_nbr->family      = nbr->family;
+
+    if (nbr->shm_slot == 0) {
+        nbr->shm_slot = slot + 1;
+        lssdp->shm.slot[slot] = nbr;
+        table->neighbor_num++;
+    }
+    shm_write_end(lssdp, table);
+}
+
+static void shm_unpublish(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    lssdp_shm_table * table = lssdp->shm.table;
+    if (table == NULL) {
+        return;
+    }
+
+    // the neighbor is not published: leave overflow list, and update overflow number
+    if (nbr->shm_slot == 0) {
+        if (nbr->shm_overflow_pprev != NULL) {
+            *nbr->shm_overflow_pprev = nbr->shm_overflow_next;
+            if (nbr->shm_overflow_next != NULL) {
+                nbr->shm_overflow_next->shm_overflow_pprev = nbr->shm_overflow_pprev;
+            }
+            nbr->shm_overflow_next  = NULL;
+            nbr->shm_overflow_pprev = NULL;
+        }
+        shm_write_begin(table);
+        shm_write_end(lssdp, table);
+        return;
+    }
+
+    // move the last slot to the removed slot
+    shm_write_begin(table);
+    size_t slot = nbr->shm_slot - 1, last = table->neighbor_num - 1;
+    if (slot != last) {
+        memcpy(&table->neighbor[slot], &table->neighbor[last], sizeof(lssdp_shm_nbr));
+        lssdp->shm.slot[slot] = lssdp->shm.slot[last];
+        lssdp->shm.slot[slot]->shm_slot = slot + 1;
+    }
+    lssdp->shm.slot[last] = NULL;
+    table->neighbor_num--;
+    nbr->shm_slot = 0;
+    shm_write_end(lssdp, table);
+
+    // publish a waiting neighbor to the free slot
+    lssdp_nbr * wait = lssdp->shm.overflow_list;
+    if (wait != NULL) {
+        lssdp->shm.overflow_list = wait->shm_overflow_next;
+        if (wait->shm_overflow_next != NULL) {
+            wait->shm_overflow_next->shm_overflow_pprev = &lssdp->shm.overflow_list;
+        }
+        wait->shm_overflow_next  = NULL;
+        wait->shm_overflow_pprev = NULL;
+        shm_publish(lssdp, wait);
+    }
+}
+
+static void shm_refresh(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    lssdp_shm_table * table = lssdp->shm.table;
+    if (table == NULL || nbr->shm_slot == 0) {
+        return;
+    }
+
+    // only update_time is changed
+    shm_write_begin(table);
+    table->neighbor[nbr->shm_slot - 1].update_time = nbr->update_time;
+    shm_write_end(lssdp, table);
+}
+
+static void shm_clear(lssdp_ctx * lssdp) {
+    lssdp_shm_table * table = lssdp->shm.table;
+    if (table == NULL) {
+        return;
+    }
+
+    shm_write_begin(table);
+    memset(lssdp->shm.slot, 0, table->capacity * sizeof(lssdp_nbr *));
+    lssdp->shm.overflow_list = NULL;
+    table->neighbor_num = 0;
+    shm_write_end(lssdp, table);
+}
+
+static void shm_write_begin(lssdp_shm_table * table) {
+    // sequence is odd: readers retry until writer is finished
+    __atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void shm_write_end(lssdp_ctx * lssdp, lssdp_shm_table * table) {
+    table->overflow_num = lssdp->neighbor_num - table->neighbor_num;
+    table->update_time  = get_current_time();
+    __atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELEASE);
+}
+
+static size_t snapshot_fields(const lssdp_nbr * nbr, const char * fields[], size_t lens[]) {
+    // the order of fields in snapshot record
+    fields[0] = nbr->ip;            lens[0] = strnlen(nbr->ip, LSSDP_IP_LEN);
+    fields[1] = nbr->interface;     lens[1] = strnlen(nbr->interface, LSSDP_INTERFACE_NAME_LEN);
+    fields[2] = nbr->header;        lens[2] = nbr->header_len;
+    return LSSDP_SNAPSHOT_FIELD_NUM;
+}
+
+static uint32_t snapshot_checksum(const uint8_t * data, size_t len) {
+    uint32_t hash = get_prefix_hash("", 0);
     size_t i;
+    for (i = 0; i < len; i++) {
+        hash = hash_update(hash, data[i]);
+    }
+    return hash;
+}
+
+static int pcap_replay(lssdp_ctx * lssdp, lssdp_pcap * pcap, uint32_t magic) {
+    // 1. magic number: byte order and timestamp resolution (us or ns)
+    bool is_nano;
+    switch (magic) {
+        case 0xA1B2C3D4: pcap->is_swap = false; is_nano = false; break;
+        case 0xD4C3B2A1: pcap->is_swap = true;  is_nano = false; break;
+        case 0xA1B23C4D: pcap->is_swap = false; is_nano = true;  break;
+        case 0x4D3CB2A1: pcap->is_swap = true;  is_nano = true;  break;
+        default:
+            lssdp_error("unknown pcap magic number 0x%08x\n", magic);
+            return -1;
+    }
+
+    // 2. rest of global header: version, thiszone, sigfigs, snaplen, linktype
+    uint8_t header[20];
+    if (fread(header, sizeof(header), 1, pcap->fp) != 1) {
+        lssdp_error("read pcap global header failed\n");
+        return -1;
+    }
+    int linktype = pcap_u32(pcap, header + 16) & 0xFFFF;
+
+    uint8_t * data = (uint8_t *) lssdp_malloc(lssdp, LSSDP_PCAP_PACKET_LEN);
+    if (data == NULL) {
+        lssdp_error("malloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    // 3. packet records: ts_sec, ts_usec (ts_nsec), incl_len, orig_len, packet data
+    int result = 0;
+    uint8_t record[16];
+    while (fread(record, sizeof(record), 1, pcap->fp) == 1) {
+        uint32_t caplen = pcap_u32(pcap, record + 8);
+        if (caplen > LSSDP_PCAP_PACKET_LEN) {
+            lssdp_error("pcap record length %u is invalid\n", caplen);
+            result = -1;
+            break;
+        }
+
+        if (fread(data, 1, caplen, pcap->fp) != caplen) {
+            lssdp_warn("pcap record is truncated\n");
+            break;
+        }
+
+        long long timestamp = (long long) pcap_u32(pcap, record) * 1000000
+                            + (is_nano ? pcap_u32(pcap, record + 4) / 1000 : pcap_u32(pcap, record + 4));
+        pcap_packet_handler(lssdp, pcap, linktype, data, caplen, timestamp);
+    }
+
+    lssdp_free(lssdp, data);
+    return result;
+}
+
+static int pcapng_replay(lssdp_ctx * lssdp, lssdp_pcap * pcap) {
+    uint8_t * body = (uint8_t *) lssdp_malloc(lssdp, LSSDP_PCAP_PACKET_LEN);
+    if (body == NULL) {
+        lssdp_error("malloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    int result = 0;
+    long long timestamp = 0;
+    uint8_t header[8];
+    while (fread(header, sizeof(header), 1, pcap->fp) == 1) {
+        uint32_t type = pcap_u32(pcap, header);
+
+        // 1. Section Header Block: byte order magic decides byte order of the section
+        if (type == 0x0A0D0D0A) {
+            uint8_t magic[4];
+            if (fread(magic, sizeof(magic), 1, pcap->fp) != 1) {
+                break;
+            }
+            pcap->is_swap = false;
+            if (pcap_u32(pcap, magic) != 0x1A2B3C4D) {
+                pcap->is_swap = true;
+            }
+            pcap->interface_num = 0;
+
+            // skip the rest of block
+            uint32_t block_len = pcap_u32(pcap, header + 4);
+            if (block_len < 16 || block_len % 4 != 0 || fseek(pcap->fp, block_len - 12, SEEK_CUR) != 0) {
+                lssdp_error("pcapng section header block length %u is invalid\n", block_len);
+                result = -1;
+                break;
+            }
+            continue;
+        }
+
+        // 2. read block body (include the trailing block length)
+        uint32_t block_len = pcap_u32(pcap, header + 4);
+        if (block_len < 12 || block_len % 4 != 0 || block_len - 8 > LSSDP_PCAP_PACKET_LEN) {
+            lssdp_error("pcapng block length %u is invalid\n", block_len);
+            result = -1;
+            break;
+        }
+
+        size_t body_len = block_len - 8;
+        if (fread(body, 1, body_len, pcap->fp) != body_len) {
+            lssdp_warn("pcapng block is truncated\n");
+            break;
+        }
+        body_len -= 4;
+
+        // 3. Interface Description Block: linktype, options (if_tsresol)
+        if (type == 0x00000001 && body_len >= 8) {
+            if (pcap->interface_num >= LSSDP_PCAP_INTERFACE_SIZE) {
+                lssdp_warn("pcapng interface number is over than MAX SIZE (%d)\n", LSSDP_PCAP_INTERFACE_SIZE);
+                continue;
+            }
+
+            size_t n = pcap->interface_num++;
+            pcap->interface[n].linktype = pcap_u16(pcap, body);
+            pcap->interface[n].tsresol  = 6;
+
+            size_t offset = 8;
+            while (offset + 4 <= body_len) {
+                uint16_t code = pcap_u16(pcap, body + offset);
+                uint16_t len  = pcap_u16(pcap, body + offset + 2);
+                if (code == 0 || offset + 4 + len > body_len) {
+                    break;
+                }
+
+                if (code == 9 && len >= 1) {
+                    pcap->interface[n].tsresol = body[offset + 4];
+                }
+                offset += 4 + ((len + 3) & ~3);
+            }
+            continue;
+        }
+
+        // 4. Enhanced Packet Block: interface id, timestamp, captured length, original length, data
+        if (type == 0x00000006 && body_len >= 20) {
+            uint32_t id     = pcap_u32(pcap, body);
+            uint32_t caplen = pcap_u32(pcap, body + 12);
+            if (id >= pcap->interface_num || caplen > body_len - 20) {
+                continue;
+            }
+
+            uint64_t ts = ((uint64_t) pcap_u32(pcap, body + 4) << 32) | pcap_u32(pcap, body + 8);
+            timestamp = pcap_time_us(ts, pcap->interface[id].tsresol);
+            pcap_packet_handler(lssdp, pcap, pcap->interface[id].linktype, body + 20, caplen, timestamp);
+            continue;
+        }
+
+        // 5. Simple Packet Block: original length, data (interface 0, no timestamp)
+        if (type == 0x00000003 && body_len >= 4 && pcap->interface_num > 0) {
+            uint32_t caplen = pcap_u32(pcap, body);
+            if (caplen > body_len - 4) {
+                caplen = body_len - 4;
+            }
+            pcap_packet_handler(lssdp, pcap, pcap->interface[0].linktype, body + 4, caplen, timestamp);
+            continue;
+        }
+
+        // other blocks are ignored
+    }
+
+    lssdp_free(lssdp, body);
+    return result;
+}
+
+static int pcap_packet_handler(lssdp_ctx * lssdp, lssdp_pcap * pcap, int linktype, const uint8_t * data, size_t len, long long timestamp) {
+    // 1. link layer header
+    size_t offset;
+    switch (linktype) {
+        case 1:     // LINKTYPE_ETHERNET
+            if (len < 14) {
+                return 0;
+            }
+
+            // skip VLAN tags, check ethertype is IPv4 or IPv6
+            offset = 12;
+            while ((data[offset] << 8 | data[offset + 1]) == 0x8100 || (data[offset] << 8 | data[offset + 1]) == 0x88A8) {
+                offset += 4;
+                if (len < offset + 2) {
+                    return 0;
+                }
+            }
+
+            if ((data[offset] << 8 | data[offset + 1]) != 0x0800 && (data[offset] << 8 | data[offset + 1]) != 0x86DD) {
+                return 0;
+            }
+            offset += 2;
+            break;
+        case 113:   // LINKTYPE_LINUX_SLL
+            offset = 16;
+            break;
+        case 276:   // LINKTYPE_LINUX_SLL2
+            offset = 20;
+            break;
+        case 0:     // LINKTYPE_NULL
+        case 108:   // LINKTYPE_LOOP
+            offset = 4;
+            break;
+        case 101:   // LINKTYPE_RAW
+        case 228:   // LINKTYPE_IPV4
+        case 229:   // LINKTYPE_IPV6
+            offset = 0;
+            break;
+        default:
+            return 0;
+    }
+
+    if (len <= offset) {
+        return 0;
+    }
+    data += offset;
+    len  -= offset;
+
+    // 2. IP header
+    struct sockaddr_storage address = {};
+    size_t ip_len;
+    int version = data[0] >> 4;
+    if (version == 4) {
+        ip_len = (data[0] & 0x0F) * 4;
+        if (len < 20 || ip_len < 20 || len < ip_len || data[9] != IPPROTO_UDP) {
+            return 0;
+        }
+
+        // IP fragment is not supported
+        if (((data[6] << 8 | data[7]) & 0x3FFF) != 0) {
+            return 0;
+        }
+
+        struct sockaddr_in * addr = (struct sockaddr_in *) &address;
+        addr->sin_family = AF_INET;
+        memcpy(&addr->sin_addr, data + 12, 4);
+    } else if (version == 6) {
+        if (len < 40) {
+            return 0;
+        }
+
+        // skip extension headers: hop-by-hop, routing, destination options
+        uint8_t next = data[6];
+        ip_len = 40;
+        while (next == 0 || next == 43 || next == 60) {
+            if (len < ip_len + 8) {
+                return 0;
+            }
+            next    = data[ip_len];
+            ip_len += (data[ip_len + 1] + 1) * 8;
+        }
+
+        if (next != IPPROTO_UDP || len < ip_len) {
+            return 0;
+        }
+
+        struct sockaddr_in6 * addr = (struct sockaddr_in6 *) &address;
+        addr->sin6_family = AF_INET6;
+        memcpy(&addr->sin6_addr, data + 8, 16);
+    } else {
+        return 0;
+    }
+
+    // 3. UDP header: source port, destination port, length
+    const uint8_t * udp = data + ip_len;
+    size_t udp_len = len - ip_len;
+    if (udp_len < 8) {
+        return 0;
+    }
+
+    uint16_t src_port = udp[0] << 8 | udp[1];
+    uint16_t dst_port = udp[2] << 8 | udp[3];
+    if (src_port != lssdp->port && dst_port != lssdp->port) {
+        return 0;
+    }
+
+    size_t payload_len = (udp[4] << 8 | udp[5]);
+    if (payload_len < 8) {
+        return 0;
+    }
+    payload_len -= 8;
+    if (payload_len > udp_len - 8) {
+        payload_len = udp_len - 8;
+    }
+
+    if (payload_len == 0 || payload_len >= LSSDP_BUFFER_LEN) {
+        return 0;
+    }
+
+    // 4. feed payload to packet handler
+    char buffer[LSSDP_BUFFER_LEN];
+    memcpy(buffer, udp + 8, payload_len);
+    buffer[payload_len] = '\0';
+
+    pcap_replay_wait(pcap, timestamp);
+    lssdp_packet_handler(lssdp, buffer, payload_len, (struct sockaddr *) &address, get_current_time(), 0);
+    pcap->packet_num++;
+    return 1;
+}
+
+static void pcap_replay_wait(lssdp_pcap * pcap, long long timestamp) {
+    struct timeval now = {};
+    gettimeofday(&now, NULL);
+    long long current_time = (long long) now.tv_sec * 1000000 + now.tv_usec;
+
+    if (pcap->first_time < 0) {
+        pcap->first_time = timestamp;
+        pcap->start_time = current_time;
+        return;
+    }
+
+    if (pcap->is_realtime == false) {
+        return;
+    }
+
+    // sleep until the recorded offset from the first packet
+    long long wait_time = (timestamp - pcap->first_time) - (current_time - pcap->start_time);
+    if (wait_time > 0) {
+        struct timespec ts = {
+            .tv_sec  = wait_time / 1000000,
+            .tv_nsec = (wait_time % 1000000) * 1000
+        };
+        nanosleep(&ts, NULL);
+    }
+}
+
+static long long pcap_time_us(uint64_t timestamp, uint8_t tsresol) {
+    // if_tsresol: MSB 0 is 10^-n second, MSB 1 is 2^-n second
+    uint8_t n = tsresol & 0x7F;
+    if (tsresol & 0x80) {
+        if (n >= 64) {
+            return 0;
+        }
+
+        // keep 32 fraction bits at most, fraction * 10^6 must not overflow 64 bits
+        if (n > 32) {
+            timestamp >>= n - 32;
+            n = 32;
+        }
+        int64_t  second   = (int64_t) (timestamp >> n);
+        uint64_t fraction = timestamp & ((1ULL << n) - 1);
+        return second * 1000000 + (long long) ((fraction * 1000000) >> n);
+    }
+
+    uint64_t scale = 1;
+    if (n >= 6) {
+        for (; n > 6; n--) {
+            scale *= 10;
+        }
+        return (long long) (timestamp / scale);
+    }
+
+    for (; n < 6; n++) {
+        scale *= 10;
+    }
+    return (long long) (timestamp * scale);
+}
+
+static uint16_t pcap_u16(const lssdp_pcap * pcap, const uint8_t * data) {
+    uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return pcap->is_swap ? (uint16_t) (value >> 8 | value << 8) : value;
+}
+
+static uint32_t pcap_u32(const lssdp_pcap * pcap, const uint8_t * data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    if (pcap->is_swap) {
+        value = (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+    }
+    return value;
+}
+
+static uint32_t fetch_key(const lssdp_nbr * nbr, char * key) {
+    // "uuid\nBOOTID\nCONFIGID": the services of a device (usn uuid:device-UUID::urn:...) share one description
+    const char * bootid   = header_find(nbr->header, nbr->header_len, "BOOTID.UPNP.ORG");
+    const char * configid = header_find(nbr->header, nbr->header_len, "CONFIGID.UPNP.ORG");
+    const char * id       = strlen(nbr->usn) > 0 ? nbr->usn : nbr->location;
+    const char * suffix   = strstr(id, "::");
+    int id_len = suffix != NULL ? (int) (suffix - id) : (int) strlen(id);
+
+    snprintf(key, LSSDP_BUFFER_LEN, "%.*s\n%s\n%s", id_len, id, bootid != NULL ? bootid : "", configid != NULL ? configid : "");
+    return get_hash(key);
+}
+
+static void fetch_neighbor_update(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    // fetcher is created by the first neighbor
+    if (lssdp->fetch.fetcher == NULL) {
+        lssdp->fetch.fetcher = (lssdp_fetcher *) lssdp_calloc(lssdp, 1, sizeof(lssdp_fetcher));
+        if (lssdp->fetch.fetcher == NULL) {
+            lssdp_error("calloc failed, errno = %s (%d)\n", strerror(errno), errno);
+            return;
+        }
+    }
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+
+    // 1. description key is not changed (failed one is retried)
+    char key[LSSDP_BUFFER_LEN];
+    uint32_t hash = fetch_key(nbr, key);
+    if (nbr->description_key == hash) {
+        if (nbr->description_status == LSSDP_FETCH_PENDING) {
+            return;
+        }
+        if (nbr->description_status == LSSDP_FETCH_DONE && strcmp(nbr->description_cache->key, key) == 0) {
+            return;
+        }
+    }
+
+    // 2. release the previous description, then find in cache
+    fetch_neighbor_release(lssdp, nbr);
+    nbr->description_key = hash;
+
+    lssdp_desc * desc = fetch_cache_find(fetcher, hash, key);
+    if (desc != NULL) {
+        lssdp->fetch.cache_hit_num++;
+        fetch_cache_attach(lssdp, desc, nbr);
+        return;
+    }
+
+    // 3. wait for request
+    nbr->description_status = LSSDP_FETCH_PENDING;
+    fetch_queue_add(fetcher, nbr);
+}
+
+static void fetch_neighbor_release(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+    if (fetcher == NULL) {
+        return;
+    }
+
+    // 1. dequeue, the response of in-flight request is cached only
+    if (nbr->description_status == LSSDP_FETCH_PENDING) {
+        fetch_queue_remove(fetcher, nbr);
+
+        lssdp_fetch_conn * conn;
+        for (conn = fetcher->conn_list; conn != NULL; conn = conn->next) {
+            if (conn->nbr == nbr) {
+                conn->nbr = NULL;
+            }
+        }
+    }
+
+    // 2. detach description
+    lssdp_desc * desc = nbr->description_cache;
+    nbr->description_cache  = NULL;
+    nbr->description        = NULL;
+    nbr->description_len    = 0;
+    nbr->description_status = LSSDP_FETCH_NONE;
+    if (desc != NULL && --desc->ref == 0) {
+        fetcher->cache_unused_num++;
+        fetch_cache_trim(lssdp, 0);
+    }
+}
+
+static void fetch_neighbor_done(lssdp_ctx * lssdp, lssdp_nbr * nbr, int status) {
+    nbr->description_status = status;
+    if (lssdp->description_fetched_callback != NULL) {
+        lssdp->description_fetched_callback(lssdp, nbr);
+    }
+}
+
+static void fetch_queue_add(lssdp_fetcher * fetcher, lssdp_nbr * nbr) {
+    nbr->fetch_prev = fetcher->queue_last;
+    nbr->fetch_next = NULL;
+    if (fetcher->queue_last == NULL) {
+        fetcher->queue = nbr;
+    } else {
+        fetcher->queue_last->fetch_next = nbr;
+    }
+    fetcher->queue_last = nbr;
+}
+
+static void fetch_queue_remove(lssdp_fetcher * fetcher, lssdp_nbr * nbr) {
+    // in flight: not in queue
+    if (nbr->fetch_prev == NULL && fetcher->queue != nbr) {
+        return;
+    }
+
+    if (nbr->fetch_prev == NULL) {
+        fetcher->queue = nbr->fetch_next;
+    } else {
+        nbr->fetch_prev->fetch_next = nbr->fetch_next;
+    }
+
+    if (nbr->fetch_next == NULL) {
+        fetcher->queue_last = nbr->fetch_prev;
+    } else {
+        nbr->fetch_next->fetch_prev = nbr->fetch_prev;
+    }
+    nbr->fetch_prev = NULL;
+    nbr->fetch_next = NULL;
+}
+
+static int fetch_queue_start(lssdp_ctx * lssdp, long long current_time) {
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+    size_t concurrency = lssdp->fetch.concurrency > 0 ? lssdp->fetch.concurrency : LSSDP_FETCH_CONCURRENCY;
+    concurrency = concurrency < LSSDP_FETCH_CONN_MAX ? concurrency : LSSDP_FETCH_CONN_MAX;
+
+    int start_num = 0;
+    lssdp_nbr * nbr = fetcher->queue;
+    while (nbr != NULL && lssdp->fetch.active_num < concurrency) {
+        lssdp_nbr * next = nbr->fetch_next;
+
+        // 1. the same description is in flight: wait for its response
+        lssdp_fetch_conn * conn;
+        for (conn = fetcher->conn_list; conn != NULL; conn = conn->next) {
+            if (conn->state != FETCH_IDLE && conn->hash == nbr->description_key) {
+                break;
+            }
+        }
+        if (conn != NULL) {
+            nbr = next;
+            continue;
+        }
+
+        // 2. fetched by the other neighbor, or start request
+        fetch_queue_remove(fetcher, nbr);
+        char key[LSSDP_BUFFER_LEN];
+        fetch_key(nbr, key);
+
+        lssdp_desc * desc = fetch_cache_find(fetcher, nbr->description_key, key);
+        if (desc != NULL) {
+            lssdp->fetch.cache_hit_num++;
+            fetch_cache_attach(lssdp, desc, nbr);
+            fetch_neighbor_done(lssdp, nbr, LSSDP_FETCH_DONE);
+            next = fetcher->queue;  // callback may change the queue
+        } else if (fetch_start(lssdp, nbr, key, current_time) != 0) {
+            lssdp->fetch.fail_num++;
+            fetch_neighbor_done(lssdp, nbr, LSSDP_FETCH_FAILED);
+            next = fetcher->queue;
+        } else {
+            start_num++;
+        }
+        nbr = next;
+    }
+    return start_num;
+}
+
+static lssdp_desc * fetch_cache_find(lssdp_fetcher * fetcher, uint32_t hash, const char * key) {
+    if (fetcher->cache_table_size == 0) {
+        return NULL;
+    }
+
+    lssdp_desc * desc;
+    for (desc = fetcher->cache_table[hash % fetcher->cache_table_size]; desc != NULL; desc = desc->hash_next) {
+        if (desc->hash == hash && strcmp(desc->key, key) == 0) {
+            return desc;
+        }
+    }
+    return NULL;
+}
+
+static lssdp_desc * fetch_cache_add(lssdp_ctx * lssdp, uint32_t hash, const char * key, const char * data, size_t len) {
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+
+    // 0. memory budget (neighbor_memory_max): free unused entries, neighbors are not evicted for a description
+    size_t key_len = strlen(key);
+    size_t size    = sizeof(lssdp_desc) + len + key_len + 2;
+    fetch_cache_trim(lssdp, size);
+    if (lssdp->neighbor_memory_max > 0 && lssdp->neighbor_memory + size > lssdp->neighbor_memory_max) {
+        lssdp_warn("description (%zu bytes) is over memory budget of neighbors\n", len);
+        return NULL;
+    }
+
+    // 1. grow hash table, load factor <= 1
+    if (fetcher->cache_num >= fetcher->cache_table_size) {
+        size_t size = fetcher->cache_table_size > 0 ? fetcher->cache_table_size * 2 : 64;
+        lssdp_desc ** table = (lssdp_desc **) lssdp_calloc(lssdp, size, sizeof(lssdp_desc *));
+        if (table == NULL) {
+            lssdp_error("calloc failed, errno = %s (%d)\n", strerror(errno), errno);
+            return NULL;
+        }
+
+        lssdp_desc * d;
+        for (d = fetcher->cache; d != NULL; d = d->next) {
+            d->hash_next = table[d->hash % size];
+            table[d->hash % size] = d;
+        }
+        lssdp_free(lssdp, fetcher->cache_table);
+        fetcher->cache_table      = table;
+        fetcher->cache_table_size = size;
+    }
+
+    // 2. "description\0key\0"
+    lssdp_desc * desc = (lssdp_desc *) lssdp_malloc(lssdp, size);
+    if (desc == NULL) {
+        lssdp_error("malloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return NULL;
+    }
+
+    memcpy(desc->data, data, len);
+    desc->data[len] = '\0';
+    memcpy(desc->data + len + 1, key, key_len + 1);
+    desc->key  = desc->data + len + 1;
+    desc->hash = hash;
+    desc->ref  = 0;
+    desc->len  = len;
+    desc->size = size;
+
+    // 3. add to the front of cache list, and hash table
+    desc->prev = NULL;
+    desc->next = fetcher->cache;
+    if (fetcher->cache == NULL) {
+        fetcher->cache_last = desc;
+    } else {
+        fetcher->cache->prev = desc;
+    }
+    fetcher->cache = desc;
+
+    size_t slot = hash % fetcher->cache_table_size;
+    desc->hash_next = fetcher->cache_table[slot];
+    fetcher->cache_table[slot] = desc;
+
+    fetcher->cache_num++;
+    fetcher->cache_unused_num++;
+    fetcher->cache_memory  += size;
+    lssdp->neighbor_memory += size;
+    return desc;
+}
+
+static void fetch_cache_attach(lssdp_ctx * lssdp, lssdp_desc * desc, lssdp_nbr * nbr) {
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+    if (desc->ref++ == 0) {
+        fetcher->cache_unused_num--;
+    }
+
+    // move to the front of cache list (the most recently used)
+    if (desc->prev != NULL) {
+        desc->prev->next = desc->next;
+        if (desc->next == NULL) {
+            fetcher->cache_last = desc->prev;
+        } else {
+            desc->next->prev = desc->prev;
+        }
+        desc->prev = NULL;
+        desc->next = fetcher->cache;
+        fetcher->cache->prev = desc;
+        fetcher->cache = desc;
+    }
+
+    nbr->description_cache  = desc;
+    nbr->description        = desc->data;
+    nbr->description_len    = desc->len;
+    nbr->description_status = LSSDP_FETCH_DONE;
+}
+
+static void fetch_cache_trim(lssdp_ctx * lssdp, size_t memory) {
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+    if (fetcher == NULL) {
+        return;
+    }
+    size_t cache_max = lssdp->fetch.cache_max > 0 ? lssdp->fetch.cache_max : LSSDP_FETCH_CACHE_MAX;
+
+    // free the least recently used entries which are not used by neighbors:
+    // over cache_max, or over memory budget of neighbors with the new memory
+    lssdp_desc * desc = fetcher->cache_last;
+    while (desc != NULL && fetcher->cache_unused_num > 0
+        && (fetcher->cache_unused_num > cache_max
+            || (lssdp->neighbor_memory_max > 0 && lssdp->neighbor_memory + memory > lssdp->neighbor_memory_max))) {
+        lssdp_desc * prev = desc->prev;
+        if (desc->ref > 0) {
+            desc = prev;
+            continue;
+        }
+
+        // remove from cache list
+        if (prev == NULL) {
+            fetcher->cache = desc->next;
+        } else {
+            prev->next = desc->next;
+        }
+        if (desc->next == NULL) {
+            fetcher->cache_last = prev;
+        } else {
+            desc->next->prev = prev;
+        }
+
+        // remove from hash table
+        lssdp_desc ** d = &fetcher->cache_table[desc->hash % fetcher->cache_table_size];
+        while (*d != desc) {
+            d = &(*d)->hash_next;
+        }
+        *d = desc->hash_next;
+
+        fetcher->cache_num--;
+        fetcher->cache_unused_num--;
+        fetcher->cache_memory  -= desc->size;
+        lssdp->neighbor_memory -= desc->size;
+        lssdp_free(lssdp, desc);
+        desc = prev;
+    }
+}
+
+static int fetch_location_parse(lssdp_ctx * lssdp, const lssdp_nbr * nbr, struct sockaddr_storage * address, socklen_t * address_len, char * host, const char ** path) {
+    // "http://host[:port][/path]", host is IPv4 or [IPv6] address
+    const char * location = nbr->location;
+    if (strncasecmp(location, "http://", 7) != 0) {
+        lssdp_warn("location is not http: %s\n", location);
+        return -1;
+    }
+
+    // 1. request line and HOST field: no space or control character
+    const char * c;
+    for (c = location; *c != '\0'; c++) {
+        if (is_trim_char(*c)) {
+            lssdp_warn("location has invalid character: %s\n", location);
+            return -1;
+        }
+    }
+
+    const char * authority = location + 7;
+    size_t authority_len = strcspn(authority, "/");
+    if (authority_len == 0 || authority_len >= LSSDP_LOCATION_LEN) {
+        lssdp_warn("location host is invalid: %s\n", location);
+        return -1;
+    }
+    memcpy(host, authority, authority_len);
+    host[authority_len] = '\0';
+    *path = authority[authority_len] == '/' ? authority + authority_len : "/";
+
+    // 2. split address and port
+    char ip[LSSDP_LOCATION_LEN] = {};
+    const char * port = NULL;
+    if (host[0] == '[') {
+        const char * end = strchr(host, ']');
+        if (end == NULL || (end[1] != '\0' && end[1] != ':')) {
+            lssdp_warn("location host is invalid: %s\n", location);
+            return -1;
+        }
+        memcpy(ip, host + 1, end - host - 1);
+        port = end[1] == ':' ? end + 2 : NULL;
+
+        // zone id "%25eth0": the interface of neighbor is used
+        char * zone = strchr(ip, '%');
+        if (zone != NULL) {
+            *zone = '\0';
+        }
+    } else {
+        const char * colon = strchr(host, ':');
+        memcpy(ip, host, colon != NULL ? (size_t) (colon - host) : authority_len);
+        port = colon != NULL ? colon + 1 : NULL;
+    }
+
+    long port_num = 80;
+    if (port != NULL) {
+        char * end;
+        port_num = strtol(port, &end, 10);
+        if (end == port || *end != '\0' || port_num <= 0 || port_num > 65535) {
+            lssdp_warn("location port is invalid: %s\n", location);
+            return -1;
+        }
+    }
+
+    // 3. IP address (DNS is not resolved)
+    memset(address, 0, sizeof(struct sockaddr_storage));
+    struct sockaddr_in * addr = (struct sockaddr_in *) address;
+    if (inet_pton(AF_INET, ip, &addr->sin_addr) == 1) {
+        addr->sin_family = AF_INET;
+        addr->sin_port   = htons(port_num);
+        *address_len     = sizeof(struct sockaddr_in);
+        return 0;
+    }
+
+    struct sockaddr_in6 * addr6 = (struct sockaddr_in6 *) address;
+    if (inet_pton(AF_INET6, ip, &addr6->sin6_addr) == 1) {
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port   = htons(port_num);
+        if (IN6_IS_ADDR_LINKLOCAL(&addr6->sin6_addr)) {
+            addr6->sin6_scope_id = if_nametoindex(nbr->interface);
+        }
+        *address_len = sizeof(struct sockaddr_in6);
+        return 0;
+    }
+
+    lssdp_warn("location host is not IP address: %s\n", location);
+    return -1;
+}
+
+static int fetch_start(lssdp_ctx * lssdp, lssdp_nbr * nbr, const char * key, long long current_time) {
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+
+    // 1. server address of location
+    struct sockaddr_storage address;
+    socklen_t address_len = 0;
+    char host[LSSDP_LOCATION_LEN];
+    const char * path = NULL;
+    if (fetch_location_parse(lssdp, nbr, &address, &address_len, host, &path) != 0) {
+        return -1;
+    }
+
+    // 2. idle connection to the same server (connection pool), or open a new one
+    lssdp_fetch_conn * conn, * idle = NULL;
+    for (conn = fetcher->conn_list; conn != NULL; conn = conn->next) {
+        if (conn->state != FETCH_IDLE) {
+            continue;
+        }
+        if (conn->address_len == address_len && memcmp(&conn->address, &address, address_len) == 0) {
+            break;
+        }
+        idle = conn;
+    }
+
+    if (conn != NULL) {
+        conn->state     = FETCH_SENDING;
+        conn->is_reused = true;
+    } else {
+        // pool is full: close an idle connection to the other server
+        if (fetcher->conn_num >= LSSDP_FETCH_CONN_MAX && idle != NULL) {
+            fetch_conn_close(lssdp, idle);
+        }
+
+        conn = fetch_conn_open(lssdp, &address, address_len);
+        if (conn == NULL) {
+            return -1;
+        }
+    }
+    lssdp->fetch.active_num++;
+
+    // 3. HTTP/1.1 GET request
+    conn->key = (char *) lssdp_malloc(lssdp, strlen(key) + 1);
+    if (conn->key == NULL) {
+        lssdp_error("malloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        fetch_conn_close(lssdp, conn);
+        return -1;
+    }
+    strcpy(conn->key, key);
+
+    conn->request_len = snprintf(conn->request, LSSDP_BUFFER_LEN,
+        "GET %s HTTP/1.1\r\n"
+        "HOST: %s\r\n"
+        "CONNECTION: keep-alive\r\n"
+        "USER-AGENT: lssdp\r\n"
+        "\r\n",
+        path,
+        host
+    );
+    conn->sent_len     = 0;
+    conn->response_len = 0;
+    conn->nbr          = nbr;
+    conn->hash         = nbr->description_key;
+    conn->time         = current_time;
+
+    lssdp->fetch.request_num++;
+    lssdp_debug("fetch %s (%s connection)\n", nbr->location, conn->is_reused ? "reused" : "new");
+    return 0;
+}
+
+static lssdp_fetch_conn * fetch_conn_open(lssdp_ctx * lssdp, const struct sockaddr_storage * address, socklen_t address_len) {
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+    lssdp_fetch_conn * conn = (lssdp_fetch_conn *) lssdp_calloc(lssdp, 1, sizeof(lssdp_fetch_conn));
+    if (conn == NULL) {
+        lssdp_error("calloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return NULL;
+    }
+
+    // 1. create TCP socket (in the network namespace)
+    int original_fd;
+    if (netns_enter(lssdp, &original_fd) != 0) {
+        lssdp_free(lssdp, conn);
+        return NULL;
+    }
+
+    conn->fd = socket(address->ss_family, SOCK_STREAM, 0);
+    if (netns_leave(lssdp, original_fd) != 0) {
+        if (conn->fd >= 0) {
+            close(conn->fd);
+        }
+        lssdp_free(lssdp, conn);
+        return NULL;
+    }
+
+    if (conn->fd < 0) {
+        lssdp_error("create socket failed, errno = %s (%d)\n", strerror(errno), errno);
+        lssdp_free(lssdp, conn);
+        return NULL;
+    }
+
+    // 2. set non-blocking, FD_CLOEXEC, and no SIGPIPE
+    int opt = 1;
+    if (ioctl(conn->fd, FIONBIO, &opt) != 0) {
+        lssdp_error("ioctl FIONBIO failed, errno = %s (%d)\n", strerror(errno), errno);
+        goto err;
+    }
+
+    int fd_opt = fcntl(conn->fd, F_GETFD);
+    if (fd_opt == -1 || fcntl(conn->fd, F_SETFD, fd_opt | FD_CLOEXEC) == -1) {
+        lssdp_error("fcntl FD_CLOEXEC failed, errno = %s (%d)\n", strerror(errno), errno);
+    }
+#ifdef SO_NOSIGPIPE
+    if (setsockopt(conn->fd, SOL_SOCKET, SO_NOSIGPIPE, &opt, sizeof(opt)) != 0) {
+        lssdp_warn("setsockopt SO_NOSIGPIPE failed, errno = %s (%d)\n", strerror(errno), errno);
+    }
+#endif
+
+    // 3. connect, it is done when socket is writable
+    conn->state = FETCH_CONNECTING;
+    if (connect(conn->fd, (const struct sockaddr *) address, address_len) == 0) {
+        conn->state = FETCH_SENDING;
+    } else if (errno != EINPROGRESS) {
+        lssdp_warn("connect failed, errno = %s (%d)\n", strerror(errno), errno);
+        goto err;
+    }
+
+    // 4. add to connection list
+    memcpy(&conn->address, address, address_len);
+    conn->address_len = address_len;
+    conn->next = fetcher->conn_list;
+    fetcher->conn_list = conn;
+    fetcher->conn_num++;
+    lssdp->fetch.connect_num++;
+    return conn;
+
+err:
+    close(conn->fd);
+    lssdp_free(lssdp, conn);
+    return NULL;
+}
+
+static void fetch_conn_progress(lssdp_ctx * lssdp, lssdp_fetch_conn * conn, short revents, long long current_time) {
+    // idle connection is readable (closed by server), or idle too long
+    if (conn->state == FETCH_IDLE) {
+        if (revents != 0 || current_time - conn->time >= LSSDP_FETCH_IDLE_TIME) {
+            fetch_conn_close(lssdp, conn);
+        }
+        return;
+    }
+
+    // 1. connect is done
+    if (conn->state == FETCH_CONNECTING && revents != 0) {
+        int error = 0;
+        socklen_t error_len = sizeof(error);
+        if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0) {
+            error = errno;
+        }
+        if (error != 0) {
+            fetch_conn_fail(lssdp, conn, strerror(error));
+            return;
+        }
+        conn->state = FETCH_SENDING;
+    }
+
+    // 2. send request
+    if (conn->state == FETCH_SENDING) {
+        ssize_t sent = send(conn->fd, conn->request + conn->sent_len, conn->request_len - conn->sent_len, MSG_NOSIGNAL);
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            fetch_conn_fail(lssdp, conn, strerror(errno));
+            return;
+        }
+
+        conn->sent_len += sent > 0 ? sent : 0;
+        if (conn->sent_len == conn->request_len) {
+            conn->state = FETCH_RECEIVING;
+        }
+    }
+
+    // 3. receive response
+    if (conn->state == FETCH_RECEIVING && fetch_conn_receive(lssdp, conn, current_time) != 0) {
+        return;
+    }
+
+    // 4. timeout
+    long timeout = lssdp->fetch.timeout > 0 ? lssdp->fetch.timeout : LSSDP_FETCH_TIMEOUT;
+    if (current_time - conn->time >= timeout) {
+        fetch_conn_fail(lssdp, conn, "timeout");
+    }
+}
+
+static int fetch_conn_receive(lssdp_ctx * lssdp, lssdp_fetch_conn * conn, long long current_time) {
+    // response header and chunk framing are over max_size
+    size_t max_size = lssdp->fetch.max_size > 0 ? lssdp->fetch.max_size : LSSDP_FETCH_MAX_SIZE;
+    size_t limit    = max_size + LSSDP_BUFFER_LEN;
+
+    // 1. read until socket is empty
+    bool is_eof = false;
+    for (;;) {
+        if (conn->response_len + 1 >= conn->response_size) {
+            if (conn->response_size >= limit) {
+                fetch_conn_fail(lssdp, conn, "response is too large");
+                return 1;
+            }
+
+            size_t size = conn->response_size > 0 ? conn->response_size * 2 : LSSDP_BUFFER_LEN;
+            size = size < limit ? size : limit;
+            char * response = (char *) lssdp_realloc(lssdp, conn->response, size);
+            if (response == NULL) {
+                lssdp_error("realloc failed, errno = %s (%d)\n", strerror(errno), errno);
+                fetch_conn_fail(lssdp, conn, "out of memory");
+                return 1;
+            }
+            conn->response      = response;
+            conn->response_size = size;
+        }
+
+        ssize_t received = recv(conn->fd, conn->response + conn->response_len, conn->response_size - conn->response_len - 1, 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            fetch_conn_fail(lssdp, conn, strerror(errno));
+            return 1;
+        }
+
+        if (received == 0) {
+            is_eof = true;
+            break;
+        }
+        conn->response_len += received;
+    }
+    conn->response[conn->response_len] = '\0';
+
+    // 2. response is complete
+    size_t body_start = 0, body_len = 0;
+    bool is_keep_alive = false;
+    int ret = http_response_check(lssdp, conn->response, conn->response_len, is_eof, &body_start, &body_len, &is_keep_alive);
+    if (ret == 0 && is_eof == false) {
+        return 0;
+    }
+
+    if (ret != 1) {
+        fetch_conn_fail(lssdp, conn, ret == 0 ? "connection is closed" : "invalid response");
+        return 1;
+    }
+
+    if (body_len > max_size) {
+        fetch_conn_fail(lssdp, conn, "response is too large");
+        return 1;
+    }
+
+    fetch_conn_done(lssdp, conn, conn->response + body_start, body_len, is_keep_alive && is_eof == false, current_time);
+    return 1;
+}
+
+static void fetch_conn_done(lssdp_ctx * lssdp, lssdp_fetch_conn * conn, const char * body, size_t body_len, bool is_keep_alive, long long current_time) {
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+    lssdp_nbr * nbr = conn->nbr;
+
+    // 1. add to cache (body is in response buffer)
+    lssdp_desc * desc = fetch_cache_find(fetcher, conn->hash, conn->key);
+    if (desc == NULL) {
+        desc = fetch_cache_add(lssdp, conn->hash, conn->key, body, body_len);
+    }
+
+    // 2. keep-alive connection is back to pool
+    if (is_keep_alive) {
+        lssdp_free(lssdp, conn->response);
+        lssdp_free(lssdp, conn->key);
+        conn->response      = NULL;
+        conn->response_len  = 0;
+        conn->response_size = 0;
+        conn->key           = NULL;
+        conn->nbr           = NULL;
+        conn->is_reused     = false;
+        conn->state         = FETCH_IDLE;
+        conn->time          = current_time;
+        lssdp->fetch.active_num--;
+    } else {
+        fetch_conn_close(lssdp, conn);
+    }
+
+    // 3. attach to neighbor (removed or changed: cached only)
+    if (nbr != NULL && desc != NULL) {
+        fetch_cache_attach(lssdp, desc, nbr);
+        fetch_neighbor_done(lssdp, nbr, LSSDP_FETCH_DONE);
+    } else if (nbr != NULL) {
+        lssdp->fetch.fail_num++;
+        fetch_neighbor_done(lssdp, nbr, LSSDP_FETCH_FAILED);
+    }
+    fetch_cache_trim(lssdp, 0);
+}
+
+static void fetch_conn_fail(lssdp_ctx * lssdp, lssdp_fetch_conn * conn, const char * reason) {
+    lssdp_nbr * nbr = conn->nbr;
+
+    // idle connection was closed by server: retry on a new connection
+    if (conn->is_reused && conn->response_len == 0 && nbr != NULL) {
+        lssdp_debug("reused connection failed (%s), retry %s\n", reason, nbr->location);
+        fetch_conn_close(lssdp, conn);
+        fetch_queue_add(lssdp->fetch.fetcher, nbr);
+        return;
+    }
+
+    lssdp_warn("fetch %s failed: %s\n", nbr != NULL ? nbr->location : conn->key, reason);
+    fetch_conn_close(lssdp, conn);
+    lssdp->fetch.fail_num++;
+    if (nbr != NULL) {
+        fetch_neighbor_done(lssdp, nbr, LSSDP_FETCH_FAILED);
+    }
+}
+
+static void fetch_conn_close(lssdp_ctx * lssdp, lssdp_fetch_conn * conn) {
+    lssdp_fetcher * fetcher = lssdp->fetch.fetcher;
+
+    // remove from connection list
+    lssdp_fetch_conn ** c = &fetcher->conn_list;
+    while (*c != conn) {
+        c = &(*c)->next;
+    }
+    *c = conn->next;
+    fetcher->conn_num--;
+
+    if (conn->state != FETCH_IDLE) {
+        lssdp->fetch.active_num--;
+    }
+
+    close(conn->fd);
+    lssdp_free(lssdp, conn->response);
+    lssdp_free(lssdp, conn->key);
+    lssdp_free(lssdp, conn);
+}
+
+static int http_response_check(lssdp_ctx * lssdp, char * response, size_t response_len, bool is_eof, size_t * body_start, size_t * body_len, bool * is_keep_alive) {
+    // return 1: complete, 0: incomplete, -1: invalid or not 200 OK
+
+    // 1. header is complete
+    const char * end = (const char *) memmem(response, response_len, "\r\n\r\n", 4);
+    if (end == NULL) {
+        return 0;
+    }
+    size_t header_len = end - response + 4;
+
+    // 2. status line "HTTP/1.x 200 OK"
+    if (header_len < 16 || strncmp(response, "HTTP/1.", 7) != 0 || response[8] != ' ') {
+        lssdp_warn("invalid HTTP status line\n");
+        return -1;
+    }
+
+    int status = atoi(response + 9);
+    if (status != 200) {
+        lssdp_warn("HTTP status is %d\n", status);
+        return -1;
+    }
+
+    // 3. connection: HTTP/1.1 is keep-alive by default
+    size_t value_len = 0;
+    const char * value = http_header_value(response, header_len, "CONNECTION", &value_len);
+    *is_keep_alive = response[7] == '1';
+    if (value != NULL && value_len == 5 && strncasecmp(value, "close", 5) == 0) {
+        *is_keep_alive = false;
+    }
+    if (value != NULL && value_len == 10 && strncasecmp(value, "keep-alive", 10) == 0) {
+        *is_keep_alive = true;
+    }
+
+    // 4. body: chunked, CONTENT-LENGTH, or until connection is closed
+    char * body = response + header_len;
+    size_t len  = response_len - header_len;
+    *body_start = header_len;
+
+    value = http_header_value(response, header_len, "TRANSFER-ENCODING", &value_len);
+    if (value != NULL && value_len >= 7 && strncasecmp(value + value_len - 7, "chunked", 7) == 0) {
+        int ret = http_chunked_decode(body, len, body_len, false);
+        if (ret == 1) {
+            http_chunked_decode(body, len, body_len, true);
+        }
+        return ret;
+    }
+
+    value = http_header_value(response, header_len, "CONTENT-LENGTH", &value_len);
+    if (value != NULL) {
+        char * digit_end;
+        unsigned long long length = strtoull(value, &digit_end, 10);
+        if (value[0] < '0' || value[0] > '9' || digit_end != value + value_len) {
+            lssdp_warn("invalid CONTENT-LENGTH\n");
+            return -1;
+        }
+        if (len < length) {
+            return 0;
+        }
+        *body_len = length;
+        return 1;
+    }
+
+    *is_keep_alive = false;
+    if (is_eof == false) {
+        return 0;
+    }
+    *body_len = len;
+    return 1;
+}
+
+static const char * http_header_value(const char * header, size_t header_len, const char * name, size_t * value_len) {
+    // header: "status line\r\nNAME: VALUE\r\n...\r\n\r\n", the value is trimmed
+    const char * end  = header + header_len;
+    const char * line = memchr(header, '\n', header_len);
+    size_t name_len   = strlen(name);
+    while (line != NULL && ++line < end) {
+        const char * line_end = memchr(line, '\n', end - line);
+        if (line_end == NULL) {
+            break;
+        }
+
+        if ((size_t) (line_end - line) > name_len && line[name_len] == ':' && strncasecmp(line, name, name_len) == 0) {
+            const char * value     = line + name_len + 1;
+            const char * value_end = line_end;
+            while (value < value_end && is_trim_char(*value)) value++;
+            while (value_end > value && is_trim_char(value_end[-1])) value_end--;
+
+            *value_len = value_end - value;
+            return value;
+        }
+        line = line_end;
+    }
+    return NULL;
+}
+
+static int http_chunked_decode(char * data, size_t len, size_t * decode_len, bool is_decode) {
+    // return 1: complete, 0: incomplete, -1: invalid; the decoded data is moved to front in place
+    size_t i = 0, out = 0;
+    for (;;) {
+        // 1. chunk size line "hex[;extension]\r\n"
+        const char * line_end = memchr(data + i, '\n', len - i);
+        if (line_end == NULL) {
+            return 0;
+        }
+
+        char c = data[i] | 0x20;
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return -1;
+        }
+        unsigned long long size = strtoull(data + i, NULL, 16);
+        i = line_end - data + 1;
+
+        // 2. last chunk, and trailer fields until empty line
+        if (size == 0) {
+            for (;;) {
+                line_end = memchr(data + i, '\n', len - i);
+                if (line_end == NULL) {
+                    return 0;
+                }
+
+                bool is_empty = line_end == data + i || (line_end == data + i + 1 && data[i] == '\r');
+                i = line_end - data + 1;
+                if (is_empty) {
+                    *decode_len = out;
+                    return 1;
+                }
+            }
+        }
+
+        // 3. chunk data and "\r\n"
+        if (size > len - i || len - i - size < 2) {
+            return 0;
+        }
+        if (is_decode) {
+            memmove(data + out, data + i, size);
+        }
+        out += size;
+        i   += size;
+        if (data[i] != '\r' || data[i + 1] != '\n') {
+            return -1;
+        }
+        i += 2;
+    }
+}
+
+static struct lssdp_interface * find_interface_in_LAN(lssdp_ctx * lssdp, const struct sockaddr * address) {
+    struct lssdp_interface * ifc;
+    size_t i, j;
     for (i = 0; i < lssdp->interface_num; i++) {
         ifc = &lssdp->interface[i];
+        if (ifc->family != address->sa_family) {
+            continue;
+        }
+
+        // IPv4: mask address to check whether the interface is under the same Local Network Area or not
+        if (ifc->family == AF_INET) {
+            uint32_t addr = ((const struct sockaddr_in *) address)->sin_addr.s_addr;
+            if ((ifc->addr & ifc->netmask) == (addr & ifc->netmask)) {
+                return ifc;
+            }
+            continue;
+        }
+
+        // IPv6 link-local: the interface which received the packet (scope id)
+        const struct sockaddr_in6 * addr6 = (const struct sockaddr_in6 *) address;
+        if (IN6_IS_ADDR_LINKLOCAL(&addr6->sin6_addr)) {
+            if (is_link_local_interface(ifc) && ifc->index == addr6->sin6_scope_id) {
+                return ifc;
+            }
+            continue;
+        }
 
-        // mask address to check whether the interface is under the same Local Network Area or not
-        if ((ifc->addr & ifc->netmask) == (address & ifc->netmask)) {
+        // IPv6: mask address with prefix
+        const uint8_t * addr = (const uint8_t *) &addr6->sin6_addr;
+        for (j = 0; j < 16; j++) {
+            if ((ifc->addr6[j] & ifc->netmask6[j]) != (addr[j] & ifc->netmask6[j])) {
+                break;
+            }
+        }
+        if (j == 16) {
             return ifc;
         }
     }
     return NULL;
 }
+
+static bool is_self_address(lssdp_ctx * lssdp, const struct sockaddr * address) {
+    size_t i;
+    for (i = 0; i < lssdp->interface_num; i++) {
+        struct lssdp_interface * ifc = &lssdp->interface[i];
+        if (ifc->family != address->sa_family) {
+            continue;
+        }
+
+        if (ifc->family == AF_INET) {
+            if (ifc->addr == ((const struct sockaddr_in *) address)->sin_addr.s_addr) {
+                return true;
+            }
+        } else {
+            if (memcmp(ifc->addr6, &((const struct sockaddr_in6 *) address)->sin6_addr, 16) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
@@ -3,6 +3,23 @@
 
 #include <stdbool.h>  // bool, true, false
 #include <stdint.h>   // uint32_t
+#include <stddef.h>   // size_t
+#include <sys/select.h> // fd_set
+
+/* Build Profile: -DLSSDP_PROFILE_EMBEDDED or -DLSSDP_PROFILE_SERVER (make PROFILE=embedded | server)
+ *  - the application must be compiled with the same flags as lssdp.c (struct layout)
+ *  - each setting of LSSDP_PROFILE_SELECT can be overridden by -D, e.g. -DLSSDP_FIELD_LEN=96
+ */
+#if defined(LSSDP_PROFILE_EMBEDDED)
+#define LSSDP_PROFILE_NAME                              "embedded"
+#define LSSDP_PROFILE_SELECT(embedded, standard, server) embedded
+#elif defined(LSSDP_PROFILE_SERVER)
+#define LSSDP_PROFILE_NAME                              "server"
+#define LSSDP_PROFILE_SELECT(embedded, standard, server) server
+#else
+#define LSSDP_PROFILE_NAME                              "default"
+#define LSSDP_PROFILE_SELECT(embedded, standard, server) standard
+#endif
 
 // LSSDP Log Level
 enum LSSDP_LOG {
@@ -12,40 +29,245 @@ enum LSSDP_LOG {
     LSSDP_LOG_ERROR = 1 << 3
 };
 
+/* Neighbor Index */
+enum LSSDP_NBR_INDEX {
+    LSSDP_NBR_INDEX_USN = 0,                                // indexed by usn
+    LSSDP_NBR_INDEX_LOCATION,                               // indexed by location
+    LSSDP_NBR_INDEX_KEY,                                    // indexed by identity key (lssdp.neighbor_key)
+    LSSDP_NBR_INDEX_DATAGRAM,                               // indexed by hash of the last datagram (change suppression)
+    LSSDP_NBR_INDEX_SOURCE,                                 // indexed by source ip (per-source quota)
+    LSSDP_NBR_INDEX_DEVICE_TYPE,                            // indexed by device_type (query, empty is not indexed)
+    LSSDP_NBR_INDEX_SM_ID,                                  // indexed by sm_id (query, empty is not indexed)
+    LSSDP_NBR_INDEX_INTERFACE,                              // indexed by source interface (query, empty is not indexed)
+    LSSDP_NBR_INDEX_FIELD_NUM                               // index number of lssdp_neighbor_query
+};
+
+// 0: device_type, sm_id and interface are not indexed, lssdp_neighbor_query scans neighbor list
+#ifndef LSSDP_NBR_QUERY_INDEX
+#define LSSDP_NBR_QUERY_INDEX   LSSDP_PROFILE_SELECT(0, 1, 1)
+#endif
+#define LSSDP_NBR_INDEX_NUM     (LSSDP_NBR_QUERY_INDEX ? LSSDP_NBR_INDEX_FIELD_NUM : LSSDP_NBR_INDEX_DEVICE_TYPE)   // index maintained by library
+
+/* Neighbor Identity Key */
+enum LSSDP_NBR_KEY {
+    LSSDP_NBR_KEY_LOCATION = 0,                             // location (default)
+    LSSDP_NBR_KEY_USN,                                      // usn, location is updated when neighbor is moved
+    LSSDP_NBR_KEY_USN_ST,                                   // usn + search target
+    LSSDP_NBR_KEY_CUSTOM                                    // key of neighbor_key_callback
+};
+#define LSSDP_NBR_KEY_LEN       256                         // max length of custom key
+
+/* Neighbor Eviction Policy (when neighbor table or source quota is full) */
+enum LSSDP_NBR_EVICT {
+    LSSDP_NBR_EVICT_REJECT = 0,                             // reject the new neighbor (default)
+    LSSDP_NBR_EVICT_LRU,                                    // evict the least recently received neighbor (the oldest update_time)
+    LSSDP_NBR_EVICT_DEADLINE = LSSDP_NBR_EVICT_LRU          // the same: neighbor_timeout is the same for all neighbors, LRU is the closest to timeout
+};
+
+/* Latency Stage of received packet (latency_trace) */
+enum LSSDP_LATENCY {
+    LSSDP_LATENCY_QUEUE = 0,                                // kernel receive timestamp -> read by library (socket only)
+    LSSDP_LATENCY_PARSE,                                    // packet parser
+    LSSDP_LATENCY_UPDATE,                                   // neighbor list update, not include callback
+    LSSDP_LATENCY_CALLBACK,                                 // neighbor_list_changed_callback
+    LSSDP_LATENCY_TOTAL,                                    // kernel receive timestamp -> neighbor_list_changed_callback is invoked
+    LSSDP_LATENCY_NUM
+};
+#define LSSDP_LATENCY_BUCKET_NUM    40                      // log2 buckets of nanoseconds, up to 2^40 ns (18 minutes)
+
+// 0: latency_trace and stats.latency are compiled out, lssdp_latency_percentile returns -1
+#ifndef LSSDP_LATENCY_TRACE
+#define LSSDP_LATENCY_TRACE     LSSDP_PROFILE_SELECT(0, 1, 1)
+#endif
+
+/* Description Fetch Status of neighbor (fetch.enable) */
+enum LSSDP_FETCH {
+    LSSDP_FETCH_NONE = 0,                                   // not fetched
+    LSSDP_FETCH_PENDING,                                    // waiting in queue, or in flight
+    LSSDP_FETCH_DONE,                                       // description is fetched (or found in cache)
+    LSSDP_FETCH_FAILED                                      // failed: connect, HTTP status, timeout, too large, not IP address
+};
+
 /* Struct : lssdp_nbr */
-#define LSSDP_FIELD_LEN         128
-#define LSSDP_LOCATION_LEN      256
+#ifndef LSSDP_FIELD_LEN
+#define LSSDP_FIELD_LEN         LSSDP_PROFILE_SELECT(64, 128, 128)
+#endif
+#ifndef LSSDP_LOCATION_LEN
+#define LSSDP_LOCATION_LEN      LSSDP_PROFILE_SELECT(128, 256, 256)
+#endif
+#define LSSDP_INTERFACE_NAME_LEN    16                      // IFNAMSIZ
+#define LSSDP_IP_LEN                46                      // INET6_ADDRSTRLEN
 typedef struct lssdp_nbr {
-    char            usn         [LSSDP_FIELD_LEN];          // Unique Service Name (Device Name or MAC)
-    char            location    [LSSDP_LOCATION_LEN];       // URL or IP(:Port)
+    const char *    usn;                                    // Unique Service Name (Device Name or MAC)
+    const char *    location;                               // URL or IP(:Port)
+    const char *    st;                                     // Search Target (ST / NT)
 
     /* Additional SSDP Header Fields */
-    char            sm_id       [LSSDP_FIELD_LEN];
-    char            device_type [LSSDP_FIELD_LEN];
+    const char *    sm_id;
+    const char *    device_type;
     long long       update_time;
     struct lssdp_nbr * next;
+
+    /* Received Header Fields (full length, the fields above point to the values, "" if not received) */
+    char *          header;                                 // "NAME\0VALUE\0NAME\0VALUE\0...", see lssdp_neighbor_header
+    size_t          header_len;                             // header length
+
+    /* Source */
+    int             family;                                 // AF_INET or AF_INET6
+    char            ip          [LSSDP_IP_LEN];             // source IP
+    char            interface   [LSSDP_INTERFACE_NAME_LEN]; // interface in the same LAN (empty: not found)
+
+    /* Subscription */
+    struct lssdp_subscription * subscription;               // matched subscription (NULL: header.search_target)
+    struct lssdp_nbr * subscription_next;                   // next neighbor of the same subscription
+
+    /* Description (fetch.enable) */
+    const char *    description;                            // body of location, e.g. device description XML, null-terminated (NULL: not fetched)
+    size_t          description_len;                        // description length
+    int             description_status;                     // LSSDP_FETCH_*
+
+    /* List and Index Links (maintained by library) */
+    struct lssdp_nbr * prev;                                // previous neighbor in list
+    struct lssdp_nbr * subscription_prev;                   // previous neighbor of the same subscription
+    uint32_t           index_hash[LSSDP_NBR_INDEX_NUM];     // hash of each index key
+    struct lssdp_nbr * index_next[LSSDP_NBR_INDEX_NUM];     // next neighbor in the same index bucket
+    struct lssdp_nbr **index_pprev[LSSDP_NBR_INDEX_NUM];    // link to this neighbor in index bucket (NULL: not indexed)
+    size_t             shm_slot;                            // slot + 1 in shared memory table (0: not published)
+    struct lssdp_nbr * shm_overflow_next;                   // next neighbor waiting for a free slot (table is full)
+    struct lssdp_nbr **shm_overflow_pprev;                  // link to this neighbor in overflow list (NULL: not waiting)
+    uint64_t           datagram_hash;                       // hash of the last datagram and its source IP (0: none)
+    size_t             datagram_len;                        // length of the last datagram
+    uint32_t           match_generation;                    // lssdp.match_generation when search target was matched
+    struct lssdp_nbr * age_prev;                            // previous neighbor in age list (older)
+    struct lssdp_nbr * age_next;                            // next neighbor in age list (newer)
+    long long          probe_time;                          // last unicast M-SEARCH probe time (0: not probed)
+    struct lssdp_nbr * probe_next;                          // next neighbor in probe wait list (probed later)
+    struct lssdp_nbr **probe_pprev;                         // link to this neighbor in probe wait list (NULL: not waiting)
+    struct lssdp_nbr * fetch_prev;                          // previous neighbor in fetch queue
+    struct lssdp_nbr * fetch_next;                          // next neighbor in fetch queue
+    struct lssdp_desc * description_cache;                  // description cache entry (reference)
+    uint32_t           description_key;                     // hash of description key: uuid of usn, BOOTID.UPNP.ORG, CONFIGID.UPNP.ORG
 } lssdp_nbr;
 
+/* Struct : lssdp_nbr_iter (lssdp_neighbor_query) */
+typedef struct lssdp_nbr_iter {
+    int             index;                                  // LSSDP_NBR_INDEX_*
+    const char *    value;                                  // queried value (referenced, not copied)
+    uint32_t        hash;                                   // hash of value
+    bool            is_scan;                                // value is not indexed: scan neighbor list
+    lssdp_nbr *     next;                                   // next candidate
+} lssdp_nbr_iter;
+
+
+/* Struct : lssdp_shm_nbr (neighbor in shared memory table, fixed size, longer value is truncated) */
+typedef struct lssdp_shm_nbr {
+    char            usn         [LSSDP_FIELD_LEN];
+    char            location    [LSSDP_LOCATION_LEN];
+    char            st          [LSSDP_FIELD_LEN];
+    char            sm_id       [LSSDP_FIELD_LEN];
+    char            device_type [LSSDP_FIELD_LEN];
+    int64_t         update_time;                            // milliseconds
+    int32_t         family;                                 // AF_INET or AF_INET6
+    char            ip          [LSSDP_IP_LEN];
+    char            interface   [LSSDP_INTERFACE_NAME_LEN];
+} lssdp_shm_nbr;
+
+
+/* Struct : lssdp_shm_reader */
+typedef struct lssdp_shm_reader {
+    const struct lssdp_shm_table * table;                   // read-only mapping of shared memory table
+    size_t          size;                                   // mapping size
+} lssdp_shm_reader;
+
+
+/* Struct : lssdp_subscription */
+#define LSSDP_SUBSCRIPTION_TABLE_SIZE   64                  // subscription table buckets (indexed by search target)
+typedef struct lssdp_subscription {
+    char            search_target [LSSDP_FIELD_LEN];        // exact "urn:a:b:c", or prefix "urn:a:*"
+    size_t          prefix_len;                             // compared length of search_target (without '*')
+    bool            is_prefix;                              // search_target is end with '*'
+    size_t          neighbor_num;                           // neighbor number of this subscription
+    lssdp_nbr *     neighbor_list;                          // neighbors of this subscription
+    struct lssdp_subscription * next;                       // subscription list (subscribed order)
+    struct lssdp_subscription * hash_next;                  // next subscription in the same table bucket
+} lssdp_subscription;
+
+
+/* Struct : lssdp_service */
+#define LSSDP_SERVICE_TABLE_SIZE    64                      // service table buckets (indexed by search target)
+typedef struct lssdp_service {
+    char            search_target       [LSSDP_FIELD_LEN];  // Search Target (ST / NT)
+    char            unique_service_name [LSSDP_FIELD_LEN];  // Unique Service Name
+
+    /* Additional SSDP Header Fields */
+    char            sm_id       [LSSDP_FIELD_LEN];
+    char            device_type [LSSDP_FIELD_LEN];
+    struct lssdp_service * next;                            // service list (registration order)
+    struct lssdp_service * hash_next;                       // next service in the same table bucket
+} lssdp_service;
+
 
 /* Struct : lssdp_ctx */
-#define LSSDP_INTERFACE_NAME_LEN    16                      // IFNAMSIZ
-#define LSSDP_INTERFACE_LIST_SIZE   16
-#define LSSDP_IP_LEN                16
+#ifndef LSSDP_INTERFACE_LIST_SIZE
+#define LSSDP_INTERFACE_LIST_SIZE   LSSDP_PROFILE_SELECT(4, 16, 64)
+#endif
+#define LSSDP_SHM_NAME_LEN          64
+#define LSSDP_NETNS_LEN             128
 typedef struct lssdp_ctx {
-    int             sock;                                   // SSDP socket
+    int             sock;                                   // SSDP socket (IPv4)
+    int             sock6;                                  // SSDP socket (IPv6), created when ipv6 is true
     unsigned short  port;                                   // SSDP port (0x0000 ~ 0xFFFF)
+    bool            ipv6;                                   // enable IPv6 SSDP (ff02::c, ff05::c)
+    char            netns       [LSSDP_NETNS_LEN];          // network namespace of sockets and interfaces (Linux): name in /var/run/netns, or path (empty: current)
+    int             netns_fd;                               // opened network namespace, kept until lssdp_socket_close / lssdp_ctx_free (maintained by library)
+    int             recv_buffer_size;                       // SO_RCVBUF of SSDP socket (bytes, 0: system default), SO_RCVBUFFORCE if permitted
+    int             send_buffer_size;                       // SO_SNDBUF of SSDP and multicast sockets (bytes, 0: system default), SO_SNDBUFFORCE if permitted
     lssdp_nbr *     neighbor_list;                          // SSDP neighbor list
+    lssdp_nbr *     neighbor_last;                          // the last neighbor of list (maintained by library)
+    size_t          neighbor_num;                           // SSDP neighbor number
+    struct lssdp_nbr_index {
+        size_t      size;                                   // bucket number
+        lssdp_nbr **table;                                  // buckets
+    } neighbor_index[LSSDP_NBR_INDEX_NUM];                  // SSDP neighbor hash index (maintained by library)
     long            neighbor_timeout;                       // milliseconds
+    int             neighbor_key;                           // identity key of neighbor: LSSDP_NBR_KEY_*, set before neighbor is added
+    lssdp_nbr *     neighbor_age_list;                      // neighbors from the least recently received, sorted by update_time after load (maintained by library)
+    lssdp_nbr *     neighbor_age_last;                      // the newest neighbor (maintained by library)
+
+    /* Neighbor Table Bound (0: unlimited) */
+    size_t          neighbor_max;                           // max neighbor number
+    size_t          neighbor_memory_max;                    // max memory of neighbors and description cache (bytes)
+    size_t          neighbor_source_max;                    // max neighbor number of a source ip
+    int             neighbor_eviction;                      // eviction policy: LSSDP_NBR_EVICT_*
+    size_t          neighbor_memory;                        // memory of neighbors and description cache (maintained by library)
+    size_t          neighbor_evict_num;                     // evicted neighbor number (maintained by library)
+    size_t          neighbor_reject_num;                    // rejected neighbor number (maintained by library)
+
+    /* Neighbor Probe (lssdp_neighbor_probe) */
+    long            neighbor_probe_time;                    // probe the neighbor in this time before timeout (ms, 0: disabled)
+    size_t          neighbor_probe_max;                     // max probe number of each call (0: unlimited)
+    size_t          neighbor_probe_num;                     // sent probe number (maintained by library)
+    lssdp_nbr *     neighbor_probe_next;                    // the oldest neighbor in age list which is not probed since update (maintained by library)
+    lssdp_nbr *     neighbor_probe_wait;                    // probed neighbors waiting for RESPONSE, from the earliest probe (maintained by library)
+    lssdp_nbr **    neighbor_probe_wait_tail;               // link to append the next probed neighbor (maintained by library)
     bool            debug;                                  // show debug log
 
+    /* Latency Trace */
+    bool            latency_trace;                          // record latency of each stage to stats.latency
+    long long       packet_time_ns;                         // kernel receive time of the packet being handled (ns, 0: unknown), e.g. in callbacks (maintained by library)
+
     /* Network Interface */
     size_t          interface_num;                          // interface number
     struct lssdp_interface {
         char        name        [LSSDP_INTERFACE_NAME_LEN]; // name[16]
-        char        ip          [LSSDP_IP_LEN];             // ip[16] = "xxx.xxx.xxx.xxx"
-        uint32_t    addr;                                   // address in network byte order
-        uint32_t    netmask;                                // mask in network byte order
-    } interface[LSSDP_INTERFACE_LIST_SIZE];                 // interface[16]
+        char        ip          [LSSDP_IP_LEN];             // ip[46] = "xxx.xxx.xxx.xxx" or "xxxx::xxxx"
+        int         family;                                 // AF_INET or AF_INET6
+        unsigned int index;                                 // interface index (IPv6 scope id)
+        uint32_t    addr;                                   // IPv4 address in network byte order
+        uint32_t    netmask;                                // IPv4 mask in network byte order
+        uint8_t     addr6       [16];                       // IPv6 address in network byte order
+        uint8_t     netmask6    [16];                       // IPv6 mask in network byte order
+    } interface[LSSDP_INTERFACE_LIST_SIZE];                 // interface[16] (build profile: 4 / 16 / 64)
 
     /* SSDP Header Fields */
     struct {
@@ -58,15 +280,97 @@ typedef struct lssdp_ctx {
             char    suffix              [LSSDP_FIELD_LEN];  // URI or Port: "/index.html" or ":80"
         } location;
 
+        int         max_age;                                // CACHE-CONTROL max-age (seconds, 0: 120)
+
         /* Additional SSDP Header Fields */
         char        sm_id       [LSSDP_FIELD_LEN];
         char        device_type [LSSDP_FIELD_LEN];
     } header;
 
+    /* Announce Scheduler (lssdp_announce) */
+    struct {
+        long        msearch_min;                            // initial M-SEARCH interval (ms, 0: 2 seconds)
+        long        msearch_max;                            // max M-SEARCH interval of backoff (ms, 0: 5 minutes)
+        long long   notify_time;                            // next NOTIFY time (maintained by library)
+        long long   msearch_time;                           // next M-SEARCH time (maintained by library)
+        long        msearch_interval;                       // current M-SEARCH interval (maintained by library)
+        size_t      burst;                                  // remaining NOTIFY of initial burst (maintained by library)
+        size_t      neighbor_num;                           // neighbor number of last M-SEARCH (maintained by library)
+        uint32_t    header_hash;                            // hash of header (0: re-announce) (maintained by library)
+        unsigned int seed;                                  // random seed of jitter (maintained by library)
+    } announce;
+
+    /* Advertised Services (in addition to header) */
+    size_t          service_num;                            // registered service number
+    lssdp_service * service_list;                           // registered services
+    lssdp_service * service_table[LSSDP_SERVICE_TABLE_SIZE];// services indexed by search target
+
+    /* Search Target Subscriptions (in addition to header.search_target) */
+    size_t               subscription_num;                  // subscription number
+    lssdp_subscription * subscription_list;                 // subscriptions
+    lssdp_subscription * subscription_table[LSSDP_SUBSCRIPTION_TABLE_SIZE];    // indexed by search target (prefix)
+    uint32_t             subscription_prefix_mask[(LSSDP_FIELD_LEN + 31) / 32]; // bit n: a prefix of length n is subscribed
+    uint32_t             match_generation;                  // changed with subscriptions and header.search_target (maintained by library)
+    uint32_t             match_hash;                        // hash of header.search_target of match_generation
+
+    /* Shared Memory Neighbor Table (maintained by library) */
+    struct lssdp_shm {
+        char        name        [LSSDP_SHM_NAME_LEN];       // POSIX shared memory name, e.g. "/lssdp"
+        size_t      size;                                   // mapping size
+        struct lssdp_shm_table * table;                     // NULL: not published
+        lssdp_nbr ** slot;                                  // neighbor of each slot
+        lssdp_nbr *  overflow_list;                         // neighbors waiting for a free slot (table is full)
+    } shm;
+
+    /* Description Fetcher (lssdp_fetch_process) */
+    struct {
+        bool        enable;                                 // fetch location of each neighbor by HTTP/1.1 GET (non-blocking)
+        size_t      concurrency;                            // max in-flight requests (0: 8)
+        long        timeout;                                // timeout of request (ms, 0: 5 seconds)
+        size_t      max_size;                               // max description size (bytes, 0: 64 KB)
+        size_t      cache_max;                              // max cached descriptions which are not used by neighbors (0: 256)
+        struct lssdp_fetcher * fetcher;                     // connection pool, queue and cache (maintained by library)
+        size_t      active_num;                             // in-flight requests (maintained by library)
+        size_t      request_num;                            // sent requests (maintained by library)
+        size_t      connect_num;                            // opened connections, request_num - connect_num are reused (maintained by library)
+        size_t      cache_hit_num;                          // descriptions found in cache (maintained by library)
+        size_t      fail_num;                               // failed requests (maintained by library)
+    } fetch;
+
+    /* Allocator of neighbors, services, subscriptions and buffers (NULL: libc), set all hooks or none before use */
+    struct {
+        void * (* malloc)  (void * opaque, size_t size);
+        void * (* realloc) (void * opaque, void * ptr, size_t size);
+        void   (* free)    (void * opaque, void * ptr);
+        void *    opaque;                                   // passed to allocator, e.g. memory pool of the context
+    } allocator;
+
+    /* Statistics (maintained by library) */
+    struct lssdp_stats {
+        size_t      packet_recv_num;                        // received SSDP packets (socket, replay, ingest)
+        size_t      packet_self_num;                        // received SSDP packets sent by self (ignored)
+        size_t      packet_invalid_num;                     // received SSDP packets failed to parse
+        size_t      packet_send_num;                        // sent SSDP packets
+        size_t      packet_send_error_num;                  // SSDP packets failed to send
+        size_t      packet_drop_num;                        // SSDP packets dropped by kernel, receive buffer is full (SO_RXQ_OVFL)
+        uint32_t    drop_counter[2];                        // the last SO_RXQ_OVFL counter of sock, sock6
+#if LSSDP_LATENCY_TRACE
+        struct lssdp_latency {
+            size_t      num;                                // sample number
+            long long   sum;                                // total latency (ns)
+            long long   max;                                // max latency (ns)
+            size_t      bucket[LSSDP_LATENCY_BUCKET_NUM];   // bucket n: [2^n, 2^(n+1)) ns
+        } latency[LSSDP_LATENCY_NUM];                       // latency histogram of each stage: LSSDP_LATENCY_* (latency_trace)
+#endif
+    } stats;
+
     /* Callback Function */
+    void (* log_callback) (struct lssdp_ctx * lssdp, const char * file, const char * tag, int level, int line, const char * func, const char * message);   // NULL: lssdp_set_log_callback
     int (* network_interface_changed_callback) (struct lssdp_ctx * lssdp);
     int (* neighbor_list_changed_callback)     (struct lssdp_ctx * lssdp);
     int (* packet_received_callback)           (struct lssdp_ctx * lssdp, const char * packet, size_t packet_len);
+    int (* description_fetched_callback)       (struct lssdp_ctx * lssdp, lssdp_nbr * nbr);   // fetch is done or failed (nbr.description_status)
+    int (* neighbor_key_callback)              (struct lssdp_ctx * lssdp, const lssdp_nbr * nbr, char * key, size_t key_len);  // LSSDP_NBR_KEY_CUSTOM: write key, return < 0 to use location
 
 } lssdp_ctx;
 
@@ -78,6 +382,10 @@ typedef struct lssdp_ctx {
  *
  * Note:
  *  - lssdp.interface, lssdp.interface_num will be updated.
+ *  - IPv6 addresses are included when lssdp.ipv6 is true.
+ *  - if interface is changed, SSDP socket joins / drops multicast group on the added / removed
+ *    interfaces (no re-bind), and the neighbors of the removed interfaces are removed.
+ *  - if lssdp.netns is set, the interfaces of the network namespace are listed.
  *
  * @param lssdp
  * @return = 0      success
@@ -94,6 +402,14 @@ int lssdp_network_interface_update(lssdp_ctx * lssdp);
  *  - SSDP port must be setup ready before call this function. (lssdp.port > 0)
  *  - if SSDP socket is already exist (lssdp.sock > 0),
  *    the socket will be closed, and create a new one.
+ *  - multicast group (239.255.255.250) is joined on each interface.
+ *  - if lssdp.ipv6 is true, lssdp.sock6 is also created, and joins ff02::c and ff05::c
+ *    on each IPv6 interface.
+ *  - the socket is kept when interface is changed, it is not necessary to re-create it.
+ *  - if lssdp.netns is set, the sockets (and the sockets to send NOTIFY / M-SEARCH) are created in
+ *    the network namespace (setns on the calling thread, CAP_SYS_ADMIN is required), the thread
+ *    returns to its own network namespace after that. The namespace is opened once (lssdp.netns_fd).
+ *    If the thread cannot return, the call fails.
  *  - SSDP neighbor list will be force clean up.
  *
  * @param lssdp
@@ -109,6 +425,7 @@ int lssdp_socket_create(lssdp_ctx * lssdp);
  *
  * Note:
  *  - if SSDP socket <= 0, will be ignore, and lssdp.sock will be set to -1.
+ *  - NOTIFY ssdp:byebye of header and every registered service is sent before closing.
  *  - SSDP neighbor list will be force clean up.
  *
  * @param lssdp
@@ -122,14 +439,26 @@ int lssdp_socket_close(lssdp_ctx * lssdp);
  *
  * read SSDP socket.
  *
+ * 0. one packet is read from each of lssdp.sock and lssdp.sock6 which is readable.
  * 1. if read success, packet_received_callback will be invoked.
- * 2. if received SSDP packet is match to Search Target (lssdp.header.search_target),
- *     - M-SEARCH: send RESPONSE back
- *     - NOTIFY/RESPONSE: add/update to SSDP neighbor list
+ * 2. if received M-SEARCH is match to an advertised service, send RESPONSE back
+ * 3. if received NOTIFY/RESPONSE is match to Search Target (lssdp.header.search_target)
+ *    or a subscription, add/update to SSDP neighbor list
+ *     - NOTIFY ssdp:byebye: remove the neighbors of the USN immediately
+ *     - NOTIFY ssdp:update: handled as ssdp:alive
+ *     - neighbor is identified by lssdp.neighbor_key, if the location / source of a known neighbor
+ *       is changed (moved), the neighbor is updated in place
+ *     - if the packet is the same as the last one of a neighbor from the same source IP,
+ *       only update_time is refreshed (packet is not parsed)
+ *     - if neighbor table is full (neighbor_max, neighbor_memory_max, neighbor_source_max),
+ *       a neighbor is evicted, or the new neighbor is rejected (neighbor_eviction)
  *
  * Note:
  *  - SSDP socket and port must be setup ready before call this function. (sock, port > 0)
  *  - if SSDP neighbor list has been changed, neighbor_list_changed_callback will be invoked.
+ *  - neighbor update_time is the kernel receive timestamp of packet (SO_TIMESTAMPNS), or current time if it is not supported.
+ *    The timestamp (ns) is also lssdp.packet_time_ns in callbacks.
+ *  - packets dropped by kernel since the last read are counted in stats.packet_drop_num (SO_RXQ_OVFL).
  *
  * @param lssdp
  * @return = 0      success
@@ -140,9 +469,11 @@ int lssdp_socket_read(lssdp_ctx * lssdp);
 /*
  * 05. lssdp_send_msearch
  *
- * send SSDP M-SEARCH packet to multicast address (239.255.255.250)
+ * send SSDP M-SEARCH packet to multicast address (239.255.255.250, IPv6: ff02::c / ff05::c)
  *
  * Note:
+ *  - one M-SEARCH is sent for header.search_target and each exact subscription,
+ *    and one "ssdp:all" M-SEARCH if any prefix subscription exists.
  *  - SSDP port must be setup ready before call this function. (lssdp.port > 0)
  *
  * @param lssdp
@@ -154,7 +485,7 @@ int lssdp_send_msearch(lssdp_ctx * lssdp);
 /*
  * 06. lssdp_send_notify
  *
- * send SSDP NOTIFY packet to multicast address (239.255.255.250)
+ * send SSDP NOTIFY packet to multicast address (239.255.255.250, IPv6: ff02::c / ff05::c)
  *
  * Note:
  *  - SSDP port must be setup ready before call this function. (lssdp.port > 0)
@@ -185,8 +516,493 @@ int lssdp_neighbor_check_timeout(lssdp_ctx * lssdp);
  *
  * setup SSDP log callback. All SSDP library log will be forward to here.
  *
+ * Note:
+ *  - this is the default log of process, lssdp.log_callback of context is used if it is set.
+ *  - set it once before the contexts are used by threads.
+ *
  * @param callback
  */
 void lssdp_set_log_callback(void (* callback)(const char * file, const char * tag, int level, int line, const char * func, const char * message));
 
+/*
+ * 09. lssdp_service_add
+ *
+ * add a service to the advertised service registry.
+ *
+ * Note:
+ *  - service.search_target must not be empty.
+ *  - if a service with the same search_target and unique_service_name
+ *    is already registered, it will be updated.
+ *  - lssdp_send_notify sends NOTIFY of header and every registered service.
+ *  - M-SEARCH is answered for each service matching its ST ("ssdp:all" matches all).
+ *
+ * @param lssdp
+ * @param service   (next and hash_next are ignored)
+ * @return = 0      success
+ *         < 0      failed
+ */
+int lssdp_service_add(lssdp_ctx * lssdp, const lssdp_service * service);
+
+/*
+ * 10. lssdp_service_remove
+ *
+ * remove the service from the advertised service registry.
+ *
+ * @param lssdp
+ * @param search_target
+ * @param unique_service_name
+ * @return = 0      success
+ *         < 0      failed (service is not found)
+ */
+int lssdp_service_remove(lssdp_ctx * lssdp, const char * search_target, const char * unique_service_name);
+
+/*
+ * 11. lssdp_service_remove_all
+ *
+ * remove all services from the advertised service registry.
+ *
+ * @param lssdp
+ * @return = 0      success
+ *         < 0      failed
+ */
+int lssdp_service_remove_all(lssdp_ctx * lssdp);
+
+/*
+ * 12. lssdp_subscription_add
+ *
+ * subscribe a search target for discovery.
+ *
+ * Note:
+ *  - search_target ending with '*' is a prefix, e.g. "urn:schemas-upnp-org:device:*"
+ *  - received NOTIFY/RESPONSE is matched to the exact subscription first,
+ *    then header.search_target, then the longest prefix subscription.
+ *  - matched neighbor is tagged by nbr.subscription, and also linked
+ *    in subscription.neighbor_list.
+ *
+ * @param lssdp
+ * @param search_target
+ * @return = 0      success (or already subscribed)
+ *         < 0      failed
+ */
+int lssdp_subscription_add(lssdp_ctx * lssdp, const char * search_target);
+
+/*
+ * 13. lssdp_subscription_remove
+ *
+ * unsubscribe the search target.
+ *
+ * Note:
+ *  - the neighbors of this subscription will be removed.
+ *  - if SSDP neighbor list has been changed, neighbor_list_changed_callback will be invoked.
+ *
+ * @param lssdp
+ * @param search_target
+ * @return = 0      success
+ *         < 0      failed (subscription is not found)
+ */
+int lssdp_subscription_remove(lssdp_ctx * lssdp, const char * search_target);
+
+/*
+ * 14. lssdp_subscription_remove_all
+ *
+ * unsubscribe all search targets, and remove their neighbors.
+ *
+ * @param lssdp
+ * @return = 0      success
+ *         < 0      failed
+ */
+int lssdp_subscription_remove_all(lssdp_ctx * lssdp);
+
+/*
+ * 15. lssdp_send_byebye
+ *
+ * send SSDP NOTIFY ssdp:byebye packet of header and every registered service
+ * to multicast address (239.255.255.250)
+ *
+ * Note:
+ *  - SSDP port must be setup ready before call this function. (lssdp.port > 0)
+ *  - lssdp_socket_close sends ssdp:byebye automatically.
+ *
+ * @param lssdp
+ * @return = 0      success
+ *         < 0      failed
+ */
+int lssdp_send_byebye(lssdp_ctx * lssdp);
+
+/*
+ * 16. lssdp_pcap_replay
+ *
+ * replay recorded SSDP packets of pcap / pcapng file.
+ *
+ * UDP payload of SSDP port (lssdp.port) is fed to the same path as lssdp_socket_read
+ * (self-filter, parser, neighbor list update, RESPONSE of M-SEARCH).
+ *
+ * Note:
+ *  - link type: Ethernet (VLAN), Linux cooked (SLL, SLL2), NULL/LOOP, RAW IPv4/IPv6.
+ *  - fragmented IP packet is ignored.
+ *  - RESPONSE is not sent if SSDP socket has not been setup.
+ *  - neighbor update_time is the replay time, not the recorded timestamp.
+ *
+ * @param lssdp
+ * @param file          pcap / pcapng file path
+ * @param is_realtime   true: replay at recorded pace, false: as fast as possible
+ * @return >= 0     replayed SSDP packet number
+ *         < 0      failed
+ */
+int lssdp_pcap_replay(lssdp_ctx * lssdp, const char * file, bool is_realtime);
+
+struct sockaddr;    // <sys/socket.h>
+
+/*
+ * 17. lssdp_ingest
+ *
+ * ingest a SSDP packet which is received by caller.
+ *
+ * The packet is fed to the same path as lssdp_socket_read
+ * (self-filter, parser, neighbor list update, RESPONSE of M-SEARCH).
+ *
+ * Note:
+ *  - buffer is not copied, and is not necessary to be null-terminated.
+ *  - packet_received_callback will be invoked with the buffer.
+ *  - timestamp older than the newest neighbor update_time is clamped to it (neighbors are kept in update_time order).
+ *  - RESPONSE is sent by lssdp.sock / lssdp.sock6, it is not sent if SSDP socket has not been setup.
+ *
+ * @param lssdp
+ * @param buffer        SSDP packet
+ * @param buffer_len    SSDP packet length
+ * @param address       source address (struct sockaddr_in or struct sockaddr_in6)
+ * @param timestamp     receive time in milliseconds (neighbor update_time), <= 0 is current time
+ * @return = 0      success
+ *         < 0      failed: invalid argument, packet sent by self, malformed packet, or neighbor is rejected (table is full)
+ */
+int lssdp_ingest(lssdp_ctx * lssdp, const char * buffer, size_t buffer_len, const struct sockaddr * address, long long timestamp);
+
+typedef struct lssdp_ingest_packet {
+    const char *            buffer;                         // SSDP packet
+    size_t                  buffer_len;                     // SSDP packet length
+    const struct sockaddr * address;                        // source address
+    long long               timestamp;                      // receive time in milliseconds, <= 0 is current time
+} lssdp_ingest_packet;
+
+/*
+ * 18. lssdp_ingest_batch
+ *
+ * ingest SSDP packets, same as lssdp_ingest for each packet.
+ *
+ * @param lssdp
+ * @param packets       packet array
+ * @param packet_num    packet number
+ * @return >= 0     ingested packet number, the packets failed in lssdp_ingest (e.g. self, malformed) are not counted
+ *         < 0      failed
+ */
+int lssdp_ingest_batch(lssdp_ctx * lssdp, const lssdp_ingest_packet * packets, size_t packet_num);
+
+/*
+ * 19. lssdp_neighbor_save
+ *
+ * save SSDP neighbor list to snapshot file (compact binary format).
+ *
+ * Note:
+ *  - snapshot is written to "<file>.tmp", then renamed to file.
+ *  - call it periodically or before shutdown, and lssdp_neighbor_load at startup.
+ *
+ * @param lssdp
+ * @param file          snapshot file path
+ * @return = 0      success
+ *         < 0      failed
+ */
+int lssdp_neighbor_save(lssdp_ctx * lssdp, const char * file);
+
+/*
+ * 20. lssdp_neighbor_load
+ *
+ * load SSDP neighbor list from snapshot file (warm start).
+ *
+ * Note:
+ *  - neighbor keeps its update_time, so the remaining TTL is kept. (lssdp.neighbor_timeout)
+ *  - timeout neighbor, or the neighbor not matched to search target / subscriptions is skipped.
+ *  - the neighbor which is already in list (same identity key) is not overwritten.
+ *  - lssdp_socket_create cleans up neighbor list, call this function after lssdp_socket_create.
+ *  - if SSDP neighbor list has been changed, neighbor_list_changed_callback will be invoked once.
+ *
+ * @param lssdp
+ * @param file          snapshot file path
+ * @return >= 0     loaded neighbor number
+ *         < 0      failed
+ */
+int lssdp_neighbor_load(lssdp_ctx * lssdp, const char * file);
+
+/*
+ * 21. lssdp_shm_create
+ *
+ * publish SSDP neighbor list into POSIX shared memory table.
+ *
+ * Local readers map the table read-only (lssdp_shm_reader_open), and read it without lock and syscall.
+ * Every change of neighbor list is written under a sequence lock, the reader retries if the table
+ * is changed during read.
+ *
+ * Note:
+ *  - if shared memory table is already exist, it will be destroyed, and create a new one.
+ *  - the neighbors over capacity are not published until a slot is free.
+ *  - call lssdp_shm_destroy before the program exits.
+ *
+ * @param lssdp
+ * @param name          shared memory name, start with '/', e.g. "/lssdp"
+ * @param capacity      max neighbor number of the table
+ * @return = 0      success
+ *         < 0      failed
+ */
+int lssdp_shm_create(lssdp_ctx * lssdp, const char * name, size_t capacity);
+
+/*
+ * 22. lssdp_shm_destroy
+ *
+ * unmap and unlink the shared memory table.
+ *
+ * Note:
+ *  - the opened reader is notified, lssdp_shm_reader_read returns failed.
+ *
+ * @param lssdp
+ * @return = 0      success
+ *         < 0      failed
+ */
+int lssdp_shm_destroy(lssdp_ctx * lssdp);
+
+/*
+ * 23. lssdp_shm_reader_open
+ *
+ * open the shared memory table which is created by lssdp_shm_create (read-only).
+ *
+ * @param reader
+ * @param name          shared memory name
+ * @return = 0      success
+ *         < 0      failed
+ */
+int lssdp_shm_reader_open(lssdp_shm_reader * reader, const char * name);
+
+/*
+ * 24. lssdp_shm_reader_read
+ *
+ * copy a consistent snapshot of the shared memory table.
+ *
+ * Note:
+ *  - no lock and no syscall, the table is copied again if it is changed during read.
+ *  - if the table has been destroyed, close the reader and open it again.
+ *
+ * @param reader
+ * @param list          neighbor array
+ * @param size          neighbor array size
+ * @return >= 0     copied neighbor number (at most size)
+ *         < 0      failed
+ */
+int lssdp_shm_reader_read(const lssdp_shm_reader * reader, lssdp_shm_nbr * list, size_t size);
+
+/*
+ * 25. lssdp_shm_reader_close
+ *
+ * unmap the shared memory table.
+ *
+ * @param reader
+ * @return = 0      success
+ *         < 0      failed
+ */
+int lssdp_shm_reader_close(lssdp_shm_reader * reader);
+
+/*
+ * 26. lssdp_neighbor_header
+ *
+ * get the value of a received header field of neighbor.
+ *
+ * Note:
+ *  - all header fields of the last NOTIFY / RESPONSE are kept in full length,
+ *    e.g. SERVER, CACHE-CONTROL, BOOTID.UPNP.ORG and custom fields.
+ *  - name is case-insensitive, the first one is returned if the field is repeated.
+ *
+ * @param nbr
+ * @param name          header field name, e.g. "SERVER"
+ * @return value        ("" if the value is empty)
+ *         NULL         not found
+ */
+const char * lssdp_neighbor_header(const lssdp_nbr * nbr, const char * name);
+
+/*
+ * 27. lssdp_neighbor_probe
+ *
+ * send unicast M-SEARCH to the neighbors which are approaching timeout, its RESPONSE refreshes the neighbor.
+ * Call it periodically (e.g. each select timeout), multicast M-SEARCH interval can be lengthened.
+ *
+ * Note:
+ *  - the neighbor is probed when it is not updated in (neighbor_timeout - neighbor_probe_time),
+ *    and probed again after neighbor_probe_time / 2 (at least 1 ms) if it is still not updated.
+ *  - the due neighbors are taken from age list (first probe) and probe wait list (probe again), both are in deadline order,
+ *    the walk stops at the first neighbor which is not due, at most neighbor_probe_max probes are sent.
+ *  - the neighbors of the same source IP and ST are probed by one M-SEARCH.
+ *  - the probes are sent in batch (sendmmsg on Linux).
+ *
+ * @param lssdp
+ * @return >= 0         sent probe number
+ *         -1           failed
+ */
+int lssdp_neighbor_probe(lssdp_ctx * lssdp);
+
+/*
+ * 28. lssdp_announce
+ *
+ * send NOTIFY and M-SEARCH when they are due, instead of fixed cadence.
+ * Call it periodically, and use the return value as select timeout.
+ *
+ * Note:
+ *  - NOTIFY is sent at random interval in (3/4 ~ 1) of half of header.max_age.
+ *  - at startup, NOTIFY is sent 3 times in the first seconds (initial burst),
+ *    M-SEARCH starts at announce.msearch_min, and the interval is doubled (up to announce.msearch_max)
+ *    when neighbor number is not changed since last M-SEARCH.
+ *  - every interval has random jitter, devices started together are not synchronized.
+ *  - header is changed, service is added / removed, or interface is changed: re-announce immediately (initial burst).
+ *
+ * @param lssdp
+ * @return >= 0         milliseconds to the next NOTIFY / M-SEARCH
+ *         -1           failed
+ */
+int lssdp_announce(lssdp_ctx * lssdp);
+
+/*
+ * 29. lssdp_ctx_new
+ *
+ * create a SSDP context on heap. Contexts are independent, each one can be used on its own thread.
+ *
+ * Note:
+ *  - config is copied to the context, it contains settings and callbacks only, e.g. designated initializer.
+ *  - config.allocator is also used to allocate the context, it fails if the hooks are partially set.
+ *  - config.log_callback is the log of this context, lssdp_set_log_callback is used if it is NULL.
+ *  - the context must not be shared by threads without lock.
+ *
+ * @param config        NULL: default (port 1900)
+ * @return lssdp_ctx    free by lssdp_ctx_free
+ *         NULL         failed
+ */
+lssdp_ctx * lssdp_ctx_new(const lssdp_ctx * config);
+
+/*
+ * 30. lssdp_ctx_free
+ *
+ * close SSDP socket (ssdp:byebye is sent), close description fetcher, destroy shared memory table,
+ * remove all neighbors, services and subscriptions, and free the context.
+ * The callbacks of network interface, neighbor list and description are not invoked during teardown.
+ *
+ * @param lssdp         created by lssdp_ctx_new
+ * @return = 0          success
+ *         < 0          failed
+ */
+int lssdp_ctx_free(lssdp_ctx * lssdp);
+
+/*
+ * 31. lssdp_latency_percentile
+ *
+ * get the latency percentile of a stage from stats.latency histogram.
+ *
+ * Note:
+ *  - set latency_trace to record the latency of each received packet:
+ *    kernel queue (SO_TIMESTAMPNS), parser, neighbor list update, and neighbor_list_changed_callback.
+ *  - the result is the upper bound of histogram bucket (power of 2), not larger than max.
+ *  - always -1 when LSSDP_LATENCY_TRACE is 0 (embedded profile).
+ *
+ * @param lssdp
+ * @param stage         LSSDP_LATENCY_*
+ * @param percentile    0 ~ 100, e.g. 50, 99
+ * @return >= 0         latency (ns)
+ *         -1           failed, or no sample
+ */
+long long lssdp_latency_percentile(lssdp_ctx * lssdp, int stage, double percentile);
+
+/*
+ * 32. lssdp_fetch_process
+ *
+ * fetch the description (location) of neighbors, call it in event loop before select.
+ *
+ * 1. progress in-flight requests without blocking: connect, send GET, receive response.
+ * 2. start the queued neighbors, at most fetch.concurrency requests are in flight.
+ *    An idle keep-alive connection to the same server is reused (connection pool).
+ * 3. add the sockets to read_fds / write_fds for select.
+ *
+ * Note:
+ *  - fetch.enable: a neighbor is queued when it is added, or its header is changed with a new description key.
+ *  - descriptions are cached by (uuid of usn, BOOTID.UPNP.ORG, CONFIGID.UPNP.ORG), the services of a device
+ *    share one request. A neighbor of cached key gets the description when it is added, without request and callback.
+ *  - location must be "http://" with IP address (no DNS), e.g. "http://192.168.1.2:5678/desc.xml".
+ *  - description_fetched_callback is invoked when the request of a neighbor is done or failed.
+ *  - a failed fetch is retried when the header of neighbor is changed.
+ *  - do not call lssdp_fetch_close in description_fetched_callback.
+ *
+ * @param lssdp
+ * @param read_fds      NULL: not used (e.g. called by timer)
+ * @param write_fds     NULL: not used
+ * @return >= 0         max fd of sockets
+ *         -1           no socket, or failed
+ */
+int lssdp_fetch_process(lssdp_ctx * lssdp, fd_set * read_fds, fd_set * write_fds);
+
+/*
+ * 33. lssdp_fetch_close
+ *
+ * close all connections of description fetcher, free description cache,
+ * and the descriptions of neighbors are detached (LSSDP_FETCH_NONE).
+ *
+ * @param lssdp
+ * @return = 0          success
+ *         < 0          failed
+ */
+int lssdp_fetch_close(lssdp_ctx * lssdp);
+
+/*
+ * 34. lssdp_neighbor_query
+ *
+ * find the neighbors of a field value by secondary index, without copying.
+ * Get the first neighbor, then call lssdp_neighbor_query_next until NULL, e.g.
+ *
+ *   lssdp_nbr_iter iter;
+ *   lssdp_nbr * nbr;
+ *   for (nbr = lssdp_neighbor_query(lssdp, &iter, LSSDP_NBR_INDEX_DEVICE_TYPE, "DEV_TYPE"); nbr != NULL; nbr = lssdp_neighbor_query_next(&iter)) { ... }
+ *
+ * Note:
+ *  - index: LSSDP_NBR_INDEX_USN, LOCATION, SOURCE (ip), DEVICE_TYPE, SM_ID or INTERFACE (source interface name).
+ *  - value is compared exactly, the order of neighbors is not defined.
+ *  - empty device_type / sm_id / interface is not indexed, its query scans neighbor list,
+ *    and so are all device_type / sm_id / interface queries when LSSDP_NBR_QUERY_INDEX is 0 (embedded profile).
+ *  - iterator is invalid when neighbor list is changed (e.g. lssdp_socket_read, lssdp_neighbor_check_timeout).
+ *
+ * @param lssdp
+ * @param iter          iterator, initialized by this function
+ * @param index         LSSDP_NBR_INDEX_*
+ * @param value         field value, referenced by iterator
+ * @return neighbor     the first neighbor
+ *         NULL         not found, or invalid index
+ */
+lssdp_nbr * lssdp_neighbor_query(lssdp_ctx * lssdp, lssdp_nbr_iter * iter, int index, const char * value);
+
+/*
+ * 35. lssdp_neighbor_query_next
+ *
+ * get the next neighbor of lssdp_neighbor_query.
+ *
+ * @param iter
+ * @return neighbor     the next neighbor
+ *         NULL         no more neighbor
+ */
+lssdp_nbr * lssdp_neighbor_query_next(lssdp_nbr_iter * iter);
+
+/*
+ * 36. lssdp_neighbor_query_array
+ *
+ * find the neighbors of a field value by secondary index, the pointers of neighbors are written to array.
+ *
+ * @param lssdp
+ * @param index         LSSDP_NBR_INDEX_* (same as lssdp_neighbor_query)
+ * @param value         field value
+ * @param array         neighbor pointers, at most array_size are written
+ * @param array_size
+ * @return >= 0         number of matched neighbors (it can be over array_size)
+ *         -1           invalid index
+ */
+int lssdp_neighbor_query_array(lssdp_ctx * lssdp, int index, const char * value, lssdp_nbr ** array, size_t array_size);
+
 #endif
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>         // select, fork, execv, pipe
+#include <sys/time.h>       // gettimeofday
+#include <sys/resource.h>   // getrusage
+#include <sys/wait.h>       // waitpid
+#include "lssdp.h"
+
+/* benchmark.c
+ *
+ * end-to-end throughput benchmark of SSDP daemon over loopback
+ *
+ * 1. create SSDP socket with port (default 1900)
+ * 2. run load_generator.exe as child process, its stdout is piped back
+ *    - virtual devices send NOTIFY, RESPONSE and M-SEARCH to 127.0.0.1 from 127.0.0.2
+ * 3. select SSDP socket with timeout 0.1 seconds
+ *    - when select return value > 0, invoke lssdp_socket_read until the socket is empty
+ *    - record the time when all virtual devices are in neighbor list
+ * 4. stop when load_generator is exited and the socket is idle for 0.5 seconds
+ * 5. show report
+ *    - sustained packets per second, drop rate (and kernel drops of receive buffer), CPU time per packet
+ *    - latency of each stage: kernel queue, parse, table update, callback (percentile is bucket upper bound)
+ *    - neighbor number and neighbor list convergence time
+ *    - RESPONSE of M-SEARCH received by load_generator
+ */
+
+static size_t received_num = 0;
+
+void log_callback(const char * file, const char * tag, int level, int line, const char * func, const char * message) {
+    if (level < LSSDP_LOG_WARN) {
+        return;
+    }
+    fprintf(stderr, "[%-5s][%s] %s", level == LSSDP_LOG_WARN ? "WARN" : "ERROR", tag, message);
+}
+
+long long get_current_time() {
+    struct timeval time = {};
+    if (gettimeofday(&time, NULL) == -1) {
+        printf("gettimeofday failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    return (long long) time.tv_sec * 1000 + (long long) time.tv_usec / 1000;
+}
+
+long long get_cpu_time_us() {
+    struct rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        printf("getrusage failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    return (long long) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+         + (long long) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+}
+
+int count_packet(struct lssdp_ctx * lssdp, const char * packet, size_t packet_len) {
+    received_num++;
+    return 0;
+}
+
+int neighbor_list_changed(struct lssdp_ctx * lssdp) {
+    // nothing, the latency until callback is traced
+    return 0;
+}
+
+void show_latency(lssdp_ctx * lssdp) {
+#if LSSDP_LATENCY_TRACE
+    const char * stage_name[LSSDP_LATENCY_NUM] = {"kernel queue", "parse", "table update", "callback", "total"};
+    printf("  latency (us)        :      num      avg      p50      p99      max\n");
+
+    size_t i;
+    for (i = 0; i < LSSDP_LATENCY_NUM; i++) {
+        const struct lssdp_latency * latency = &lssdp->stats.latency[i];
+        if (latency->num == 0) {
+            printf("    %-18s: no sample\n", stage_name[i]);
+            continue;
+        }
+        printf("    %-18s: %8zu %8.1f %8.1f %8.1f %8.1f\n",
+            stage_name[i],
+            latency->num,
+            latency->sum / 1000.0 / latency->num,
+            lssdp_latency_percentile(lssdp, i, 50) / 1000.0,
+            lssdp_latency_percentile(lssdp, i, 99) / 1000.0,
+            latency->max / 1000.0
+        );
+    }
+#else
+    printf("  latency (us)        : not traced (LSSDP_LATENCY_TRACE 0)\n");
+#endif
+}
+
+pid_t run_load_generator(char * argv[], int * output_fd) {
+    int fd[2];
+    if (pipe(fd) != 0) {
+        printf("pipe failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("fork failed, errno = %s (%d)\n", strerror(errno), errno);
+        close(fd[0]);
+        close(fd[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        // child: stdout -> pipe
+        dup2(fd[1], STDOUT_FILENO);
+        close(fd[0]);
+        close(fd[1]);
+        execv(argv[0], argv);
+        fprintf(stderr, "execv %s failed, errno = %s (%d)\n", argv[0], strerror(errno), errno);
+        _exit(EXIT_FAILURE);
+    }
+
+    close(fd[1]);
+    *output_fd = fd[0];
+    return pid;
+}
+
+void show_usage(const char * name) {
+    printf(
+        "Usage: %s [options]\n"
+        "  -g path      load generator          (default ./load_generator.exe)\n"
+        "  -p port      SSDP port               (default 1900)\n"
+        "  -n number    virtual device number   (default 1000)\n"
+        "  -r rate      packets per second, 0 is as fast as possible (default 10000)\n"
+        "  -d seconds   duration                (default 10)\n"
+        "  -m percent   M-SEARCH percentage     (default 5)\n"
+        "  -R percent   RESPONSE percentage     (default 15)\n"
+        "  -b bytes     receive buffer size     (default 0, system default)\n",
+        name
+    );
+}
+
+int main(int argc, char * argv[]) {
+    const char * generator = "./load_generator.exe";
+    const char * port = "1900", * device_num = "1000", * rate = "10000", * duration = "10";
+    const char * msearch_percent = "5", * response_percent = "15";
+    int recv_buffer_size = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "g:p:n:r:d:m:R:b:h")) != -1) {
+        switch (opt) {
+            case 'g': generator        = optarg; break;
+            case 'p': port             = optarg; break;
+            case 'n': device_num       = optarg; break;
+            case 'r': rate             = optarg; break;
+            case 'd': duration         = optarg; break;
+            case 'm': msearch_percent  = optarg; break;
+            case 'R': response_percent = optarg; break;
+            case 'b': recv_buffer_size = atoi(optarg); break;
+            default:
+                show_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    lssdp_set_log_callback(log_callback);
+
+    lssdp_ctx lssdp = {
+        .port = atoi(port),
+        .recv_buffer_size = recv_buffer_size,
+        .header = {
+            .search_target       = "ST_P2P",
+            .unique_service_name = "f835dd000001",
+            .sm_id               = "700000123",
+            .device_type         = "DEV_TYPE",
+            .location.suffix     = ":5678"
+        },
+
+        .latency_trace = true,      // kernel queue, parse, table update, callback
+
+        // callback
+        .packet_received_callback       = count_packet,
+        .neighbor_list_changed_callback = neighbor_list_changed
+    };
+
+    // 1. create SSDP socket
+    lssdp_network_interface_update(&lssdp);
+    if (lssdp_socket_create(&lssdp) != 0) {
+        puts("SSDP create socket failed");
+        return EXIT_FAILURE;
+    }
+
+    // 2. run load generator
+    char * generator_argv[] = {
+        (char *) generator,
+        "-a", "127.0.0.1", "-b", "127.0.0.2", "-s", lssdp.header.search_target,
+        "-p", (char *) port,
+        "-n", (char *) device_num,
+        "-r", (char *) rate,
+        "-d", (char *) duration,
+        "-m", (char *) msearch_percent,
+        "-R", (char *) response_percent,
+        NULL
+    };
+
+    int output_fd = -1;
+    pid_t pid = run_load_generator(generator_argv, &output_fd);
+    if (pid < 0) {
+        lssdp_socket_close(&lssdp);
+        return EXIT_FAILURE;
+    }
+
+    long long start_time      = get_current_time();
+    long long start_cpu_time  = get_cpu_time_us();
+    long long last_recv_time  = start_time;
+    long long converge_time   = -1;
+    bool      is_exited       = false;
+
+    // 3. Main Loop
+    for (;;) {
+        fd_set fs;
+        FD_ZERO(&fs);
+        FD_SET(lssdp.sock, &fs);
+        struct timeval tv = {
+            .tv_usec = 100 * 1000   // 100 ms
+        };
+
+        int ret = select(lssdp.sock + 1, &fs, NULL, NULL, &tv);
+        if (ret < 0) {
+            printf("select error, ret = %d\n", ret);
+            break;
+        }
+
+        long long current_time = get_current_time();
+        if (ret > 0) {
+            // read until socket is empty
+            while (lssdp_socket_read(&lssdp) == 0);
+            last_recv_time = current_time;
+
+            if (converge_time < 0 && lssdp.neighbor_num >= (size_t) atoi(device_num)) {
+                converge_time = current_time - start_time;
+            }
+        }
+
+        // 4. load generator is exited, and socket is idle
+        if (is_exited == false && waitpid(pid, NULL, WNOHANG) == pid) {
+            is_exited = true;
+        }
+
+        if (is_exited && current_time - last_recv_time >= 500) {
+            break;
+        }
+    }
+
+    long long cpu_time = get_cpu_time_us() - start_cpu_time;
+    long long run_time = last_recv_time - start_time;
+
+    // get the result of load generator
+    size_t sent_num = 0, response_num = 0;
+    char output[128] = {};
+    if (read(output_fd, output, sizeof(output) - 1) <= 0 || sscanf(output, "sent %zu received %zu", &sent_num, &response_num) != 2) {
+        puts("load generator result is not found");
+    }
+    close(output_fd);
+
+    // 5. show report (RESPONSE sent back by self are not sent by load generator)
+    printf("\nBenchmark Report:\n");
+    printf("  build profile       : %s\n", LSSDP_PROFILE_NAME);
+    printf("  virtual devices     : %s\n", device_num);
+    printf("  packets sent        : %zu\n", sent_num);
+    printf("  packets received    : %zu\n", received_num);
+    printf("  drop rate           : %.2f%%\n", sent_num > 0 && sent_num > received_num ? 100.0 * (sent_num - received_num) / sent_num : 0.0);
+    printf("  kernel drops        : %zu (receive buffer is full)\n", lssdp.stats.packet_drop_num);
+    printf("  throughput          : %.0f packets/sec\n", run_time > 0 ? received_num * 1000.0 / run_time : 0.0);
+    printf("  CPU per packet      : %.2f us\n", received_num > 0 ? (double) cpu_time / received_num : 0.0);
+    printf("  neighbor number     : %zu\n", lssdp.neighbor_num);
+    printf("  neighbor memory     : %zu bytes (%zu per neighbor), context %zu bytes\n",
+        lssdp.neighbor_memory,
+        lssdp.neighbor_num > 0 ? lssdp.neighbor_memory / lssdp.neighbor_num : 0,
+        sizeof(lssdp_ctx)
+    );
+    if (converge_time >= 0) {
+        printf("  converge time       : %lld ms\n", converge_time);
+    } else {
+        printf("  converge time       : not converged\n");
+    }
+    printf("  RESPONSE received   : %zu\n", response_num);
+    show_latency(&lssdp);
+
+    lssdp_socket_close(&lssdp);
+    return EXIT_SUCCESS;
+}
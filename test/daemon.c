@@ -6,20 +6,27 @@
 #include <sys/time.h>   // gettimeofday
 #include "lssdp.h"
 
+#define NEIGHBOR_SNAPSHOT   "lssdp_neighbor.snapshot"
+#define NEIGHBOR_SHM        "/lssdp"                // read by shm_reader.exe
+
 /* daemon.c
  *
- * 1. create SSDP socket with port 1900
- * 2. select SSDP socket with timeout 0.5 seconds
+ * 1. create SSDP socket with port 1900, load neighbor snapshot (warm start)
+ *    - publish neighbor list to shared memory, run shm_reader.exe to read it
+ * 2. select SSDP socket with timeout 0.5 seconds (or the next announce)
  *    - when select return value > 0, invoke lssdp_socket_read
- * 3. per 5 seconds do:
+ * 3. each select timeout:
+ *    - send NOTIFY and M-SEARCH when they are due (jitter, initial burst, M-SEARCH backoff up to 60 seconds)
+ *    - send unicast M-SEARCH to the neighbors approaching timeout
+ *    per 5 seconds do:
  *    - update network interface
- *    - send M-SEARCH and NOTIFY
  *    - check neighbor timeout
+ *    - save neighbor snapshot
  * 4. when neighbor list is changed
  *    - show neighbor list
  * 5. when network interface is changed
  *    - show interface list
- *    - re-bind the socket
+ *    - multicast group is joined / dropped on the changed interfaces, no re-bind
  */
 
 void log_callback(const char * file, const char * tag, int level, int line, const char * func, const char * message) {
@@ -58,8 +65,7 @@ int show_neighbor_list(lssdp_ctx * lssdp) {
     return 0;
 }
 
-int show_interface_list_and_rebind_socket(lssdp_ctx * lssdp) {
-    // 1. show interface list
+int show_interface_list(lssdp_ctx * lssdp) {
     printf("\nNetwork Interface List (%zu):\n", lssdp->interface_num);
     size_t i;
     for (i = 0; i < lssdp->interface_num; i++) {
@@ -71,12 +77,6 @@ int show_interface_list_and_rebind_socket(lssdp_ctx * lssdp) {
     }
     printf("%s\n", i == 0 ? "Empty" : "");
 
-    // 2. re-bind SSDP socket
-    if (lssdp_socket_create(lssdp) != 0) {
-        puts("SSDP create socket failed");
-        return -1;
-    }
-
     return 0;
 }
 
@@ -86,26 +86,40 @@ int main() {
 
     lssdp_ctx lssdp = {
         // .debug = true,           // debug
+        // .ipv6 = true,            // IPv6
         .port = 1900,
         .neighbor_timeout = 15000,  // 15 seconds
+        .neighbor_probe_time = 5000,    // probe in 5 seconds before timeout
         .header = {
             .search_target       = "ST_P2P",
             .unique_service_name = "f835dd000001",
             .sm_id               = "700000123",
             .device_type         = "DEV_TYPE",
-            .location.suffix     = ":5678"
+            .location.suffix     = ":5678",
+            .max_age             = 10   // NOTIFY per 3.75 ~ 5 seconds
         },
+        .announce.msearch_max = 60000,  // M-SEARCH backoff up to 60 seconds
 
         // callback
         .neighbor_list_changed_callback     = show_neighbor_list,
-        .network_interface_changed_callback = show_interface_list_and_rebind_socket,
+        .network_interface_changed_callback = show_interface_list,
     };
 
-    /* get network interface at first time, network_interface_changed_callback will be invoke
-     * SSDP socket will be created in callback function
-     */
+    // get network interface at first time, network_interface_changed_callback will be invoke
     lssdp_network_interface_update(&lssdp);
 
+    // create SSDP socket once, it is kept when network interface is changed
+    if (lssdp_socket_create(&lssdp) != 0) {
+        puts("SSDP create socket failed");
+        return EXIT_FAILURE;
+    }
+
+    // load neighbor snapshot of last run
+    lssdp_neighbor_load(&lssdp, NEIGHBOR_SNAPSHOT);
+
+    // publish neighbor list to shared memory
+    lssdp_shm_create(&lssdp, NEIGHBOR_SHM, 1024);
+
     long long last_time = get_current_time();
     if (last_time < 0) {
         printf("got invalid timestamp %lld\n", last_time);
@@ -117,11 +131,18 @@ int main() {
         fd_set fs;
         FD_ZERO(&fs);
         FD_SET(lssdp.sock, &fs);
+        int max_fd = lssdp.sock;
+        if (lssdp.sock6 > 0) {
+            FD_SET(lssdp.sock6, &fs);
+            max_fd = lssdp.sock6 > max_fd ? lssdp.sock6 : max_fd;
+        }
+        // send NOTIFY and M-SEARCH when they are due
+        int next_announce = lssdp_announce(&lssdp);
         struct timeval tv = {
-            .tv_usec = 500 * 1000   // 500 ms
+            .tv_usec = next_announce >= 0 && next_announce < 500 ? next_announce * 1000 : 500 * 1000   // 500 ms
         };
 
-        int ret = select(lssdp.sock + 1, &fs, NULL, NULL, &tv);
+        int ret = select(max_fd + 1, &fs, NULL, NULL, &tv);
         if (ret < 0) {
             printf("select error, ret = %d\n", ret);
             break;
@@ -138,16 +159,19 @@ int main() {
             break;
         }
 
+        // refresh the neighbors approaching timeout by unicast M-SEARCH
+        lssdp_neighbor_probe(&lssdp);
+
         // doing task per 5 seconds
         if (current_time - last_time >= 5000) {
-            lssdp_network_interface_update(&lssdp); // 1. update network interface
-            lssdp_send_msearch(&lssdp);             // 2. send M-SEARCH
-            lssdp_send_notify(&lssdp);              // 3. send NOTIFY
-            lssdp_neighbor_check_timeout(&lssdp);   // 4. check neighbor timeout
+            lssdp_network_interface_update(&lssdp); // 1. update network interface (re-announce if changed)
+            lssdp_neighbor_check_timeout(&lssdp);   // 2. check neighbor timeout
+            lssdp_neighbor_save(&lssdp, NEIGHBOR_SNAPSHOT); // 3. save neighbor snapshot
 
             last_time = current_time;               // update last_time
         }
     }
 
+    lssdp_shm_destroy(&lssdp);
     return EXIT_SUCCESS;
 }
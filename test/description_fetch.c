@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>         // getopt, close, usleep
+#include <pthread.h>        // pthread_create, pthread_mutex_t
+#include <sys/time.h>       // gettimeofday
+#include <sys/select.h>     // select
+#include <sys/socket.h>     // socket, bind, listen, accept, recv, send
+#include <netinet/in.h>     // struct sockaddr_in
+#include <netinet/tcp.h>    // TCP_NODELAY
+#include <arpa/inet.h>      // htons, htonl, inet_addr
+#include "lssdp.h"
+
+/* description_fetch.c
+ *
+ * description fetcher test with a stand-in HTTP server on 127.0.0.1
+ *
+ * 1. run HTTP/1.1 keep-alive server thread, one thread per connection
+ *    - GET /device/<n>.xml responds the description of device n after delay,
+ *      odd device is chunked, even device has CONTENT-LENGTH
+ * 2. ingest NOTIFY of virtual devices, each device has several services (usn uuid:device-<n>::urn:...)
+ *    - neighbor is identified by usn, the services of a device share one description
+ * 3. select the fetcher sockets (lssdp_fetch_process) until every neighbor is fetched or failed
+ * 4. check each description belongs to its device, and show report
+ *    - time, requests, opened / reused connections, cache hits, server connections and requests
+ */
+
+static size_t delay_ms = 10;
+static size_t server_conn_num = 0;
+static size_t server_request_num = 0;
+static pthread_mutex_t server_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t done_num = 0;
+static size_t fail_num = 0;
+
+void log_callback(const char * file, const char * tag, int level, int line, const char * func, const char * message) {
+    if (level < LSSDP_LOG_WARN) {
+        return;
+    }
+    fprintf(stderr, "[%-5s][%s] %s", level == LSSDP_LOG_WARN ? "WARN" : "ERROR", tag, message);
+}
+
+long long get_current_time() {
+    struct timeval time = {};
+    if (gettimeofday(&time, NULL) == -1) {
+        printf("gettimeofday failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    return (long long) time.tv_sec * 1000 + (long long) time.tv_usec / 1000;
+}
+
+int send_all(int fd, const char * data, size_t len) {
+    while (len > 0) {
+        ssize_t ret = send(fd, data, len, MSG_NOSIGNAL);
+        if (ret <= 0) {
+            return -1;
+        }
+        data += ret;
+        len  -= ret;
+    }
+    return 0;
+}
+
+int send_description(int fd, int device) {
+    char body[512];
+    int body_len = snprintf(body, sizeof(body),
+        "<?xml version=\"1.0\"?>\n"
+        "<root xmlns=\"urn:schemas-upnp-org:device-1-0\">\n"
+        "<device><friendlyName>device %d</friendlyName><UDN>uuid:device-%d</UDN></device>\n"
+        "</root>\n",
+        device,
+        device
+    );
+
+    char header[256];
+    if (device % 2 == 0) {
+        int header_len = snprintf(header, sizeof(header),
+            "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nContent-Length: %d\r\n\r\n", body_len);
+        return send_all(fd, header, header_len) == 0 && send_all(fd, body, body_len) == 0 ? 0 : -1;
+    }
+
+    // chunked: two chunks and the last chunk
+    int half = body_len / 2;
+    int header_len = snprintf(header, sizeof(header),
+        "HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nTransfer-Encoding: chunked\r\n\r\n%x\r\n", half);
+    char middle[32];
+    int middle_len = snprintf(middle, sizeof(middle), "\r\n%x;ext=1\r\n", body_len - half);
+    return send_all(fd, header, header_len) == 0
+        && send_all(fd, body, half) == 0
+        && send_all(fd, middle, middle_len) == 0
+        && send_all(fd, body + half, body_len - half) == 0
+        && send_all(fd, "\r\n0\r\n\r\n", 7) == 0 ? 0 : -1;
+}
+
+void * server_connection(void * arg) {
+    int fd = (int) (long) arg;
+    char buffer[4096];
+    size_t len = 0;
+
+    for (;;) {
+        ssize_t ret = recv(fd, buffer + len, sizeof(buffer) - len - 1, 0);
+        if (ret <= 0) {
+            break;
+        }
+        len += ret;
+        buffer[len] = '\0';
+
+        // one request per loop (the client does not pipeline)
+        char * end = strstr(buffer, "\r\n\r\n");
+        if (end == NULL) {
+            continue;
+        }
+
+        int device = -1;
+        if (sscanf(buffer, "GET /device/%d.xml HTTP/1.1", &device) != 1) {
+            send_all(fd, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", 45);
+        } else {
+            usleep(delay_ms * 1000);
+            if (send_description(fd, device) != 0) {
+                break;
+            }
+        }
+
+        pthread_mutex_lock(&server_lock);
+        server_request_num++;
+        pthread_mutex_unlock(&server_lock);
+
+        len -= end + 4 - buffer;
+        memmove(buffer, end + 4, len);
+    }
+    close(fd);
+    return NULL;
+}
+
+void * server(void * arg) {
+    int listen_fd = (int) (long) arg;
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            printf("accept failed, errno = %s (%d)\n", strerror(errno), errno);
+            break;
+        }
+
+        pthread_mutex_lock(&server_lock);
+        server_conn_num++;
+        pthread_mutex_unlock(&server_lock);
+
+        // response is sent in pieces (header, chunks), not delayed by Nagle
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, server_connection, (void *) (long) fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+int server_start(unsigned short * port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        printf("create socket failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    // port 0: the kernel chooses one
+    struct sockaddr_in addr = {
+        .sin_family      = AF_INET,
+        .sin_addr.s_addr = inet_addr("127.0.0.1")
+    };
+    socklen_t addr_len = sizeof(addr);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, 128) != 0
+        || getsockname(fd, (struct sockaddr *) &addr, &addr_len) != 0) {
+        printf("bind / listen failed, errno = %s (%d)\n", strerror(errno), errno);
+        close(fd);
+        return -1;
+    }
+    *port = ntohs(addr.sin_port);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, server, (void *) (long) fd) != 0) {
+        printf("pthread_create failed\n");
+        close(fd);
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+int description_fetched(lssdp_ctx * lssdp, lssdp_nbr * nbr) {
+    if (nbr->description_status != LSSDP_FETCH_DONE) {
+        fail_num++;
+        return 0;
+    }
+    done_num++;
+    return 0;
+}
+
+int ingest_notify(lssdp_ctx * lssdp, unsigned short port, int device, int service) {
+    char packet[1024];
+    int len = snprintf(packet, sizeof(packet),
+        "NOTIFY * HTTP/1.1\r\n"
+        "HOST: 239.255.255.250:1900\r\n"
+        "CACHE-CONTROL: max-age=1800\r\n"
+        "LOCATION: http://127.0.0.1:%u/device/%d.xml\r\n"
+        "NT: urn:schemas-upnp-org:service:Test:%d\r\n"
+        "NTS: ssdp:alive\r\n"
+        "USN: uuid:device-%d::urn:schemas-upnp-org:service:Test:%d\r\n"
+        "BOOTID.UPNP.ORG: 1\r\n"
+        "CONFIGID.UPNP.ORG: 1\r\n"
+        "\r\n",
+        port, device, service, device, service
+    );
+
+    // source 10.x.x.x, one address per device
+    struct sockaddr_in address = {
+        .sin_family      = AF_INET,
+        .sin_port        = htons(1900),
+        .sin_addr.s_addr = htonl(0x0A000000 | (device + 1))
+    };
+    return lssdp_ingest(lssdp, packet, len, (struct sockaddr *) &address, 0);
+}
+
+void show_usage(const char * name) {
+    printf(
+        "Usage: %s [options]\n"
+        "  -n number    virtual device number   (default 200)\n"
+        "  -s number    services per device     (default 3)\n"
+        "  -c number    concurrency             (default 8)\n"
+        "  -d ms        server response delay   (default 10)\n",
+        name
+    );
+}
+
+int main(int argc, char * argv[]) {
+    int device_num = 200, service_num = 3;
+    size_t concurrency = 8;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:c:d:h")) != -1) {
+        switch (opt) {
+            case 'n': device_num  = atoi(optarg); break;
+            case 's': service_num = atoi(optarg); break;
+            case 'c': concurrency = atoi(optarg); break;
+            case 'd': delay_ms    = atoi(optarg); break;
+            default:
+                show_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    // 1. stand-in HTTP server
+    unsigned short port = 0;
+    if (server_start(&port) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    lssdp_set_log_callback(log_callback);
+    lssdp_ctx config = {
+        .port         = 1900,
+        .neighbor_key = LSSDP_NBR_KEY_USN,
+        .header = {
+            .search_target       = "ST_FETCH",
+            .unique_service_name = "f835dd000001"
+        },
+        .fetch = {
+            .enable      = true,
+            .concurrency = concurrency
+        },
+        .description_fetched_callback = description_fetched
+    };
+
+    lssdp_ctx * lssdp = lssdp_ctx_new(&config);
+    if (lssdp == NULL || lssdp_subscription_add(lssdp, "urn:schemas-upnp-org:service:Test:*") != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // 2. ingest NOTIFY of each service
+    long long start_time = get_current_time();
+    int device, service;
+    for (service = 1; service <= service_num; service++) {
+        for (device = 0; device < device_num; device++) {
+            ingest_notify(lssdp, port, device, service);
+        }
+    }
+
+    // 3. select until every neighbor is fetched or failed
+    for (;;) {
+        fd_set read_fds, write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        int max_fd = lssdp_fetch_process(lssdp, &read_fds, &write_fds);
+
+        size_t pending = 0;
+        lssdp_nbr * nbr;
+        for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+            pending += nbr->description_status == LSSDP_FETCH_PENDING;
+        }
+        if (pending == 0) {
+            break;
+        }
+
+        struct timeval tv = {
+            .tv_usec = 100 * 1000   // 100 ms, fetch timeout is checked
+        };
+        if (select(max_fd + 1, &read_fds, &write_fds, NULL, &tv) < 0) {
+            printf("select failed, errno = %s (%d)\n", strerror(errno), errno);
+            break;
+        }
+    }
+    long long elapsed = get_current_time() - start_time;
+
+    // 4. check descriptions
+    size_t mismatch_num = 0, fetched_num = 0;
+    lssdp_nbr * nbr;
+    for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+        if (nbr->description_status != LSSDP_FETCH_DONE) {
+            continue;
+        }
+        fetched_num++;
+
+        // "uuid:device-<n>::urn:..." -> "<UDN>uuid:device-<n></UDN>"
+        char udn[LSSDP_FIELD_LEN + 16];
+        snprintf(udn, sizeof(udn), "<UDN>%.*s</UDN>", (int) (strstr(nbr->usn, "::") - nbr->usn), nbr->usn);
+        if (strstr(nbr->description, udn) == NULL || strlen(nbr->description) != nbr->description_len) {
+            mismatch_num++;
+        }
+    }
+
+    pthread_mutex_lock(&server_lock);
+    printf("Description Fetch Report\n");
+    printf("  neighbors             : %zu (%d devices x %d services)\n", lssdp->neighbor_num, device_num, service_num);
+    printf("  fetched / failed      : %zu / %zu, description mismatch %zu\n", fetched_num, lssdp->neighbor_num - fetched_num, mismatch_num);
+    printf("  time                  : %lld ms (concurrency %zu, server delay %zu ms)\n", elapsed, concurrency, delay_ms);
+    printf("  requests              : %zu (failed %zu)\n", lssdp->fetch.request_num, lssdp->fetch.fail_num);
+    printf("  connections           : %zu opened, %zu requests reused a connection\n", lssdp->fetch.connect_num, lssdp->fetch.request_num - lssdp->fetch.connect_num);
+    printf("  cache hits            : %zu\n", lssdp->fetch.cache_hit_num);
+    printf("  callbacks             : %zu done, %zu failed\n", done_num, fail_num);
+    printf("  server                : %zu connections, %zu requests\n", server_conn_num, server_request_num);
+    pthread_mutex_unlock(&server_lock);
+
+    bool is_ok = fetched_num == lssdp->neighbor_num && mismatch_num == 0;
+    lssdp_ctx_free(lssdp);
+    return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>      // htons, htonl
+#include <netinet/in.h>     // struct sockaddr_in
+#include "lssdp.h"
+
+/* fuzz_parser.c
+ *
+ * fuzzing harness of SSDP packet parser and neighbor ingestion (libFuzzer / AFL compatible)
+ *
+ * 1. each input is one SSDP packet, it is fed to lssdp_ingest
+ *    - source IP is derived from the input, so the neighbors are added, updated and evicted
+ *    - neighbor list is bounded (LRU), all search targets are subscribed
+ * 2. every received header field of the neighbors is looked up by lssdp_neighbor_header
+ * 3. build:
+ *    - make fuzz                   libFuzzer (clang), run ./fuzz_parser_libfuzzer.exe fuzz_corpus
+ *    - make fuzz_parser            replay files (or stdin) without libFuzzer, e.g. afl-fuzz or ASan build
+ *                                  ./fuzz_parser.exe fuzz_corpus/notify_alive ...
+ */
+
+#define FUZZ_NEIGHBOR_MAX   64
+
+static lssdp_ctx * lssdp = NULL;
+
+static void log_callback(lssdp_ctx * lssdp, const char * file, const char * tag, int level, int line, const char * func, const char * message) {
+    // quiet, the input is invalid mostly
+}
+
+static int fuzz_init() {
+    lssdp_ctx config = {
+        .port                = 1900,
+        .neighbor_timeout    = 15000,
+        .neighbor_max        = FUZZ_NEIGHBOR_MAX,
+        .neighbor_eviction   = LSSDP_NBR_EVICT_LRU,
+        .header = {
+            .search_target       = "ST_FUZZ",
+            .unique_service_name = "fuzz000001"
+        },
+        .log_callback = log_callback
+    };
+
+    lssdp = lssdp_ctx_new(&config);
+    if (lssdp == NULL) {
+        return -1;
+    }
+
+    // prefix "*" matches every search target, all NOTIFY / RESPONSE are added to neighbor list
+    return lssdp_subscription_add(lssdp, "*");
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    if (lssdp == NULL && fuzz_init() != 0) {
+        abort();
+    }
+
+    // 1. source IP 10.0.0.x from the input, the packet is not from self
+    struct sockaddr_in address = {
+        .sin_family      = AF_INET,
+        .sin_port        = htons(1900),
+        .sin_addr.s_addr = htonl(0x0A000000 | (size > 0 ? data[size - 1] : 0))
+    };
+    lssdp_ingest(lssdp, (const char *) data, size, (struct sockaddr *) &address, 0);
+
+    // 2. look up each received header field
+    lssdp_nbr * nbr;
+    for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+        const char * name = nbr->header;
+        while (name != NULL && name < nbr->header + nbr->header_len) {
+            if (lssdp_neighbor_header(nbr, name) == NULL) {
+                abort();    // the received field is not found
+            }
+            name += strlen(name) + 1;   // skip name and value
+            name += strlen(name) + 1;
+        }
+    }
+
+    // 3. neighbor list is bounded
+    if (lssdp->neighbor_num > FUZZ_NEIGHBOR_MAX) {
+        abort();
+    }
+    return 0;
+}
+
+#ifndef LSSDP_LIBFUZZER
+static int fuzz_file(FILE * file, const char * name) {
+    static uint8_t buffer[1 << 16];
+    size_t size = fread(buffer, 1, sizeof(buffer), file);
+    if (ferror(file)) {
+        printf("read %s failed, errno = %s (%d)\n", name, strerror(errno), errno);
+        return -1;
+    }
+
+    // copy to exact size, out of bounds read is detected by ASan
+    uint8_t * data = (uint8_t *) malloc(size > 0 ? size : 1);
+    if (data == NULL) {
+        printf("malloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    memcpy(data, buffer, size);
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char * argv[]) {
+    // no argument: read one input from stdin (afl-fuzz)
+    if (argc < 2) {
+        int ret = fuzz_file(stdin, "stdin");
+        if (lssdp != NULL) {
+            lssdp_ctx_free(lssdp);
+        }
+        return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // replay each file
+    int i, ret = 0;
+    for (i = 1; i < argc && ret == 0; i++) {
+        FILE * file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            printf("open %s failed, errno = %s (%d)\n", argv[i], strerror(errno), errno);
+            ret = -1;
+            break;
+        }
+        ret = fuzz_file(file, argv[i]);
+        fclose(file);
+    }
+
+    if (lssdp != NULL) {
+        printf("%d inputs, %zu neighbors\n", i - 1, lssdp->neighbor_num);
+        lssdp_ctx_free(lssdp);
+    }
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
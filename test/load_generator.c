@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>     // getopt, close
+#include <time.h>       // clock_gettime, nanosleep
+#include <arpa/inet.h>  // inet_pton, htons
+#include <sys/socket.h>
+
+/* load_generator.c
+ *
+ * simulate a lot of virtual SSDP devices, send NOTIFY, RESPONSE and M-SEARCH to SSDP daemon
+ *
+ * 1. bind UDP socket to source address (default 127.0.0.2) with SSDP port
+ *    - 127.0.0.2 is not the address of lo, so the packets are not ignored as "received from self"
+ *    - RESPONSE of M-SEARCH is sent back to source address and SSDP port, it is received and counted here
+ * 2. send packets to destination address (default 127.0.0.1) at the configured rate
+ *    - virtual device i has distinct USN, LOCATION and SM_ID, devices are sent in round-robin
+ *    - packet type is chosen randomly by M-SEARCH / RESPONSE percentage, others are NOTIFY
+ * 3. show packets per second every second
+ * 4. when duration is over, print "sent <N> received <M>" to stdout
+ *
+ * run in network namespace with veth pair:
+ *   ip netns exec ns1 ./load_generator.exe -a <veth peer address> -b <veth address>
+ */
+
+typedef struct load_config {
+    const char *    dest_addr;
+    const char *    bind_addr;
+    unsigned short  port;
+    size_t          device_num;
+    size_t          rate;               // packets per second, 0: as fast as possible
+    size_t          duration;           // seconds
+    size_t          msearch_percent;
+    size_t          response_percent;
+    const char *    search_target;
+} load_config;
+
+long long get_current_time_us() {
+    struct timespec ts = {};
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        fprintf(stderr, "clock_gettime failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+unsigned int next_random(unsigned int * seed) {
+    // xorshift32
+    unsigned int x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
+
+int set_packet(const load_config * config, size_t device, unsigned int dice, char * buffer, size_t buffer_len) {
+    // M-SEARCH
+    if (dice < config->msearch_percent) {
+        return snprintf(buffer, buffer_len,
+            "M-SEARCH * HTTP/1.1\r\n"
+            "HOST:239.255.255.250:%d\r\n"
+            "MAN:\"ssdp:discover\"\r\n"
+            "MX:1\r\n"
+            "ST:%s\r\n"
+            "USER-AGENT:OS/version product/version\r\n"
+            "\r\n",
+            config->port,
+            config->search_target
+        );
+    }
+
+    // RESPONSE
+    if (dice < config->msearch_percent + config->response_percent) {
+        return snprintf(buffer, buffer_len,
+            "HTTP/1.1 200 OK\r\n"
+            "CACHE-CONTROL:max-age=120\r\n"
+            "DATE:\r\n"
+            "EXT:\r\n"
+            "LOCATION:http://%s:5678/device/%zu\r\n"
+            "SERVER:OS/version product/version\r\n"
+            "ST:%s\r\n"
+            "USN:uuid:load-generator-%08zu\r\n"
+            "SM_ID:%09zu\r\n"
+            "DEV_TYPE:LOAD_GENERATOR\r\n"
+            "\r\n",
+            config->bind_addr, device,
+            config->search_target,
+            device,
+            device
+        );
+    }
+
+    // NOTIFY
+    return snprintf(buffer, buffer_len,
+        "NOTIFY * HTTP/1.1\r\n"
+        "HOST:239.255.255.250:%d\r\n"
+        "CACHE-CONTROL:max-age=120\r\n"
+        "LOCATION:http://%s:5678/device/%zu\r\n"
+        "SERVER:OS/version product/version\r\n"
+        "NT:%s\r\n"
+        "NTS:ssdp:alive\r\n"
+        "USN:uuid:load-generator-%08zu\r\n"
+        "SM_ID:%09zu\r\n"
+        "DEV_TYPE:LOAD_GENERATOR\r\n"
+        "\r\n",
+        config->port,
+        config->bind_addr, device,
+        config->search_target,
+        device,
+        device
+    );
+}
+
+int socket_create(const load_config * config) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "create socket failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    // SSDP daemon is bound to INADDR_ANY with the same port
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) != 0) {
+        fprintf(stderr, "setsockopt SO_REUSEADDR failed, errno = %s (%d)\n", strerror(errno), errno);
+        goto err;
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port   = htons(config->port)
+    };
+    if (inet_pton(AF_INET, config->bind_addr, &addr.sin_addr) != 1) {
+        fprintf(stderr, "invalid bind address %s\n", config->bind_addr);
+        goto err;
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "bind %s:%d failed, errno = %s (%d)\n", config->bind_addr, config->port, strerror(errno), errno);
+        goto err;
+    }
+    return fd;
+err:
+    close(fd);
+    return -1;
+}
+
+void show_usage(const char * name) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -a address   destination address     (default 127.0.0.1)\n"
+        "  -b address   source address          (default 127.0.0.2)\n"
+        "  -p port      SSDP port               (default 1900)\n"
+        "  -n number    virtual device number   (default 1000)\n"
+        "  -r rate      packets per second, 0 is as fast as possible (default 10000)\n"
+        "  -d seconds   duration                (default 10)\n"
+        "  -m percent   M-SEARCH percentage     (default 5)\n"
+        "  -R percent   RESPONSE percentage     (default 15)\n"
+        "  -s st        search target           (default ST_P2P)\n",
+        name
+    );
+}
+
+int main(int argc, char * argv[]) {
+    load_config config = {
+        .dest_addr        = "127.0.0.1",
+        .bind_addr        = "127.0.0.2",
+        .port             = 1900,
+        .device_num       = 1000,
+        .rate             = 10000,
+        .duration         = 10,
+        .msearch_percent  = 5,
+        .response_percent = 15,
+        .search_target    = "ST_P2P"
+    };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:b:p:n:r:d:m:R:s:h")) != -1) {
+        switch (opt) {
+            case 'a': config.dest_addr        = optarg;              break;
+            case 'b': config.bind_addr        = optarg;              break;
+            case 'p': config.port             = atoi(optarg);        break;
+            case 'n': config.device_num       = strtoul(optarg, NULL, 10); break;
+            case 'r': config.rate             = strtoul(optarg, NULL, 10); break;
+            case 'd': config.duration         = strtoul(optarg, NULL, 10); break;
+            case 'm': config.msearch_percent  = strtoul(optarg, NULL, 10); break;
+            case 'R': config.response_percent = strtoul(optarg, NULL, 10); break;
+            case 's': config.search_target    = optarg;              break;
+            default:
+                show_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (config.device_num == 0 || config.port == 0 || config.msearch_percent + config.response_percent > 100) {
+        show_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // 1. create socket
+    int fd = socket_create(&config);
+    if (fd < 0) {
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_in dest = {
+        .sin_family = AF_INET,
+        .sin_port   = htons(config.port)
+    };
+    if (inet_pton(AF_INET, config.dest_addr, &dest.sin_addr) != 1) {
+        fprintf(stderr, "invalid destination address %s\n", config.dest_addr);
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    // 2. send packets
+    long long start_time = get_current_time_us();
+    long long end_time   = start_time + (long long) config.duration * 1000000;
+    long long last_time  = start_time;
+    size_t sent_num = 0, recv_num = 0, error_num = 0, last_sent_num = 0;
+    unsigned int seed = 2463534242u;
+
+    for (;;) {
+        long long current_time = get_current_time_us();
+        if (current_time < 0 || current_time >= end_time) {
+            break;
+        }
+
+        // packet number should be sent until now
+        size_t target_num = config.rate == 0
+                          ? sent_num + 64
+                          : (size_t) ((current_time - start_time) * config.rate / 1000000);
+
+        for (; sent_num < target_num; sent_num++) {
+            char buffer[1024];
+            int len = set_packet(&config, sent_num % config.device_num, next_random(&seed) % 100, buffer, sizeof(buffer));
+            if (sendto(fd, buffer, len, 0, (struct sockaddr *)&dest, sizeof(dest)) < 0) {
+                error_num++;
+            }
+        }
+
+        // drain RESPONSE of M-SEARCH
+        char buffer[1024];
+        while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+            recv_num++;
+        }
+
+        // 3. show packets per second
+        if (current_time - last_time >= 1000000) {
+            fprintf(stderr, "[load_generator] sent %zu pps, total %zu, error %zu, RESPONSE received %zu\n",
+                sent_num - last_sent_num, sent_num, error_num, recv_num);
+            last_sent_num = sent_num;
+            last_time     = current_time;
+        }
+
+        if (config.rate > 0) {
+            struct timespec tick = {.tv_nsec = 1000 * 1000};   // 1 ms
+            nanosleep(&tick, NULL);
+        }
+    }
+
+    // drain the last RESPONSE
+    struct timespec wait = {.tv_nsec = 200 * 1000 * 1000};  // 200 ms
+    nanosleep(&wait, NULL);
+    char buffer[1024];
+    while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+        recv_num++;
+    }
+
+    // 4. print result
+    printf("sent %zu received %zu\n", sent_num - error_num, recv_num);
+    fflush(stdout);
+    close(fd);
+    return EXIT_SUCCESS;
+}
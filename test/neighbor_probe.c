@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>         // close, alarm
+#include <sys/time.h>       // gettimeofday
+#include <arpa/inet.h>      // htons, htonl
+#include <netinet/in.h>     // struct sockaddr_in
+#include "lssdp.h"
+
+/* neighbor_probe.c
+ *
+ * unicast M-SEARCH probe of the neighbors approaching timeout (lssdp_neighbor_probe)
+ *
+ * 1. ingest NOTIFY of neighbors from 127.0.0.1, the probes are received by a socket bound to the SSDP port
+ * 2. check probe number of each call: first probe, probed neighbors wait for RESPONSE, RESPONSE stops waiting,
+ *    and the shortest neighbor_probe_time (1 ms) does not probe a neighbor twice in one call
+ * 3. show result of each case, exit code is the failed case number
+ */
+
+#define PROBE_PORT      41900
+#define TIMEOUT         10000       // ms
+
+void log_callback(const char * file, const char * tag, int level, int line, const char * func, const char * message) {
+    if (level < LSSDP_LOG_WARN) {
+        return;
+    }
+    fprintf(stderr, "[%-5s][%s] %s", level == LSSDP_LOG_WARN ? "WARN" : "ERROR", tag, message);
+}
+
+long long get_current_time() {
+    struct timeval time = {};
+    gettimeofday(&time, NULL);
+    return (long long) time.tv_sec * 1000 + time.tv_usec / 1000;
+}
+
+int ingest_notify(lssdp_ctx * lssdp, const char * usn, const char * st, long long timestamp) {
+    char packet[1024];
+    int len = snprintf(packet, sizeof(packet),
+        "NOTIFY * HTTP/1.1\r\n"
+        "HOST: 239.255.255.250:1900\r\n"
+        "CACHE-CONTROL: max-age=1800\r\n"
+        "LOCATION: http://127.0.0.1:5678/%s.xml\r\n"
+        "NT: %s\r\n"
+        "NTS: ssdp:alive\r\n"
+        "USN: %s\r\n"
+        "\r\n",
+        usn, st, usn
+    );
+
+    struct sockaddr_in address = {
+        .sin_family      = AF_INET,
+        .sin_port        = htons(PROBE_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    return lssdp_ingest(lssdp, packet, len, (struct sockaddr *) &address, timestamp);
+}
+
+// received probe number (non-blocking)
+int receive_num(int fd) {
+    char buffer[2048];
+    int num = 0;
+    while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {
+        num++;
+    }
+    return num;
+}
+
+// SSDP socket is only used to send probes
+lssdp_ctx * probe_ctx_new(long probe_time) {
+    lssdp_ctx config = {
+        .sock                = socket(AF_INET, SOCK_DGRAM, 0),
+        .sock6               = -1,
+        .port                = PROBE_PORT,
+        .neighbor_timeout    = TIMEOUT,
+        .neighbor_probe_time = probe_time,
+        .header = {
+            .search_target       = "ST_PROBE",
+            .unique_service_name = "f835dd000001"
+        }
+    };
+
+    lssdp_ctx * lssdp = lssdp_ctx_new(&config);
+    if (lssdp != NULL) {
+        lssdp_subscription_add(lssdp, "*");
+    }
+    return lssdp;
+}
+
+int check(const char * name, int probe_num, int expect) {
+    bool is_pass = probe_num == expect;
+    printf("  %-52s: %s (%d)\n", name, is_pass ? "pass" : "FAIL", probe_num);
+    return is_pass ? 0 : 1;
+}
+
+int main() {
+    lssdp_set_log_callback(log_callback);
+
+    // probes are sent to the SSDP port of neighbor (127.0.0.1)
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address = {
+        .sin_family      = AF_INET,
+        .sin_port        = htons(PROBE_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    if (fd < 0 || bind(fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        printf("bind 127.0.0.1:%d failed\n", PROBE_PORT);
+        return EXIT_FAILURE;
+    }
+
+    lssdp_ctx * lssdp = probe_ctx_new(4000);
+    if (lssdp == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    // a probe loop which never ends is failed
+    alarm(10);
+
+    printf("Neighbor Probe Report\n");
+    int fail = 0;
+
+    // 1. a and b share source IP and ST, c has its own ST, d is not approaching timeout
+    long long now = get_current_time();
+    ingest_notify(lssdp, "uuid:a", "ST_PROBE", now - 7000);
+    ingest_notify(lssdp, "uuid:b", "ST_PROBE", now - 6500);
+    ingest_notify(lssdp, "uuid:c", "ST_OTHER", now - 6200);
+    ingest_notify(lssdp, "uuid:d", "ST_PROBE", now - 1000);
+    int probe_num = lssdp_neighbor_probe(lssdp);
+    fail += check("approaching timeout, same source and ST share a probe", probe_num, 2);
+    fail += check("probes are received", receive_num(fd), 2);
+
+    // 2. probed neighbors wait for RESPONSE
+    fail += check("probed recently", lssdp_neighbor_probe(lssdp), 0);
+
+    // 3. shortest probe time: the retry interval is at least 1 ms, each neighbor is probed at most once in a call
+    lssdp_ctx_free(lssdp);
+    lssdp = probe_ctx_new(1);
+    if (lssdp == NULL) {
+        return EXIT_FAILURE;
+    }
+    now = get_current_time();
+    ingest_notify(lssdp, "uuid:e", "ST_PROBE", now - TIMEOUT);
+    ingest_notify(lssdp, "uuid:f", "ST_OTHER", now - TIMEOUT);
+    fail += check("neighbor_probe_time = 1, first probe", lssdp_neighbor_probe(lssdp), 2);
+    usleep(2000);
+    fail += check("neighbor_probe_time = 1, probe again", lssdp_neighbor_probe(lssdp), 2);
+    fail += check("probes are received", receive_num(fd), 4);
+
+    // 4. RESPONSE (the neighbor is updated) stops waiting
+    usleep(2000);
+    ingest_notify(lssdp, "uuid:e", "ST_PROBE", get_current_time());
+    fail += check("updated neighbor is not probed", lssdp_neighbor_probe(lssdp), 1);
+
+    printf("  failed      : %d\n", fail);
+    close(fd);
+    lssdp_ctx_free(lssdp);
+    return fail;
+}
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>         // getopt
+#include <time.h>           // clock_gettime
+#include <arpa/inet.h>      // htons, htonl
+#include <netinet/in.h>     // struct sockaddr_in
+#include "lssdp.h"
+
+/* neighbor_query.c
+ *
+ * neighbor query by secondary index vs. full scan of neighbor list
+ *
+ * 1. ingest NOTIFY of virtual devices, device_type / sm_id are shared by groups of neighbors
+ *    - neighbor is identified by usn, each device has its own source ip
+ * 2. query each device_type, sm_id, usn and source ip by lssdp_neighbor_query (and _array),
+ *    and by scanning neighbor list, the results must be the same
+ * 3. change device_type / sm_id / source ip of every 3rd neighbor, remove every 5th neighbor (ssdp:byebye),
+ *    and query again: the index must follow the changes
+ * 4. show report: average time of a query (index / scan)
+ */
+
+static const char * index_name[LSSDP_NBR_INDEX_FIELD_NUM] = {
+    [LSSDP_NBR_INDEX_USN]         = "usn",
+    [LSSDP_NBR_INDEX_SOURCE]      = "source ip",
+    [LSSDP_NBR_INDEX_DEVICE_TYPE] = "device_type",
+    [LSSDP_NBR_INDEX_SM_ID]       = "sm_id"
+};
+
+void log_callback(const char * file, const char * tag, int level, int line, const char * func, const char * message) {
+    if (level < LSSDP_LOG_WARN) {
+        return;
+    }
+    fprintf(stderr, "[%-5s][%s] %s", level == LSSDP_LOG_WARN ? "WARN" : "ERROR", tag, message);
+}
+
+long long get_current_time_ns() {
+    struct timespec time = {};
+    if (clock_gettime(CLOCK_MONOTONIC, &time) != 0) {
+        printf("clock_gettime failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    return (long long) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+// change: shift device_type / sm_id and source ip of the device
+int ingest_notify(lssdp_ctx * lssdp, int device, int type_num, int sm_id_num, int change, const char * nts) {
+    char packet[1024];
+    int len = snprintf(packet, sizeof(packet),
+        "NOTIFY * HTTP/1.1\r\n"
+        "HOST: 239.255.255.250:1900\r\n"
+        "CACHE-CONTROL: max-age=1800\r\n"
+        "LOCATION: http://10.%d.%d.%d:5678/desc.xml\r\n"
+        "NT: ST_QUERY\r\n"
+        "NTS: %s\r\n"
+        "USN: uuid:device-%d\r\n"
+        "DEV_TYPE: type-%d\r\n"
+        "SM_ID: sm-%d\r\n"
+        "\r\n",
+        (device >> 16) & 0xFF, (device >> 8) & 0xFF, device & 0xFF,
+        nts,
+        device,
+        (device + change) % type_num,
+        (device + change) % sm_id_num
+    );
+
+    struct sockaddr_in address = {
+        .sin_family      = AF_INET,
+        .sin_port        = htons(1900),
+        .sin_addr.s_addr = htonl((0x0A000000 + (change << 24)) | device)
+    };
+    return lssdp_ingest(lssdp, packet, len, (struct sockaddr *) &address, 0);
+}
+
+const char * field_value(const lssdp_nbr * nbr, int index) {
+    switch (index) {
+        case LSSDP_NBR_INDEX_USN:           return nbr->usn;
+        case LSSDP_NBR_INDEX_SOURCE:        return nbr->ip;
+        case LSSDP_NBR_INDEX_DEVICE_TYPE:   return nbr->device_type;
+        default:                            return nbr->sm_id;
+    }
+}
+
+size_t scan_count(lssdp_ctx * lssdp, int index, const char * value) {
+    size_t num = 0;
+    lssdp_nbr * nbr;
+    for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+        num += strcmp(field_value(nbr, index), value) == 0;
+    }
+    return num;
+}
+
+// query each value of the first value_num neighbors, return mismatch number
+size_t run_query(lssdp_ctx * lssdp, int index, size_t value_num, lssdp_nbr ** array, size_t array_size) {
+    long long index_ns = 0, scan_ns = 0;
+    size_t mismatch = 0, result_num = 0, i = 0;
+    lssdp_nbr * n;
+    for (n = lssdp->neighbor_list; n != NULL && i < value_num; n = n->next, i++) {
+        const char * value = field_value(n, index);
+
+        // 1. iterator
+        long long start = get_current_time_ns();
+        size_t num = 0;
+        lssdp_nbr_iter iter;
+        lssdp_nbr * nbr;
+        for (nbr = lssdp_neighbor_query(lssdp, &iter, index, value); nbr != NULL; nbr = lssdp_neighbor_query_next(&iter)) {
+            mismatch += strcmp(field_value(nbr, index), value) != 0;
+            num++;
+        }
+        long long middle = get_current_time_ns();
+
+        // 2. full scan
+        size_t expect = scan_count(lssdp, index, value);
+        index_ns += middle - start;
+        scan_ns  += get_current_time_ns() - middle;
+
+        // 3. array
+        int array_num = lssdp_neighbor_query_array(lssdp, index, value, array, array_size);
+        mismatch += num != expect || array_num != (int) expect;
+        result_num += num;
+    }
+
+    printf("  %-12s: %6zu queries, %8.1f neighbors/query, index %9.2f us, scan %9.2f us, speedup %7.1fx\n",
+        index_name[index],
+        i,
+        (double) result_num / i,
+        index_ns / 1000.0 / i,
+        scan_ns / 1000.0 / i,
+        index_ns > 0 ? (double) scan_ns / index_ns : 0
+    );
+    return mismatch;
+}
+
+void show_usage(const char * name) {
+    printf(
+        "Usage: %s [options]\n"
+        "  -n number    neighbor number         (default 20000)\n"
+        "  -t number    device_type number      (default 50)\n"
+        "  -s number    sm_id number            (default 1000)\n"
+        "  -q number    queries of each index   (default 1000)\n",
+        name
+    );
+}
+
+int main(int argc, char * argv[]) {
+    int neighbor_num = 20000, type_num = 50, sm_id_num = 1000;
+    size_t query_num = 1000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:s:q:h")) != -1) {
+        switch (opt) {
+            case 'n': neighbor_num = atoi(optarg); break;
+            case 't': type_num     = atoi(optarg); break;
+            case 's': sm_id_num    = atoi(optarg); break;
+            case 'q': query_num    = atoi(optarg); break;
+            default:
+                show_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (neighbor_num <= 0 || type_num <= 0 || sm_id_num <= 0) {
+        show_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    lssdp_set_log_callback(log_callback);
+    lssdp_ctx config = {
+        .port         = 1900,
+        .neighbor_key = LSSDP_NBR_KEY_USN,
+        .header = {
+            .search_target       = "ST_QUERY",
+            .unique_service_name = "f835dd000001"
+        }
+    };
+
+    lssdp_ctx * lssdp = lssdp_ctx_new(&config);
+    if (lssdp == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    // 1. neighbors
+    int i;
+    for (i = 1; i <= neighbor_num; i++) {
+        ingest_notify(lssdp, i, type_num, sm_id_num, 0, "ssdp:alive");
+    }
+
+    lssdp_nbr ** array = (lssdp_nbr **) calloc(neighbor_num, sizeof(lssdp_nbr *));
+    if (array == NULL) {
+        printf("calloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return EXIT_FAILURE;
+    }
+
+    // 2. query each index
+    printf("Neighbor Query Report (%zu neighbors, %s profile%s)\n",
+        lssdp->neighbor_num,
+        LSSDP_PROFILE_NAME,
+        LSSDP_NBR_QUERY_INDEX ? "" : ", device_type / sm_id are scanned"
+    );
+    int index[] = {LSSDP_NBR_INDEX_USN, LSSDP_NBR_INDEX_SOURCE, LSSDP_NBR_INDEX_DEVICE_TYPE, LSSDP_NBR_INDEX_SM_ID};
+    size_t mismatch = 0;
+    for (i = 0; i < (int) (sizeof(index) / sizeof(index[0])); i++) {
+        mismatch += run_query(lssdp, index[i], query_num, array, neighbor_num);
+    }
+
+    // empty optional field (not indexed) is scanned, and an unknown value has no result
+    lssdp_nbr_iter iter;
+    mismatch += lssdp_neighbor_query(lssdp, &iter, LSSDP_NBR_INDEX_INTERFACE, "") == NULL;
+    mismatch += lssdp_neighbor_query(lssdp, &iter, LSSDP_NBR_INDEX_DEVICE_TYPE, "type-none") != NULL;
+
+    // 3. index maintenance: neighbors are updated in place or removed
+    for (i = 1; i <= neighbor_num; i++) {
+        if (i % 5 == 0) {
+            ingest_notify(lssdp, i, type_num, sm_id_num, 0, "ssdp:byebye");
+        } else if (i % 3 == 0) {
+            ingest_notify(lssdp, i, type_num, sm_id_num, 1, "ssdp:alive");
+        }
+    }
+
+    printf("After Change (%zu neighbors: every 3rd is changed, every 5th is removed)\n", lssdp->neighbor_num);
+    for (i = 0; i < (int) (sizeof(index) / sizeof(index[0])); i++) {
+        mismatch += run_query(lssdp, index[i], query_num, array, neighbor_num);
+    }
+
+    // removed neighbor and the old source ip of changed neighbor have no result
+    mismatch += neighbor_num >= 5 && lssdp_neighbor_query(lssdp, &iter, LSSDP_NBR_INDEX_USN, "uuid:device-5") != NULL;
+    mismatch += neighbor_num >= 3 && lssdp_neighbor_query(lssdp, &iter, LSSDP_NBR_INDEX_SOURCE, "10.0.0.3") != NULL;
+    mismatch += lssdp->neighbor_num != (size_t) (neighbor_num - neighbor_num / 5);
+    printf("  mismatch    : %zu\n", mismatch);
+
+    free(array);
+    lssdp_ctx_free(lssdp);
+    return mismatch == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>         // getopt, read, close
+#include <pthread.h>        // pthread_create, pthread_mutex_t
+#include <sys/epoll.h>      // epoll_create1, epoll_ctl, epoll_wait
+#include <sys/timerfd.h>    // timerfd_create, timerfd_settime
+#include <sys/time.h>       // gettimeofday
+#include "lssdp.h"
+
+/* netns_daemon.c
+ *
+ * SSDP discovery in many network namespaces by one process (Linux, root)
+ *
+ * 1. create one lssdp_ctx for each network namespace (lssdp.netns)
+ *    - name in /var/run/netns (ip netns add <name>), or path, e.g. /proc/<pid>/ns/net
+ * 2. add SSDP sockets and a timer of each context to one epoll (EPOLLONESHOT)
+ * 3. worker threads wait on the epoll, a context is handled by one worker at a time
+ *    - socket is readable: invoke lssdp_socket_read until the socket is empty
+ *    - timer: send NOTIFY / M-SEARCH when they are due (lssdp_announce), probe neighbors,
+ *      and per 5 seconds update network interface and check neighbor timeout
+ * 4. when neighbor list is changed
+ *    - show neighbor list tagged by network namespace
+ */
+
+#define TENANT_SOURCE_NUM   3           // sock, sock6, timer
+
+typedef struct tenant {
+    lssdp_ctx *         lssdp;
+    pthread_mutex_t     lock;
+    int                 timer_fd;
+    long long           last_time;      // last time of 5 seconds task
+    struct source {
+        struct tenant * tenant;
+        int             fd;
+    } source[TENANT_SOURCE_NUM];
+} tenant;
+
+static int epoll_fd = -1;
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void log_callback(lssdp_ctx * lssdp, const char * file, const char * tag, int level, int line, const char * func, const char * message) {
+    char * level_name = "DEBUG";
+    if (level == LSSDP_LOG_INFO)   level_name = "INFO";
+    if (level == LSSDP_LOG_WARN)   level_name = "WARN";
+    if (level == LSSDP_LOG_ERROR)  level_name = "ERROR";
+
+    pthread_mutex_lock(&print_lock);
+    printf("[%-5s][%s][%s] %s", level_name, tag, lssdp->netns, message);
+    pthread_mutex_unlock(&print_lock);
+}
+
+long long get_current_time() {
+    struct timeval time = {};
+    if (gettimeofday(&time, NULL) == -1) {
+        printf("gettimeofday failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    return (long long) time.tv_sec * 1000 + (long long) time.tv_usec / 1000;
+}
+
+int show_neighbor_list(lssdp_ctx * lssdp) {
+    int i = 0;
+    lssdp_nbr * nbr;
+    pthread_mutex_lock(&print_lock);
+    printf("\n[%s] SSDP List (%zu):\n", lssdp->netns, lssdp->neighbor_num);
+    for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+        printf("[%s] %d. ip = %-16s, st = %-20s, usn = %-24s, location = %s\n",
+            lssdp->netns,
+            ++i,
+            nbr->ip,
+            nbr->st,
+            nbr->usn,
+            nbr->location
+        );
+    }
+    printf("%s\n", i == 0 ? "Empty" : "");
+    pthread_mutex_unlock(&print_lock);
+    return 0;
+}
+
+int timer_set(tenant * t, long long ms) {
+    // 0 disarms timerfd, fire after 1 ms at least
+    ms = ms > 0 ? ms : 1;
+    struct itimerspec spec = {
+        .it_value = {
+            .tv_sec  = ms / 1000,
+            .tv_nsec = (ms % 1000) * 1000000
+        }
+    };
+
+    if (timerfd_settime(t->timer_fd, 0, &spec, NULL) != 0) {
+        printf("timerfd_settime failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    return 0;
+}
+
+int epoll_arm(struct source * source, int op) {
+    struct epoll_event event = {
+        .events   = EPOLLIN | EPOLLONESHOT,
+        .data.ptr = source
+    };
+
+    if (epoll_ctl(epoll_fd, op, source->fd, &event) != 0) {
+        printf("epoll_ctl fd %d failed, errno = %s (%d)\n", source->fd, strerror(errno), errno);
+        return -1;
+    }
+    return 0;
+}
+
+void tenant_timer(tenant * t) {
+    uint64_t expired;
+    if (read(t->timer_fd, &expired, sizeof(expired)) < 0 && errno != EAGAIN) {
+        printf("read timerfd failed, errno = %s (%d)\n", strerror(errno), errno);
+    }
+
+    long long current_time = get_current_time();
+    int next_announce = lssdp_announce(t->lssdp);  // 1. send NOTIFY / M-SEARCH when they are due
+    lssdp_neighbor_probe(t->lssdp);                 // 2. probe the neighbors approaching timeout
+
+    // doing task per 5 seconds
+    if (current_time - t->last_time >= 5000) {
+        lssdp_network_interface_update(t->lssdp);  // 3. update network interface
+        lssdp_neighbor_check_timeout(t->lssdp);     // 4. check neighbor timeout
+        t->last_time = current_time;
+    }
+
+    timer_set(t, next_announce >= 0 && next_announce < 500 ? next_announce : 500);
+}
+
+void * worker(void * arg) {
+    for (;;) {
+        struct epoll_event event;
+        int ret = epoll_wait(epoll_fd, &event, 1, -1);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("epoll_wait failed, errno = %s (%d)\n", strerror(errno), errno);
+            break;
+        }
+
+        // EPOLLONESHOT: the source is disabled until it is armed again
+        struct source * source = (struct source *) event.data.ptr;
+        tenant * t = source->tenant;
+        pthread_mutex_lock(&t->lock);
+        if (source->fd == t->timer_fd) {
+            tenant_timer(t);
+        } else {
+            // read until socket is empty
+            while (lssdp_socket_read(t->lssdp) == 0);
+        }
+        pthread_mutex_unlock(&t->lock);
+
+        epoll_arm(source, EPOLL_CTL_MOD);
+    }
+    return NULL;
+}
+
+int tenant_open(tenant * t, const char * netns, unsigned short port, const char * search_target) {
+    lssdp_ctx config = {
+        .port                = port,
+        .neighbor_timeout    = 15000,   // 15 seconds
+        .neighbor_probe_time = 5000,    // probe in 5 seconds before timeout
+        .header = {
+            .search_target       = "ST_P2P",
+            .unique_service_name = "f835dd000001",
+            .sm_id               = "700000123",
+            .device_type         = "DEV_TYPE",
+            .location.suffix     = ":5678",
+            .max_age             = 10   // NOTIFY per 3.75 ~ 5 seconds
+        },
+        .announce.msearch_max = 60000,  // M-SEARCH backoff up to 60 seconds
+
+        // callback
+        .log_callback                   = log_callback,
+        .neighbor_list_changed_callback = show_neighbor_list
+    };
+    snprintf(config.netns, LSSDP_NETNS_LEN, "%s", netns);
+
+    // 1. create context, and SSDP socket in the network namespace
+    t->lssdp = lssdp_ctx_new(&config);
+    if (t->lssdp == NULL) {
+        return -1;
+    }
+    pthread_mutex_init(&t->lock, NULL);
+    t->last_time = get_current_time();
+
+    if (search_target != NULL) {
+        lssdp_subscription_add(t->lssdp, search_target);
+    }
+
+    lssdp_network_interface_update(t->lssdp);
+    if (lssdp_socket_create(t->lssdp) != 0) {
+        printf("[%s] SSDP create socket failed\n", netns);
+        return -1;
+    }
+
+    // 2. create timer
+    t->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (t->timer_fd < 0) {
+        printf("timerfd_create failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+
+    // 3. add sockets and timer to epoll
+    int fd[TENANT_SOURCE_NUM] = {t->lssdp->sock, t->lssdp->sock6, t->timer_fd};
+    size_t i;
+    for (i = 0; i < TENANT_SOURCE_NUM; i++) {
+        t->source[i].tenant = t;
+        t->source[i].fd     = fd[i];
+        if (fd[i] > 0 && epoll_arm(&t->source[i], EPOLL_CTL_ADD) != 0) {
+            return -1;
+        }
+    }
+    return timer_set(t, 1);
+}
+
+void show_usage(const char * name) {
+    printf(
+        "Usage: %s [options] netns...\n"
+        "  -t threads   worker thread number    (default 4)\n"
+        "  -p port      SSDP port               (default 1900)\n"
+        "  -s st        subscription            (default none, header ST_P2P only)\n",
+        name
+    );
+}
+
+int main(int argc, char * argv[]) {
+    size_t thread_num = 4;
+    unsigned short port = 1900;
+    const char * search_target = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:p:s:h")) != -1) {
+        switch (opt) {
+            case 't': thread_num    = atoi(optarg); break;
+            case 'p': port          = atoi(optarg); break;
+            case 's': search_target = optarg;       break;
+            default:
+                show_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    size_t tenant_num = argc - optind;
+    if (tenant_num == 0 || thread_num == 0) {
+        show_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        printf("epoll_create1 failed, errno = %s (%d)\n", strerror(errno), errno);
+        return EXIT_FAILURE;
+    }
+
+    // 1. open a context for each network namespace
+    tenant * tenant_list = (tenant *) calloc(tenant_num, sizeof(tenant));
+    if (tenant_list == NULL) {
+        printf("calloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return EXIT_FAILURE;
+    }
+
+    size_t i;
+    for (i = 0; i < tenant_num; i++) {
+        if (tenant_open(&tenant_list[i], argv[optind + i], port, search_target) != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    // 2. run worker threads
+    pthread_t * thread = (pthread_t *) calloc(thread_num, sizeof(pthread_t));
+    if (thread == NULL) {
+        printf("calloc failed, errno = %s (%d)\n", strerror(errno), errno);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < thread_num; i++) {
+        if (pthread_create(&thread[i], NULL, worker, NULL) != 0) {
+            printf("pthread_create failed\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (i = 0; i < thread_num; i++) {
+        pthread_join(thread[i], NULL);
+    }
+    return EXIT_SUCCESS;
+}
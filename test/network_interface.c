@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>     // sleep
+#include <sys/socket.h> // AF_INET6
 #include "lssdp.h"
 
 /* network_interface.c
@@ -23,6 +24,10 @@ int show_interface_list(lssdp_ctx * lssdp) {
     printf("\nNetwork Interface List (%zu):\n", lssdp->interface_num);
     size_t i;
     for (i = 0; i < lssdp->interface_num; i++) {
+        if (lssdp->interface[i].family == AF_INET6) {
+            printf("%zu. %-6s: %s (IPv6)\n", i + 1, lssdp->interface[i].name, lssdp->interface[i].ip);
+            continue;
+        }
         printf("%zu. %-6s: %-15s (%d.%d.%d.%d)\n",
             i + 1,
             lssdp->interface[i].name,
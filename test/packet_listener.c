@@ -16,7 +16,7 @@
  * 3. update network interface per 5 seconds
  * 4. when network interface is changed
  *    - show interface list
- *    - re-bind the socket
+ *    - multicast group is joined / dropped on the changed interfaces, no re-bind
  */
 
 void log_callback(const char * file, const char * tag, int level, int line, const char * func, const char * message) {
@@ -37,8 +37,7 @@ long long get_current_time() {
     return (long long) time.tv_sec * 1000 + (long long) time.tv_usec / 1000;
 }
 
-int show_interface_list_and_rebind_socket(lssdp_ctx * lssdp) {
-    // 1. show interface list
+int show_interface_list(lssdp_ctx * lssdp) {
     printf("\nNetwork Interface List (%zu):\n", lssdp->interface_num);
     size_t i;
     for (i = 0; i < lssdp->interface_num; i++) {
@@ -50,12 +49,6 @@ int show_interface_list_and_rebind_socket(lssdp_ctx * lssdp) {
     }
     printf("%s\n", i == 0 ? "Empty" : "");
 
-    // 2. re-bind SSDP socket
-    if (lssdp_socket_create(lssdp) != 0) {
-        puts("SSDP create socket failed");
-        return -1;
-    }
-
     return 0;
 }
 
@@ -71,17 +64,22 @@ int main() {
     lssdp_ctx lssdp = {
         .port = 1900,
         // .debug = true,           // debug
+        // .ipv6 = true,            // IPv6
 
         // callback
-        .network_interface_changed_callback = show_interface_list_and_rebind_socket,
+        .network_interface_changed_callback = show_interface_list,
         .packet_received_callback           = show_ssdp_packet
     };
 
-    /* get network interface at first time, network_interface_changed_callback will be invoke
-     * SSDP socket will be created in callback function
-     */
+    // get network interface at first time, network_interface_changed_callback will be invoke
     lssdp_network_interface_update(&lssdp);
 
+    // create SSDP socket once, it is kept when network interface is changed
+    if (lssdp_socket_create(&lssdp) != 0) {
+        puts("SSDP create socket failed");
+        return EXIT_FAILURE;
+    }
+
     long long last_time = get_current_time();
     if (last_time < 0) {
         printf("got invalid timestamp %lld\n", last_time);
@@ -93,11 +91,16 @@ int main() {
         fd_set fs;
         FD_ZERO(&fs);
         FD_SET(lssdp.sock, &fs);
+        int max_fd = lssdp.sock;
+        if (lssdp.sock6 > 0) {
+            FD_SET(lssdp.sock6, &fs);
+            max_fd = lssdp.sock6 > max_fd ? lssdp.sock6 : max_fd;
+        }
         struct timeval tv = {
             .tv_usec = 500 * 1000   // 500 ms
         };
 
-        int ret = select(lssdp.sock + 1, &fs, NULL, NULL, &tv);
+        int ret = select(max_fd + 1, &fs, NULL, NULL, &tv);
         if (ret < 0) {
             printf("select error, ret = %d\n", ret);
             break;
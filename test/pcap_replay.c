@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>     // getopt
+#include <sys/time.h>   // gettimeofday
+#include "lssdp.h"
+
+/* pcap_replay.c
+ *
+ * replay recorded SSDP packets of pcap / pcapng file, and show the result
+ *
+ * 1. subscribe search target (default "*" matches all)
+ * 2. replay file as fast as possible, or at recorded pace (-r)
+ * 3. show throughput and the final neighbor list
+ */
+
+void log_callback(const char * file, const char * tag, int level, int line, const char * func, const char * message) {
+    char * level_name = "DEBUG";
+    if (level == LSSDP_LOG_INFO)   level_name = "INFO";
+    if (level == LSSDP_LOG_WARN)   level_name = "WARN";
+    if (level == LSSDP_LOG_ERROR)  level_name = "ERROR";
+
+    printf("[%-5s][%s] %s", level_name, tag, message);
+}
+
+long long get_current_time_us() {
+    struct timeval time = {};
+    if (gettimeofday(&time, NULL) == -1) {
+        printf("gettimeofday failed, errno = %s (%d)\n", strerror(errno), errno);
+        return -1;
+    }
+    return (long long) time.tv_sec * 1000000 + (long long) time.tv_usec;
+}
+
+int show_neighbor_list(lssdp_ctx * lssdp) {
+    int i = 0;
+    lssdp_nbr * nbr;
+    printf("\nSSDP List (%zu):\n", lssdp->neighbor_num);
+    for (nbr = lssdp->neighbor_list; nbr != NULL; nbr = nbr->next) {
+        printf("%d. ip = %-16s, st = %-20s, usn = %-24s, location = %s\n",
+            ++i,
+            nbr->ip,
+            nbr->st,
+            nbr->usn,
+            nbr->location
+        );
+    }
+    printf("%s\n", i == 0 ? "Empty" : "");
+    return 0;
+}
+
+void show_usage(const char * name) {
+    printf(
+        "Usage: %s [options] file\n"
+        "  -r           replay at recorded pace (default as fast as possible)\n"
+        "  -p port      SSDP port           (default 1900)\n"
+        "  -s st        subscription        (default *)\n"
+        "  -v           debug\n",
+        name
+    );
+}
+
+int main(int argc, char * argv[]) {
+    lssdp_set_log_callback(log_callback);
+
+    lssdp_ctx lssdp = {
+        .port = 1900
+    };
+
+    bool is_realtime = false;
+    const char * search_target = "*";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "rp:s:vh")) != -1) {
+        switch (opt) {
+            case 'r': is_realtime   = true;         break;
+            case 'p': lssdp.port    = atoi(optarg); break;
+            case 's': search_target = optarg;       break;
+            case 'v': lssdp.debug   = true;         break;
+            default:
+                show_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc) {
+        show_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // 1. subscribe search target
+    if (lssdp_subscription_add(&lssdp, search_target) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    // 2. replay
+    long long start_time = get_current_time_us();
+    int packet_num = lssdp_pcap_replay(&lssdp, argv[optind], is_realtime);
+    long long run_time = get_current_time_us() - start_time;
+    int result = EXIT_SUCCESS;
+    if (packet_num < 0) {
+        printf("replay %s failed\n", argv[optind]);
+        result = EXIT_FAILURE;
+        goto end;
+    }
+
+    // 3. show result
+    show_neighbor_list(&lssdp);
+    printf("Replay Report:\n");
+    printf("  SSDP packets        : %d\n", packet_num);
+    printf("  replay time         : %.3f ms\n", run_time / 1000.0);
+    printf("  throughput          : %.0f packets/sec\n", run_time > 0 ? packet_num * 1000000.0 / run_time : 0.0);
+    printf("  neighbor number     : %zu\n", lssdp.neighbor_num);
+
+end:
+    // clean up neighbor list and subscriptions
+    lssdp_socket_close(&lssdp);
+    lssdp_subscription_remove_all(&lssdp);
+    return result;
+}
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>     // getopt, usleep
+#include "lssdp.h"
+
+/* shm_reader.c
+ *
+ * read SSDP neighbor table which is published by daemon.exe in shared memory
+ *
+ * 1. open shared memory table (default "/lssdp"), read-only
+ * 2. copy the table without lock and syscall, and show neighbor list
+ * 3. repeat per interval seconds (-i), or show once
+ */
+
+#define NEIGHBOR_MAX_NUM    1024
+
+void log_callback(const char * file, const char * tag, int level, int line, const char * func, const char * message) {
+    char * level_name = "DEBUG";
+    if (level == LSSDP_LOG_INFO)   level_name = "INFO";
+    if (level == LSSDP_LOG_WARN)   level_name = "WARN";
+    if (level == LSSDP_LOG_ERROR)  level_name = "ERROR";
+
+    printf("[%-5s][%s] %s", level_name, tag, message);
+}
+
+void show_usage(const char * name) {
+    printf(
+        "Usage: %s [options]\n"
+        "  -n name      shared memory name  (default /lssdp)\n"
+        "  -i seconds   show per interval   (default 0: show once)\n",
+        name
+    );
+}
+
+int main(int argc, char * argv[]) {
+    lssdp_set_log_callback(log_callback);
+
+    const char * name = "/lssdp";
+    int interval = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:i:h")) != -1) {
+        switch (opt) {
+            case 'n': name     = optarg;       break;
+            case 'i': interval = atoi(optarg); break;
+            default:
+                show_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    // 1. open shared memory table
+    lssdp_shm_reader reader = {};
+    if (lssdp_shm_reader_open(&reader, name) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    static lssdp_shm_nbr list[NEIGHBOR_MAX_NUM];
+    int result = EXIT_SUCCESS;
+    for (;;) {
+        // 2. copy table and show neighbor list
+        int num = lssdp_shm_reader_read(&reader, list, NEIGHBOR_MAX_NUM);
+        if (num < 0) {
+            result = EXIT_FAILURE;
+            break;
+        }
+
+        printf("\nSSDP List (%d):\n", num);
+        int i;
+        for (i = 0; i < num; i++) {
+            printf("%d. ip = %-16s, st = %-20s, usn = %-24s, location = %s (%lld)\n",
+                i + 1,
+                list[i].ip,
+                list[i].st,
+                list[i].usn,
+                list[i].location,
+                (long long) list[i].update_time
+            );
+        }
+        printf("%s\n", i == 0 ? "Empty" : "");
+
+        // 3. repeat per interval
+        if (interval <= 0) {
+            break;
+        }
+        sleep(interval);
+    }
+
+    lssdp_shm_reader_close(&reader);
+    return result;
+}
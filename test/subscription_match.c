@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>      // htons, htonl
+#include <netinet/in.h>     // struct sockaddr_in
+#include "lssdp.h"
+
+/* subscription_match.c
+ *
+ * search target of a neighbor is matched again when subscriptions or header.search_target are changed,
+ * even if the neighbor keeps sending the same datagram (datagram fast path)
+ *
+ * 1. the same NOTIFY is ingested before and after each change
+ * 2. the neighbor must be linked to the expected subscription (exact > header.search_target > longest prefix)
+ * 3. show result of each case, exit code is the failed case number
+ */
+
+#define NOTIFY_ST   "urn:device:printer:1"
+
+void log_callback(const char * file, const char * tag, int level, int line, const char * func, const char * message) {
+    if (level < LSSDP_LOG_WARN) {
+        return;
+    }
+    fprintf(stderr, "[%-5s][%s] %s", level == LSSDP_LOG_WARN ? "WARN" : "ERROR", tag, message);
+}
+
+int ingest_notify(lssdp_ctx * lssdp) {
+    const char * packet =
+        "NOTIFY * HTTP/1.1\r\n"
+        "HOST: 239.255.255.250:1900\r\n"
+        "CACHE-CONTROL: max-age=1800\r\n"
+        "LOCATION: http://10.0.0.1:5678/desc.xml\r\n"
+        "NT: " NOTIFY_ST "\r\n"
+        "NTS: ssdp:alive\r\n"
+        "USN: uuid:printer-1\r\n"
+        "\r\n";
+
+    struct sockaddr_in address = {
+        .sin_family      = AF_INET,
+        .sin_port        = htons(1900),
+        .sin_addr.s_addr = htonl(0x0A000001)
+    };
+    return lssdp_ingest(lssdp, packet, strlen(packet), (struct sockaddr *) &address, 0);
+}
+
+lssdp_subscription * find_subscription(lssdp_ctx * lssdp, const char * search_target) {
+    lssdp_subscription * s;
+    for (s = lssdp->subscription_list; s != NULL; s = s->next) {
+        if (strcmp(s->search_target, search_target) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// expect: search target of the matched subscription, NULL is header.search_target, "" is no neighbor
+int check(lssdp_ctx * lssdp, const char * name, const char * expect) {
+    ingest_notify(lssdp);
+
+    lssdp_nbr * nbr = lssdp->neighbor_list;
+    bool is_pass;
+    if (expect != NULL && strlen(expect) == 0) {
+        is_pass = nbr == NULL;
+    } else if (nbr == NULL) {
+        is_pass = false;
+    } else if (expect == NULL) {
+        is_pass = nbr->subscription == NULL;
+    } else {
+        // linked to the subscription, and in its neighbor list
+        lssdp_subscription * s = find_subscription(lssdp, expect);
+        is_pass = s != NULL && nbr->subscription == s && s->neighbor_list == nbr && s->neighbor_num == 1;
+    }
+
+    printf("  %-44s: %s\n", name, is_pass ? "pass" : "FAIL");
+    return is_pass ? 0 : 1;
+}
+
+int main() {
+    lssdp_set_log_callback(log_callback);
+    lssdp_ctx config = {
+        .port = 1900,
+        .header = {
+            .search_target       = "ST_OTHER",
+            .unique_service_name = "f835dd000001"
+        }
+    };
+
+    lssdp_ctx * lssdp = lssdp_ctx_new(&config);
+    if (lssdp == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    printf("Subscription Match Report\n");
+    int fail = 0;
+
+    // 1. not matched, then subscribed by prefix
+    fail += check(lssdp, "not subscribed", "");
+    lssdp_subscription_add(lssdp, "urn:device:*");
+    fail += check(lssdp, "prefix subscription is added", "urn:device:*");
+
+    // 2. a longer prefix, then exact subscription is preferred
+    lssdp_subscription_add(lssdp, "urn:device:printer:*");
+    fail += check(lssdp, "longer prefix subscription is added", "urn:device:printer:*");
+    lssdp_subscription_add(lssdp, NOTIFY_ST);
+    fail += check(lssdp, "exact subscription is added", NOTIFY_ST);
+
+    // 3. header.search_target is preferred to prefix subscriptions
+    lssdp_subscription_remove(lssdp, NOTIFY_ST);
+    fail += check(lssdp, "exact subscription is removed", "urn:device:printer:*");
+    snprintf(lssdp->header.search_target, LSSDP_FIELD_LEN, "%s", NOTIFY_ST);
+    fail += check(lssdp, "header.search_target is changed", NULL);
+    snprintf(lssdp->header.search_target, LSSDP_FIELD_LEN, "%s", "ST_OTHER");
+    fail += check(lssdp, "header.search_target is changed back", "urn:device:printer:*");
+
+    printf("  failed      : %d\n", fail);
+    lssdp_ctx_free(lssdp);
+    return fail;
+}